@@ -0,0 +1,119 @@
+#include "assembler.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+// assembles a generated source of N lines (default 1000000) and reports throughput
+
+namespace {
+
+std::string generate_source(size_t num_lines) {
+    std::string text = "main:\n";
+    for (size_t i = 0; text.size() < num_lines * 24 && i < num_lines; i += 8) {
+        std::string block = std::to_string(i);
+        text += "block" + block + ":\n";
+        text += "    addi $t0, $t0, " + block + "\n";
+        text += "    lw $t1, 4($sp)\n";
+        text += "    add $t2, $t0, $t1   # running sum\n";
+        text += "    sw $t2, 8($sp)\n";
+        text += "    beq $t2, $zero, block" + block + "\n";
+        text += "    j next" + block + "\n";
+        text += "    .asciiz \"line " + block + ", with spaces\"\n";
+        text += "next" + block + ":\n";
+    }
+    text += "    trap 5\n";
+    return text;
+}
+
+// heap held by the string form of the lines
+size_t listing_bytes(const std::vector<mips::AssemblyLine>& lines) {
+    auto string_bytes = [](const std::string& text) {
+        return text.capacity() > 15 ? text.capacity() + 1 : 0; // beyond the small string buffer
+    };
+    size_t bytes = lines.capacity() * sizeof(mips::AssemblyLine);
+    for (const auto& line : lines) {
+        bytes += string_bytes(line.label) + string_bytes(line.instruction);
+        bytes += line.operands.capacity() * sizeof(std::string);
+        for (const auto& operand : line.operands) {
+            bytes += string_bytes(operand);
+        }
+    }
+    return bytes;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t num_lines = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 1000000;
+    std::string source = generate_source(num_lines);
+    double megabytes = source.size() / 1e6;
+    std::cout << std::fixed << std::setprecision(2) << "source: " << megabytes << " MB" << std::endl;
+    
+    // tokens only, no IR
+    auto start = std::chrono::steady_clock::now();
+    mips::SourceScanner scanner(source);
+    mips::ScannedLine scanned;
+    std::string_view line;
+    size_t tokens = 0;
+    while (scanner.next_line(line)) {
+        mips::SourceScanner::scan(line, scanned);
+        tokens += !scanned.label.empty() + !scanned.mnemonic.empty() + scanned.operands.size();
+    }
+    double scan_seconds = seconds_since(start);
+    std::cout << "scan:     " << std::setw(8) << scan_seconds * 1000 << " ms, " << std::setw(8)
+              << megabytes / scan_seconds << " MB/s (" << tokens << " tokens)" << std::endl;
+    
+    mips::Assembler parser;
+    start = std::chrono::steady_clock::now();
+    auto lines = parser.parse_assembly(source);
+    double parse_seconds = seconds_since(start);
+    std::cout << "parse:    " << std::setw(8) << parse_seconds * 1000 << " ms, " << std::setw(8)
+              << megabytes / parse_seconds << " MB/s (" << lines.size() << " lines, "
+              << listing_bytes(lines) / 1e6 << " MB as strings)" << std::endl;
+    
+    mips::Assembler assembler;
+    start = std::chrono::steady_clock::now();
+    auto binary = assembler.assemble_text(source);
+    double total_seconds = seconds_since(start);
+    if (assembler.has_errors()) {
+        std::cerr << "Error: " << assembler.get_errors()[0] << std::endl;
+        return 1;
+    }
+    std::cout << "assemble: " << std::setw(8) << total_seconds * 1000 << " ms, " << std::setw(8)
+              << megabytes / total_seconds << " MB/s (" << binary.size() << " bytes, "
+              << assembler.program().memory_usage() / 1e6 << " MB as IR)" << std::endl;
+    
+    // single pass from a stream, nothing but the output and the labels is kept
+    std::istringstream input(source);
+    mips::Assembler streaming;
+    start = std::chrono::steady_clock::now();
+    auto streamed = streaming.assemble_stream(input);
+    double stream_seconds = seconds_since(start);
+    if (streamed != binary) {
+        std::cerr << "Error: streaming output differs" << std::endl;
+        return 1;
+    }
+    std::cout << "stream:   " << std::setw(8) << stream_seconds * 1000 << " ms, " << std::setw(8)
+              << megabytes / stream_seconds << " MB/s" << std::endl;
+    
+    // chunks on every hardware thread
+    mips::ThreadPool pool;
+    mips::Assembler parallel;
+    start = std::chrono::steady_clock::now();
+    auto chunked = parallel.assemble_parallel(source, pool);
+    double parallel_seconds = seconds_since(start);
+    if (chunked != binary) {
+        std::cerr << "Error: parallel output differs" << std::endl;
+        return 1;
+    }
+    std::cout << "parallel: " << std::setw(8) << parallel_seconds * 1000 << " ms, " << std::setw(8)
+              << megabytes / parallel_seconds << " MB/s (" << pool.size() << " threads)" << std::endl;
+    return 0;
+}
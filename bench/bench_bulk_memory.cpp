@@ -0,0 +1,139 @@
+#include "mips_core.h"
+#include "assembler.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+
+// compares guest lb/sb copy and fill loops against the native bulk memory traps
+
+namespace {
+
+// copies 16KB from 0x10000 to 0x20000, 64 times
+const char* COPY_LOOP = R"(
+main:
+    lhi $a0, 1
+    addi $a1, $zero, 90
+    addi $a2, $zero, 16384
+    trap 8
+    lhi $s0, 1
+    lhi $s1, 2
+    addi $s3, $zero, 64
+outer:
+    addi $t0, $s0, 0
+    addi $t1, $s1, 0
+    addi $t2, $zero, 16384
+copy:
+    lb $t3, 0($t0)
+    sb $t3, 0($t1)
+    addi $t0, $t0, 1
+    addi $t1, $t1, 1
+    addi $t2, $t2, -1
+    bgtz $t2, copy
+    addi $s3, $s3, -1
+    bgtz $s3, outer
+    trap 5
+)";
+
+const char* COPY_TRAP = R"(
+main:
+    lhi $a0, 1
+    addi $a1, $zero, 90
+    addi $a2, $zero, 16384
+    trap 8
+    lhi $s0, 1
+    lhi $s1, 2
+    addi $s3, $zero, 64
+outer:
+    addi $a0, $s1, 0
+    addi $a1, $s0, 0
+    addi $a2, $zero, 16384
+    trap 6
+    addi $s3, $s3, -1
+    bgtz $s3, outer
+    trap 5
+)";
+
+// fills 16KB at 0x30000 with a byte, 64 times
+const char* FILL_LOOP = R"(
+main:
+    lhi $s0, 3
+    addi $s3, $zero, 64
+outer:
+    addi $t0, $s0, 0
+    addi $t2, $zero, 16384
+    addi $t3, $zero, 7
+fill:
+    sb $t3, 0($t0)
+    addi $t0, $t0, 1
+    addi $t2, $t2, -1
+    bgtz $t2, fill
+    addi $s3, $s3, -1
+    bgtz $s3, outer
+    trap 5
+)";
+
+const char* FILL_TRAP = R"(
+main:
+    lhi $s0, 3
+    addi $s3, $zero, 64
+outer:
+    addi $a0, $s0, 0
+    addi $a1, $zero, 7
+    addi $a2, $zero, 16384
+    trap 8
+    addi $s3, $s3, -1
+    bgtz $s3, outer
+    trap 5
+)";
+
+struct BenchResult {
+    uint64_t instructions;
+    double milliseconds;
+};
+
+BenchResult run_guest(const std::string& source) {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(source);
+    if (assembler.has_errors()) {
+        throw std::runtime_error("benchmark program failed to assemble: " + assembler.get_errors()[0]);
+    }
+    
+    mips::CPU cpu;
+    cpu.get_state().load_memory(binary, 0);
+    cpu.get_state().set_pc(assembler.get_main_address());
+    
+    uint64_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (!cpu.is_halted()) {
+        cpu.run_single_step();
+        steps++;
+    }
+    auto end = std::chrono::steady_clock::now();
+    
+    return {steps, std::chrono::duration<double, std::milli>(end - start).count()};
+}
+
+void compare(const std::string& name, const char* loop_source, const char* trap_source) {
+    BenchResult loop = run_guest(loop_source);
+    BenchResult trap = run_guest(trap_source);
+    
+    std::cout << std::left << std::setw(8) << name
+              << " loop: " << std::setw(10) << loop.instructions << " instr " << std::fixed << std::setprecision(2)
+              << std::setw(9) << loop.milliseconds << " ms | trap: " << std::setw(6) << trap.instructions
+              << " instr " << std::setw(7) << trap.milliseconds << " ms | speedup "
+              << (trap.milliseconds > 0 ? loop.milliseconds / trap.milliseconds : 0.0) << "x" << std::endl;
+}
+
+} // namespace
+
+int main() {
+    try {
+        compare("memcpy", COPY_LOOP, COPY_TRAP);
+        compare("memset", FILL_LOOP, FILL_TRAP);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
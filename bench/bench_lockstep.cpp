@@ -0,0 +1,142 @@
+#include "mips_core.h"
+#include "assembler.h"
+#include "lockstep.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// runs eight instances of a data-parallel kernel one after another and as one lockstep batch
+
+namespace {
+
+// hashes n (read from input) through 200000 rounds of xorshift-style mixing
+const char* MIX_KERNEL = R"(
+main:
+    trap 3
+    addi $a0, $v0, 0
+    lhi $s0, 3
+    addi $s0, $s0, 3392
+loop:
+    sll $t0, $a0, 13
+    xor $a0, $a0, $t0
+    srl $t0, $a0, 17
+    xor $a0, $a0, $t0
+    sll $t0, $a0, 5
+    xor $a0, $a0, $t0
+    addiu $a0, $a0, 12345
+    addi $s0, $s0, -1
+    bgtz $s0, loop
+    trap 0
+    trap 5
+)";
+
+// sums a 4096-word table 50 times, the table is built per instance
+const char* TABLE_KERNEL = R"(
+main:
+    trap 3
+    addi $s2, $v0, 0
+    lhi $s1, 1
+    addi $t0, $zero, 0
+    addi $t9, $zero, 4096
+fill:
+    sll $t1, $t0, 2
+    addu $t1, $t1, $s1
+    addu $t2, $t0, $s2
+    sw $t2, 0($t1)
+    addi $t0, $t0, 1
+    bne $t0, $t9, fill
+    addi $a0, $zero, 0
+    addi $s3, $zero, 50
+outer:
+    addi $t0, $zero, 0
+sum:
+    sll $t1, $t0, 2
+    addu $t1, $t1, $s1
+    lw $t2, 0($t1)
+    addu $a0, $a0, $t2
+    addi $t0, $t0, 1
+    bne $t0, $t9, sum
+    addi $s3, $s3, -1
+    bgtz $s3, outer
+    trap 0
+    trap 5
+)";
+
+struct Instance {
+    std::istringstream input;
+    std::ostringstream output;
+    mips::CPU cpu;
+};
+
+std::vector<std::unique_ptr<Instance>> load(const std::vector<uint8_t>& binary, uint32_t main_address) {
+    std::vector<std::unique_ptr<Instance>> instances;
+    for (size_t i = 0; i < mips::LockstepBatch::LANES; ++i) {
+        auto instance = std::make_unique<Instance>();
+        instance->input.str(std::to_string(i * 7 + 1));
+        instance->cpu.get_state().input_stream = &instance->input;
+        instance->cpu.get_state().output_stream = &instance->output;
+        instance->cpu.get_state().load_memory(binary, 0);
+        instance->cpu.get_state().set_pc(main_address);
+        instances.push_back(std::move(instance));
+    }
+    return instances;
+}
+
+void compare(const std::string& name, const char* source) {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(source);
+    if (assembler.has_errors()) {
+        throw std::runtime_error("benchmark program failed to assemble: " + assembler.get_errors()[0]);
+    }
+    
+    auto scalar = load(binary, assembler.get_main_address());
+    uint64_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto& instance : scalar) {
+        while (!instance->cpu.is_halted()) {
+            instance->cpu.run_single_step();
+            steps++;
+        }
+    }
+    double scalar_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << std::left << std::setw(6) << name << " scalar: " << std::fixed << std::setprecision(2)
+              << std::setw(9) << scalar_ms << " ms";
+    for (auto isa : {mips::LockstepIsa::BASELINE, mips::LockstepIsa::AVX2}) {
+        if (isa == mips::LockstepIsa::AVX2 && !mips::LockstepBatch::host_has_avx2()) continue;
+        auto lanes = load(binary, assembler.get_main_address());
+        std::vector<mips::CPU*> cpus;
+        for (auto& instance : lanes) cpus.push_back(&instance->cpu);
+        
+        start = std::chrono::steady_clock::now();
+        mips::LockstepBatch batch(cpus, isa);
+        batch.run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            if (lanes[i]->output.str() != scalar[i]->output.str()) {
+                throw std::runtime_error(name + ": lockstep output differs in lane " + std::to_string(i));
+            }
+        }
+        std::cout << " | " << (isa == mips::LockstepIsa::AVX2 ? "avx2: " : "baseline: ") << std::setw(8) << ms
+                  << " ms (" << (ms > 0 ? scalar_ms / ms : 0.0) << "x)";
+    }
+    std::cout << " | " << steps << " instr" << std::endl;
+}
+
+} // namespace
+
+int main() {
+    try {
+        compare("mix", MIX_KERNEL);
+        compare("table", TABLE_KERNEL);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "assembler.h"
+#include "guest_session.h"
+#include "program_image.h"
+#include "scheduler.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// runs many guests back to back on one thread and on the scheduler, then feeds an
+// interactive guest one number at a time to time parking and waking
+
+namespace {
+
+// hashes n (read from input) through 50000 rounds of xorshift-style mixing
+const char* MIX_KERNEL = R"(
+main:
+    trap 3
+    addi $a0, $v0, 0
+    addi $s0, $zero, 25000
+    addu $s0, $s0, $s0
+loop:
+    sll $t0, $a0, 13
+    xor $a0, $a0, $t0
+    srl $t0, $a0, 17
+    xor $a0, $a0, $t0
+    sll $t0, $a0, 5
+    xor $a0, $a0, $t0
+    addiu $a0, $a0, 12345
+    addi $s0, $s0, -1
+    bgtz $s0, loop
+    trap 0
+    trap 5
+)";
+
+// echoes numbers until it reads 0
+const char* ECHO_KERNEL = R"(
+main:
+    trap 3
+    beq $v0, $zero, done
+    addi $a0, $v0, 0
+    trap 0
+    j main
+done:
+    trap 5
+)";
+
+const size_t GUESTS = 64;
+const size_t ROUNDS = 2000;
+
+std::shared_ptr<const mips::ProgramImage> build(const char* source) {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(source);
+    if (assembler.has_errors()) {
+        throw std::runtime_error("benchmark program failed to assemble: " + assembler.get_errors()[0]);
+    }
+    return std::make_shared<const mips::ProgramImage>(binary, assembler.get_main_address());
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void batch() {
+    auto image = build(MIX_KERNEL);
+    
+    std::vector<std::string> expected;
+    uint64_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < GUESTS; ++i) {
+        mips::GuestSession session(image);
+        session.provide_input(std::to_string(i * 7 + 1) + "\n");
+        session.resume();
+        expected.push_back(session.output());
+        steps += session.instructions();
+    }
+    double serial_ms = elapsed_ms(start);
+    
+    start = std::chrono::steady_clock::now();
+    mips::Scheduler scheduler;
+    for (size_t i = 0; i < GUESTS; ++i) {
+        scheduler.add_guest(image, std::to_string(i * 7 + 1) + "\n");
+    }
+    scheduler.wait_all();
+    double ms = elapsed_ms(start);
+    for (size_t i = 0; i < GUESTS; ++i) {
+        if (scheduler.get_status(i).output != expected[i]) {
+            throw std::runtime_error("batch: scheduled output differs for guest " + std::to_string(i));
+        }
+    }
+    
+    std::cout << std::left << std::setw(12) << "batch" << " back to back: " << std::fixed << std::setprecision(2)
+              << std::setw(9) << serial_ms << " ms | scheduler (" << scheduler.num_workers() << " workers): "
+              << std::setw(9) << ms << " ms (" << (ms > 0 ? serial_ms / ms : 0.0) << "x) | " << steps
+              << " instr" << std::endl;
+}
+
+void interactive() {
+    auto image = build(ECHO_KERNEL);
+    
+    mips::GuestSession session(image);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 1; round <= ROUNDS; ++round) {
+        session.provide_input(std::to_string(round) + "\n");
+        session.resume();
+    }
+    session.provide_input("0\n");
+    session.resume();
+    double serial_ms = elapsed_ms(start);
+    
+    mips::Scheduler scheduler;
+    start = std::chrono::steady_clock::now();
+    size_t id = scheduler.add_guest(image);
+    for (size_t round = 1; round <= ROUNDS; ++round) {
+        scheduler.provide_input(id, std::to_string(round) + "\n");
+        scheduler.wait(id);
+    }
+    scheduler.provide_input(id, "0\n");
+    scheduler.wait(id);
+    double ms = elapsed_ms(start);
+    if (scheduler.get_status(id).output != session.output()) {
+        throw std::runtime_error("interactive: scheduled output differs");
+    }
+    
+    std::cout << std::left << std::setw(12) << "interactive" << " back to back: " << std::fixed
+              << std::setprecision(2) << std::setw(9) << serial_ms << " ms | scheduler: " << std::setw(9) << ms
+              << " ms (" << (ms * 1000 / (ROUNDS + 1)) << " us per wake) | " << ROUNDS + 1 << " inputs"
+              << std::endl;
+}
+
+} // namespace
+
+int main() {
+    try {
+        batch();
+        interactive();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "asm_ir.h"
+#include <algorithm>
+#include <cstring>
+
+namespace mips {
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(alignment - 1);
+    if (!cursor_ || aligned + size > reinterpret_cast<uintptr_t>(end_)) {
+        size_t block_size = std::max(next_block_, size + alignment);
+        blocks_.emplace_back(new char[block_size]);
+        reserved_ += block_size;
+        if (block_size == next_block_) {
+            // an oversized block is used for its request only, the regular one continues
+            cursor_ = blocks_.back().get();
+            end_ = cursor_ + block_size;
+            next_block_ = std::min(next_block_ * 2, MAX_BLOCK);
+        } else {
+            uintptr_t start = reinterpret_cast<uintptr_t>(blocks_.back().get());
+            return reinterpret_cast<void*>((start + alignment - 1) & ~(alignment - 1));
+        }
+        aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(alignment - 1);
+    }
+    cursor_ = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) return std::string_view();
+    char* data = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(data, text.data(), text.size());
+    return std::string_view(data, text.size());
+}
+
+size_t SymbolTable::hash(std::string_view name) {
+    // FNV-1a, symbol names are short
+    uint64_t h = 14695981039346656037ull;
+    for (char c : name) {
+        h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return static_cast<size_t>(h);
+}
+
+uint32_t SymbolTable::find(std::string_view name) const {
+    if (slots_.empty()) return NONE;
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash(name) & mask; ; i = (i + 1) & mask) {
+        uint32_t id = slots_[i];
+        if (id == NONE || symbols_[id].name == name) return id;
+    }
+}
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    if ((symbols_.size() + 1) * 4 > slots_.size() * 3) {
+        grow(); // at most 3/4 full so probes stay short and always end
+    }
+    size_t mask = slots_.size() - 1;
+    size_t i = hash(name) & mask;
+    for (; slots_[i] != NONE; i = (i + 1) & mask) {
+        if (symbols_[slots_[i]].name == name) return slots_[i];
+    }
+    uint32_t id = static_cast<uint32_t>(symbols_.size());
+    symbols_.push_back(Symbol{arena_.copy(name), 0, false});
+    slots_[i] = id;
+    return id;
+}
+
+void SymbolTable::grow() {
+    std::vector<uint32_t> slots(slots_.empty() ? 64 : slots_.size() * 2, NONE);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < symbols_.size(); ++id) {
+        size_t i = hash(symbols_[id].name) & mask;
+        while (slots[i] != NONE) i = (i + 1) & mask;
+        slots[i] = id;
+    }
+    slots_.swap(slots);
+}
+
+} // namespace mips
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace mips {
+
+// bump allocator, nothing is freed before the arena goes away
+class Arena {
+public:
+    Arena() : cursor_(nullptr), end_(nullptr), next_block_(MIN_BLOCK), reserved_(0) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    std::string_view copy(std::string_view text);
+    
+    size_t bytes_reserved() const { return reserved_; }
+
+private:
+    static constexpr size_t MIN_BLOCK = 4096;
+    static constexpr size_t MAX_BLOCK = 1 << 20; // blocks double up to this, larger requests get their own
+    
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cursor_;
+    char* end_;
+    size_t next_block_;
+    size_t reserved_;
+};
+
+// append-only array in fixed chunks from an arena: elements never move and growing
+// never copies, only the chunk table is a regular vector
+template <typename T>
+class ArenaArray {
+    static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+
+public:
+    static constexpr size_t CHUNK = 1024;
+    
+    explicit ArenaArray(Arena& arena) : arena_(arena), size_(0) {}
+    
+    T& push_back(const T& value) {
+        if (size_ == chunks_.size() * CHUNK) {
+            chunks_.push_back(static_cast<T*>(arena_.allocate(sizeof(T) * CHUNK, alignof(T))));
+        }
+        T* slot = chunks_[size_ / CHUNK] + size_ % CHUNK;
+        *slot = value;
+        size_++;
+        return *slot;
+    }
+    
+    T& operator[](size_t index) { return chunks_[index / CHUNK][index % CHUNK]; }
+    const T& operator[](size_t index) const { return chunks_[index / CHUNK][index % CHUNK]; }
+    size_t size() const { return size_; }
+    
+    // the chunks stay allocated and are reused
+    void clear() { size_ = 0; }
+    
+    size_t table_bytes() const { return chunks_.capacity() * sizeof(T*); }
+
+private:
+    Arena& arena_;
+    std::vector<T*> chunks_;
+    size_t size_;
+};
+
+// interned names with ids, used for labels and anything else that is not a number
+class SymbolTable {
+public:
+    static constexpr uint32_t NONE = 0xFFFFFFFF;
+    
+    explicit SymbolTable(Arena& arena) : arena_(arena), symbols_(arena) {}
+    
+    uint32_t intern(std::string_view name);
+    uint32_t find(std::string_view name) const; // NONE if never interned
+    
+    std::string_view name(uint32_t id) const { return symbols_[id].name; }
+    bool defined(uint32_t id) const { return symbols_[id].defined; }
+    uint32_t address(uint32_t id) const { return symbols_[id].address; }
+    void define(uint32_t id, uint32_t address) {
+        symbols_[id].address = address;
+        symbols_[id].defined = true;
+    }
+    void undefine(uint32_t id) { symbols_[id].defined = false; }
+    
+    size_t size() const { return symbols_.size(); }
+    size_t table_bytes() const { return symbols_.table_bytes() + slots_.capacity() * sizeof(uint32_t); }
+
+private:
+    struct Symbol {
+        std::string_view name; // copied into the arena
+        uint32_t address;
+        bool defined;
+    };
+    
+    Arena& arena_;
+    ArenaArray<Symbol> symbols_;
+    std::vector<uint32_t> slots_; // open addressing over symbol ids, NONE = empty
+    
+    static size_t hash(std::string_view name);
+    void grow();
+};
+
+enum class OperandKind : uint8_t {
+    REGISTER,       // reg
+    IMMEDIATE,      // value
+    SYMBOL,         // value = symbol id, labels and anything that did not parse
+    MEMORY,         // value(reg)
+    MEMORY_SYMBOL,  // symbol(reg), value = symbol id
+    STRING          // value = index into the string pool
+};
+
+struct IrOperand {
+    OperandKind kind;
+    uint8_t reg;
+    uint32_t value;
+};
+
+// mnemonic ids: instructions index the assembler's instruction table, directives follow
+// from DIRECTIVE_BASE
+constexpr uint16_t DIRECTIVE_BASE = 0x8000;
+constexpr uint16_t UNKNOWN_DIRECTIVE = 0xFFFE;   // ignored, like .text or .globl
+constexpr uint16_t UNKNOWN_INSTRUCTION = 0xFFFF; // reported when emitted
+
+// one source line with an instruction or directive, labels only live in the symbol table
+struct IrLine {
+    uint32_t address;
+    uint32_t size;
+    uint32_t first_operand;  // index into the operand pool
+    uint16_t num_operands;
+    uint16_t op;             // mnemonic id
+    uint32_t line_number;
+    uint32_t name;           // symbol id of an unknown mnemonic, for its error message
+};
+
+// how a reference to a not yet defined label is patched in once the label is known
+enum class FixupKind : uint8_t {
+    BRANCH,     // 16-bit word offset from the instruction after the branch
+    JUMP,       // 26-bit word address
+    IMMEDIATE,  // low 16 bits of the instruction
+    BYTE,       // .byte, .half and .word data
+    HALF,
+    WORD
+};
+
+struct Fixup {
+    FixupKind kind;
+    uint32_t address;     // of the instruction or data item to patch
+    uint32_t line_number;
+};
+
+// compact form of a parsed program: fixed-size records, pooled operands and interned
+// symbols, all in one arena that is released in one go
+class IrProgram {
+public:
+    IrProgram() : symbols(arena), lines(arena), operands(arena), strings(arena), end_address(0) {}
+    IrProgram(const IrProgram&) = delete;
+    IrProgram& operator=(const IrProgram&) = delete;
+    
+    Arena arena; // declared first, the tables below allocate from it
+    SymbolTable symbols;
+    ArenaArray<IrLine> lines;
+    ArenaArray<IrOperand> operands;
+    ArenaArray<std::string_view> strings; // decoded .ascii/.asciiz contents, in the arena
+    uint32_t end_address;                 // address after the last line
+    
+    // drops the lines but keeps the symbols and end_address, the chunks are reused
+    void clear_lines() {
+        lines.clear();
+        operands.clear();
+        strings.clear();
+    }
+    
+    // bytes held by the program, arena and index tables
+    size_t memory_usage() const {
+        return arena.bytes_reserved() + symbols.table_bytes() + lines.table_bytes()
+            + operands.table_bytes() + strings.table_bytes();
+    }
+};
+
+} // namespace mips
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mips {
+
+// one source line split into tokens, every view points into the scanned buffer
+struct ScannedLine {
+    std::string_view label;                  // without the ':'
+    std::string_view mnemonic;               // instruction or directive
+    std::vector<std::string_view> operands;  // string literals keep their quotes
+    const char* error = nullptr;             // set if the line could not be scanned
+    
+    void clear() {
+        label = std::string_view();
+        mnemonic = std::string_view();
+        operands.clear(); // keeps capacity, a reused ScannedLine stops allocating
+        error = nullptr;
+    }
+};
+
+// hand-written scanner over one contiguous buffer: tokens are separated by blanks and
+// commas, '#' starts a comment outside string literals and "..." literals may hold
+// blanks, commas, '#' and backslash escapes
+class SourceScanner {
+public:
+    // first_line numbers the first line of text, for a slice of a larger source
+    explicit SourceScanner(std::string_view text, uint32_t first_line = 1)
+        : text_(text), position_(0), line_number_(first_line - 1) {}
+    
+    // next line without its terminator, false at the end of the buffer
+    bool next_line(std::string_view& line) {
+        if (position_ >= text_.size()) return false;
+        const char* start = text_.data() + position_;
+        const void* newline = std::memchr(start, '\n', text_.size() - position_);
+        size_t length = newline ? static_cast<const char*>(newline) - start : text_.size() - position_;
+        position_ += length + 1;
+        line_number_++;
+        line = std::string_view(start, length);
+        return true;
+    }
+    
+    uint32_t line_number() const { return line_number_; }
+    size_t position() const { return position_; } // offset of the next line
+    
+    // splits one line, out is cleared first
+    static void scan(std::string_view line, ScannedLine& out) {
+        out.clear();
+        size_t i = 0;
+        size_t n = line.size();
+        bool first = true;
+        while (true) {
+            while (i < n && is_separator(line[i])) i++;
+            if (i >= n || line[i] == '#') return;
+            
+            size_t start = i;
+            if (line[i] == '"') {
+                for (i++; i < n && line[i] != '"'; i++) {
+                    if (line[i] == '\\') i++; // the escaped character cannot end the literal
+                }
+                if (i >= n) {
+                    out.error = "Unterminated string literal";
+                    return;
+                }
+                i++;
+            } else {
+                while (i < n && !is_separator(line[i]) && line[i] != '#' && line[i] != '"') i++;
+            }
+            std::string_view token = line.substr(start, i - start);
+            
+            if (first && token.size() > 1 && token.back() == ':') {
+                out.label = token.substr(0, token.size() - 1);
+            } else if (out.mnemonic.empty()) {
+                out.mnemonic = token;
+            } else {
+                out.operands.push_back(token);
+            }
+            first = false;
+        }
+    }
+    
+    // contents of a "..." literal with \n \t \r \0 \\ \" escapes decoded
+    static std::string decode_string(std::string_view literal) {
+        if (literal.size() >= 2 && literal.front() == '"' && literal.back() == '"') {
+            literal = literal.substr(1, literal.size() - 2);
+        }
+        std::string text;
+        text.reserve(literal.size());
+        for (size_t i = 0; i < literal.size(); ++i) {
+            char c = literal[i];
+            if (c == '\\' && i + 1 < literal.size()) {
+                switch (literal[++i]) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case '0': c = '\0'; break;
+                    default: c = literal[i]; break; // \\ and \" and anything else
+                }
+            }
+            text.push_back(c);
+        }
+        return text;
+    }
+
+private:
+    std::string_view text_;
+    size_t position_;
+    uint32_t line_number_;
+    
+    static bool is_separator(char c) {
+        return c == ' ' || c == '\t' || c == ',' || c == '\r';
+    }
+};
+
+// lines from a stream a block at a time, for sources that do not fit or have not all
+// arrived yet; a line view is valid until the next call
+class StreamLineReader {
+public:
+    explicit StreamLineReader(std::istream& input, size_t block_size = 1 << 16)
+        : input_(input), buffer_(block_size > 0 ? block_size : 1, '\0'), begin_(0), end_(0), line_number_(0) {}
+    
+    bool next_line(std::string_view& line) {
+        while (true) {
+            const void* newline = std::memchr(buffer_.data() + begin_, '\n', end_ - begin_);
+            if (newline) {
+                size_t length = static_cast<const char*>(newline) - (buffer_.data() + begin_);
+                line = std::string_view(buffer_.data() + begin_, length);
+                begin_ += length + 1;
+                line_number_++;
+                return true;
+            }
+            if (!refill()) {
+                if (begin_ == end_) return false;
+                line = std::string_view(buffer_.data() + begin_, end_ - begin_); // no final newline
+                begin_ = end_;
+                line_number_++;
+                return true;
+            }
+        }
+    }
+    
+    uint32_t line_number() const { return line_number_; }
+
+private:
+    std::istream& input_;
+    std::string buffer_;
+    size_t begin_; // unread bytes are [begin_, end_)
+    size_t end_;
+    uint32_t line_number_;
+    
+    // reads more after the partial line, false at the end of the stream
+    bool refill() {
+        if (!input_) return false;
+        if (begin_ > 0) {
+            std::memmove(&buffer_[0], buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2, '\0'); // a line longer than the buffer
+        }
+        input_.read(&buffer_[end_], static_cast<std::streamsize>(buffer_.size() - end_));
+        end_ += static_cast<size_t>(input_.gcount());
+        return input_.gcount() > 0;
+    }
+};
+
+} // namespace mips
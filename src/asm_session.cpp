@@ -0,0 +1,335 @@
+#include "asm_session.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mips {
+
+namespace {
+
+// lines like the scanner reads them, a last line without newline included
+std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    SourceScanner scanner(text);
+    std::string_view line;
+    while (scanner.next_line(line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+const int64_t UNDEFINED = -1;
+
+int64_t symbol_value(const SymbolTable& symbols, uint32_t id) {
+    return symbols.defined(id) ? symbols.address(id) : UNDEFINED;
+}
+
+} // namespace
+
+void AssemblySession::load(std::string_view text) {
+    last_edit_.old_count = lines_.size();
+    lines_.clear();
+    for (std::string_view line : split_lines(text)) {
+        lines_.emplace_back();
+        lines_.back().text = std::string(line);
+    }
+    last_edit_.first = 0;
+    last_edit_.count = lines_.size();
+    rebuild();
+}
+
+void AssemblySession::replace_lines(size_t first, size_t count, std::string_view text) {
+    replace(first, count, split_lines(text));
+}
+
+void AssemblySession::update(std::string_view text) {
+    std::vector<std::string_view> new_lines = split_lines(text);
+    size_t prefix = 0;
+    while (prefix < lines_.size() && prefix < new_lines.size() && lines_[prefix].text == new_lines[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < lines_.size() - prefix && suffix < new_lines.size() - prefix
+           && lines_[lines_.size() - 1 - suffix].text == new_lines[new_lines.size() - 1 - suffix]) {
+        suffix++;
+    }
+    if (prefix + suffix == lines_.size() && prefix + suffix == new_lines.size()) {
+        lines_encoded_ = 0; // nothing changed
+        last_edit_ = Edit();
+        return;
+    }
+    new_lines.erase(new_lines.end() - suffix, new_lines.end());
+    new_lines.erase(new_lines.begin(), new_lines.begin() + prefix);
+    replace(prefix, lines_.size() - prefix - suffix, new_lines);
+}
+
+std::vector<std::string> AssemblySession::get_errors() const {
+    // parse errors first, then encode errors, like the two-pass assembler
+    std::vector<std::string> errors;
+    for (size_t i = 0; i < lines_.size(); ++i) {
+        if (lines_[i].duplicate) {
+            errors.push_back("Line " + std::to_string(i + 1) + ": Duplicate label: "
+                             + std::string(assembler_.program_->symbols.name(lines_[i].label)));
+        }
+        for (const auto& error : lines_[i].parse_errors) {
+            errors.push_back("Line " + std::to_string(i + 1) + ": " + error);
+        }
+    }
+    if (!encode_errors_.empty()) {
+        for (size_t i = 0; i < lines_.size(); ++i) {
+            auto it = lines_[i].ir != SymbolTable::NONE ? encode_errors_.find(lines_[i].ir) : encode_errors_.end();
+            if (it != encode_errors_.end()) {
+                for (const auto& error : it->second) {
+                    errors.push_back("Line " + std::to_string(i + 1) + ": " + error);
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+bool AssemblySession::has_errors() const {
+    if (!encode_errors_.empty()) {
+        return true;
+    }
+    for (const auto& line : lines_) {
+        if (line.duplicate || !line.parse_errors.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AssemblySession::replace(size_t first, size_t count, const std::vector<std::string_view>& new_lines) {
+    if (first > lines_.size() || count > lines_.size() - first) {
+        throw std::out_of_range("Line range outside the source");
+    }
+    IrProgram& program = *assembler_.program_;
+    const SymbolTable& symbols = program.symbols;
+    lines_encoded_ = 0;
+    last_edit_.first = first;
+    last_edit_.count = new_lines.size();
+    last_edit_.old_count = count;
+    
+    // where the replaced lines sit in the output, and every label before the edit
+    uint32_t start = first < lines_.size() ? lines_[first].address : program.end_address;
+    uint32_t old_end = first + count < lines_.size() ? lines_[first + count].address : program.end_address;
+    std::vector<int64_t> before(symbols.size());
+    for (uint32_t id = 0; id < symbols.size(); ++id) {
+        before[id] = symbol_value(symbols, id);
+    }
+    
+    // the new lines are parsed, the old records stay behind unused
+    for (size_t i = first; i < first + count; ++i) {
+        kill(lines_[i].ir);
+    }
+    std::vector<SourceLine> added(new_lines.size());
+    std::vector<uint32_t> dirty;
+    uint64_t new_size = 0;
+    for (size_t i = 0; i < added.size(); ++i) {
+        added[i].text = std::string(new_lines[i]);
+        parse_line(added[i], static_cast<uint32_t>(first + i + 1));
+        if (added[i].ir != SymbolTable::NONE) {
+            dirty.push_back(added[i].ir);
+            new_size += program.lines[added[i].ir].size;
+        }
+    }
+    lines_.erase(lines_.begin() + first, lines_.begin() + first + count);
+    lines_.insert(lines_.begin() + first, std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+    
+    // the output after the edit moves as one block, the new lines start from zeros
+    uint32_t old_size = old_end - start;
+    if (overflowed_ || program.end_address - old_size + new_size > Assembler::MAX_END_ADDRESS) {
+        rebuild(); // some line does not fit, or did not before this edit
+        return;
+    }
+    if (new_size > old_size) {
+        binary_.insert(binary_.begin() + old_end, new_size - old_size, 0);
+    } else {
+        binary_.erase(binary_.begin() + start + new_size, binary_.begin() + old_end);
+    }
+    std::fill(binary_.begin() + start, binary_.begin() + start + new_size, 0);
+    layout();
+    int64_t shift = static_cast<int64_t>(new_size) - old_size;
+    uint32_t tail = start + static_cast<uint32_t>(new_size); // lines from here on moved by shift
+    
+    // a moved branch needs new bytes unless its target moved with it, anything else only
+    // if a label it uses changed
+    auto branch_changed = [&](const IrLine& line) {
+        if (line.num_operands == 0) {
+            return false; // an error that no address can fix
+        }
+        const IrOperand& target = program.operands[line.first_operand + line.num_operands - 1];
+        if (target.kind != OperandKind::SYMBOL) {
+            return false;
+        }
+        int64_t old_target = target.value < before.size() ? before[target.value] : UNDEFINED;
+        int64_t new_target = symbol_value(symbols, target.value);
+        if (old_target == UNDEFINED || new_target == UNDEFINED) {
+            return old_target != new_target;
+        }
+        int64_t old_address = line.address >= tail ? line.address - shift : line.address;
+        return new_target - line.address != old_target - old_address;
+    };
+    for (uint32_t id = 0; id < symbols.size(); ++id) {
+        int64_t old_value = id < before.size() ? before[id] : UNDEFINED;
+        auto users = users_.find(id);
+        if (old_value == symbol_value(symbols, id) || users == users_.end()) {
+            continue;
+        }
+        for (uint32_t ir : users->second) {
+            const IrLine& line = program.lines[ir];
+            if (line.size > 0 && (!Assembler::is_branch(line) || branch_changed(line))) {
+                dirty.push_back(ir);
+            }
+        }
+    }
+    if (shift != 0) {
+        for (size_t i = first + new_lines.size(); i < lines_.size(); ++i) {
+            uint32_t ir = lines_[i].ir;
+            if (ir != SymbolTable::NONE && Assembler::is_branch(program.lines[ir]) && branch_changed(program.lines[ir])) {
+                dirty.push_back(ir);
+            }
+        }
+    }
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    for (uint32_t ir : dirty) {
+        encode(ir);
+    }
+    
+    // start over once most records in the arena are dead
+    if (program.lines.size() > 2 * live_lines_ + 1024) {
+        rebuild();
+    }
+}
+
+void AssemblySession::rebuild() {
+    assembler_.program_.reset(new IrProgram());
+    assembler_.errors_.clear();
+    users_.clear();
+    encode_errors_.clear();
+    live_lines_ = 0;
+    overflowed_ = false;
+    for (size_t i = 0; i < lines_.size(); ++i) {
+        parse_line(lines_[i], static_cast<uint32_t>(i + 1));
+    }
+    layout();
+    
+    IrProgram& program = *assembler_.program_;
+    binary_.assign(program.end_address, 0);
+    lines_encoded_ = 0;
+    for (uint32_t ir = 0; ir < program.lines.size(); ++ir) {
+        encode(ir);
+    }
+}
+
+void AssemblySession::parse_line(SourceLine& line, uint32_t line_number) {
+    IrProgram& program = *assembler_.program_;
+    line.label = SymbolTable::NONE;
+    line.ir = SymbolTable::NONE;
+    line.parse_errors.clear();
+    SourceScanner::scan(line.text, scanned_);
+    if (scanned_.error) {
+        line.parse_errors.push_back(scanned_.error);
+        return;
+    }
+    if (!scanned_.label.empty()) {
+        line.label = program.symbols.intern(scanned_.label); // defined by layout
+    }
+    
+    size_t index = program.lines.size();
+    size_t errors = assembler_.errors_.size();
+    uint32_t end_address = program.end_address; // layout places the line, it only checks its own size
+    program.end_address = 0;
+    assembler_.add_line(std::string_view(), scanned_.mnemonic, scanned_.operands.data(), scanned_.operands.size(),
+                        line_number);
+    program.end_address = end_address;
+    take_errors(errors, line.parse_errors);
+    if (program.lines.size() == index) {
+        return;
+    }
+    line.ir = static_cast<uint32_t>(index);
+    live_lines_++;
+    const IrLine& ir_line = program.lines[index];
+    for (uint32_t i = 0; i < ir_line.num_operands; ++i) {
+        const IrOperand& operand = program.operands[ir_line.first_operand + i];
+        if (operand.kind == OperandKind::SYMBOL || operand.kind == OperandKind::MEMORY_SYMBOL) {
+            users_[operand.value].push_back(line.ir);
+        }
+    }
+}
+
+void AssemblySession::layout() {
+    // plain sums over the records, nothing is parsed or encoded
+    IrProgram& program = *assembler_.program_;
+    for (uint32_t id = 0; id < program.symbols.size(); ++id) {
+        program.symbols.undefine(id);
+    }
+    uint32_t address = 0;
+    for (size_t i = 0; i < lines_.size(); ++i) {
+        SourceLine& line = lines_[i];
+        line.address = address;
+        line.duplicate = line.label != SymbolTable::NONE && program.symbols.defined(line.label);
+        if (line.label != SymbolTable::NONE && !line.duplicate) {
+            program.symbols.define(line.label, address); // the first definition stands
+        }
+        if (line.ir != SymbolTable::NONE) {
+            IrLine& ir_line = program.lines[line.ir];
+            ir_line.address = address;
+            ir_line.line_number = static_cast<uint32_t>(i + 1);
+            if (ir_line.size > Assembler::MAX_END_ADDRESS - address) {
+                // dropped like the assembler drops it, the next edit rebuilds so it can return
+                kill(line.ir);
+                line.ir = SymbolTable::NONE;
+                line.parse_errors.push_back("Program does not fit in the 32-bit address space");
+                overflowed_ = true;
+                continue;
+            }
+            address += ir_line.size;
+        }
+    }
+    program.end_address = address;
+    uint32_t main = program.symbols.find("main");
+    main_address_ = main != SymbolTable::NONE && program.symbols.defined(main) ? program.symbols.address(main) : 0;
+}
+
+void AssemblySession::encode(uint32_t ir) {
+    const IrLine& line = assembler_.program_->lines[ir];
+    encode_errors_.erase(ir);
+    size_t errors = assembler_.errors_.size();
+    std::fill(binary_.begin() + line.address, binary_.begin() + line.address + line.size, 0);
+    try {
+        assembler_.emit_line(line, binary_.data() + line.address);
+    } catch (const std::invalid_argument& e) {
+        assembler_.add_error(e.what(), line.line_number); // a bad register, kept with the line
+    }
+    if (assembler_.errors_.size() > errors) {
+        take_errors(errors, encode_errors_[ir]);
+    }
+    lines_encoded_++;
+}
+
+void AssemblySession::kill(uint32_t ir) {
+    if (ir == SymbolTable::NONE) {
+        return;
+    }
+    // an empty unknown directive encodes to nothing, in case a label still lists it
+    IrLine& line = assembler_.program_->lines[ir];
+    line.op = UNKNOWN_DIRECTIVE;
+    line.size = 0;
+    line.num_operands = 0;
+    encode_errors_.erase(ir);
+    live_lines_--;
+}
+
+void AssemblySession::take_errors(size_t first, std::vector<std::string>& out) {
+    // the assembler's "Line N: " goes, the number is added when the errors are read
+    std::vector<std::string>& errors = assembler_.errors_;
+    for (size_t i = first; i < errors.size(); ++i) {
+        size_t colon = errors[i].find(": ");
+        out.push_back(colon == std::string::npos ? errors[i] : errors[i].substr(colon + 2));
+    }
+    errors.resize(first);
+}
+
+} // namespace mips
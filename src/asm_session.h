@@ -0,0 +1,84 @@
+#pragma once
+
+#include "assembler.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mips {
+
+// a program that stays assembled between edits: the IR, the labels and the output are
+// kept, an edit re-parses only the replaced lines, moves the output after them and
+// re-encodes only the lines whose bytes depend on an address that changed
+class AssemblySession {
+public:
+    AssemblySession() : main_address_(0), live_lines_(0), lines_encoded_(0), overflowed_(false) {}
+    
+    // assembles text from scratch
+    void load(std::string_view text);
+    
+    // replaces source lines [first, first + count), counted from 0, with the lines of text
+    void replace_lines(size_t first, size_t count, std::string_view text);
+    
+    // the new full source, only the lines between the unchanged start and end are replaced
+    void update(std::string_view text);
+    
+    // same bytes, main address and errors as Assembler::assemble_text on the current source,
+    // except that an invalid register name, which assemble_text throws as
+    // std::invalid_argument, is an error on its line here and never throws
+    const std::vector<uint8_t>& binary() const { return binary_; }
+    uint32_t get_main_address() const { return main_address_; }
+    std::vector<std::string> get_errors() const;
+    bool has_errors() const;
+    
+    size_t num_lines() const { return lines_.size(); }
+    const std::string& line_text(size_t index) const { return lines_[index].text; }
+    uint32_t line_address(size_t index) const { return lines_[index].address; }
+    const IrProgram& program() const { return assembler_.program(); }
+    
+    // lines encoded by the last load or edit
+    size_t lines_encoded() const { return lines_encoded_; }
+
+    // source lines the last load or edit replaced: old_count lines at first became count
+    // lines, the lines around them kept their text (not their addresses)
+    struct Edit {
+        size_t first = 0;
+        size_t count = 0;
+        size_t old_count = 0;
+    };
+    const Edit& last_edit() const { return last_edit_; }
+
+private:
+    struct SourceLine {
+        std::string text;
+        uint32_t address = 0;
+        uint32_t label = SymbolTable::NONE; // symbol id of the label defined here
+        uint32_t ir = SymbolTable::NONE;    // index into the program's lines
+        bool duplicate = false;             // label already defined by an earlier line
+        std::vector<std::string> parse_errors; // without the line number, it changes
+    };
+    
+    Assembler assembler_;
+    std::vector<SourceLine> lines_;
+    std::vector<uint8_t> binary_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> users_; // symbol id -> lines referencing it
+    std::unordered_map<uint32_t, std::vector<std::string>> encode_errors_; // by line record
+    ScannedLine scanned_;
+    uint32_t main_address_;
+    Edit last_edit_;
+    size_t live_lines_; // records still in use, replaced ones stay in the arena
+    size_t lines_encoded_;
+    bool overflowed_; // layout dropped lines past MAX_END_ADDRESS
+    
+    void replace(size_t first, size_t count, const std::vector<std::string_view>& new_lines);
+    void rebuild();
+    void parse_line(SourceLine& line, uint32_t line_number);
+    void layout();
+    void encode(uint32_t ir);
+    void kill(uint32_t ir);
+    void take_errors(size_t first, std::vector<std::string>& out);
+};
+
+} // namespace mips
@@ -1,8 +1,11 @@
 #include "assembler.h"
 #include <sstream>
+#include <iterator>
 #include <algorithm>
-#include <cctype>
 #include <fstream>
+#include <exception>
+#include <functional>
+#include <stdexcept>
 
 namespace mips {
 
@@ -27,291 +30,732 @@ uint32_t Directive::size() const {
 }
 
 // Assembler implementation
-Assembler::Assembler() : main_address_(0) {
-    init_instruction_tables();
-}
+namespace {
+
+// a mnemonic id below DIRECTIVE_BASE is the index into this table
+struct InstructionInfo {
+    const char* name;
+    InstructionType type;
+    InstructionCategory category;
+    uint32_t opcode;
+    uint32_t function; // R-type only
+};
 
-void Assembler::init_instruction_tables() {
+const InstructionInfo INSTRUCTIONS[] = {
     // R-type (opcode = 0!!!)
-    instruction_functions_["sll"] = 0b000000;
-    instruction_functions_["srl"] = 0b000010;
-    instruction_functions_["sra"] = 0b000011;
-    instruction_functions_["sllv"] = 0b000100;
-    instruction_functions_["srlv"] = 0b000110;
-    instruction_functions_["srav"] = 0b000111;
-    instruction_functions_["jr"] = 0b001000;
-    instruction_functions_["jalr"] = 0b001001;
-    instruction_functions_["mfhi"] = 0b010000;
-    instruction_functions_["mthi"] = 0b010001;
-    instruction_functions_["mflo"] = 0b010010;
-    instruction_functions_["mtlo"] = 0b010011;
-    instruction_functions_["mult"] = 0b011000;
-    instruction_functions_["multu"] = 0b011001;
-    instruction_functions_["div"] = 0b011010;
-    instruction_functions_["divu"] = 0b011011;
-    instruction_functions_["add"] = 0b100000;
-    instruction_functions_["addu"] = 0b100001;
-    instruction_functions_["sub"] = 0b100010;
-    instruction_functions_["subu"] = 0b100011;
-    instruction_functions_["and"] = 0b100100;
-    instruction_functions_["or"] = 0b100101;
-    instruction_functions_["xor"] = 0b100110;
-    instruction_functions_["nor"] = 0b100111;
-    instruction_functions_["slt"] = 0b101010;
-    instruction_functions_["sltu"] = 0b101011;
-
-    // I-type & J-type 
-    instruction_opcodes_["beq"] = 0b000100;
-    instruction_opcodes_["bne"] = 0b000101;
-    instruction_opcodes_["blez"] = 0b000110;
-    instruction_opcodes_["bgtz"] = 0b000111;
-    instruction_opcodes_["addi"] = 0b001000;
-    instruction_opcodes_["addiu"] = 0b001001;
-    instruction_opcodes_["slti"] = 0b001010;
-    instruction_opcodes_["sltiu"] = 0b001011;
-    instruction_opcodes_["andi"] = 0b001100;
-    instruction_opcodes_["ori"] = 0b001101;
-    instruction_opcodes_["xori"] = 0b001110;
-    instruction_opcodes_["llo"] = 0b011000;
-    instruction_opcodes_["lhi"] = 0b011001;
-    instruction_opcodes_["lb"] = 0b100000;
-    instruction_opcodes_["lh"] = 0b100001;
-    instruction_opcodes_["lw"] = 0b100011;
-    instruction_opcodes_["lbu"] = 0b100100;
-    instruction_opcodes_["lhu"] = 0b100101;
-    instruction_opcodes_["sb"] = 0b101000;
-    instruction_opcodes_["sh"] = 0b101001;
-    instruction_opcodes_["sw"] = 0b101011;
-    instruction_opcodes_["j"] = 0b000010;
-    instruction_opcodes_["jal"] = 0b000011;
-    instruction_opcodes_["trap"] = 0b011010;
-
-    // Instruction categories
-    instruction_categories_["add"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["addu"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["sub"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["subu"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["and"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["or"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["xor"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["nor"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["slt"] = InstructionCategory::ARITH_LOGIC;
-    instruction_categories_["sltu"] = InstructionCategory::ARITH_LOGIC;
-    
-    instruction_categories_["mult"] = InstructionCategory::DIV_MULT;
-    instruction_categories_["multu"] = InstructionCategory::DIV_MULT;
-    instruction_categories_["div"] = InstructionCategory::DIV_MULT;
-    instruction_categories_["divu"] = InstructionCategory::DIV_MULT;
-    
-    instruction_categories_["sll"] = InstructionCategory::SHIFT;
-    instruction_categories_["srl"] = InstructionCategory::SHIFT;
-    instruction_categories_["sra"] = InstructionCategory::SHIFT;
-    
-    instruction_categories_["sllv"] = InstructionCategory::SHIFT_REG;
-    instruction_categories_["srlv"] = InstructionCategory::SHIFT_REG;
-    instruction_categories_["srav"] = InstructionCategory::SHIFT_REG;
-    
-    instruction_categories_["jr"] = InstructionCategory::JUMP_REG;
-    instruction_categories_["jalr"] = InstructionCategory::JUMP_REG;
-    
-    instruction_categories_["mfhi"] = InstructionCategory::MOVE_FROM;
-    instruction_categories_["mflo"] = InstructionCategory::MOVE_FROM;
-    
-    instruction_categories_["mthi"] = InstructionCategory::MOVE_TO;
-    instruction_categories_["mtlo"] = InstructionCategory::MOVE_TO;
-    
-    instruction_categories_["addi"] = InstructionCategory::ARITH_LOGIC_IMM;
-    instruction_categories_["addiu"] = InstructionCategory::ARITH_LOGIC_IMM;
-    instruction_categories_["slti"] = InstructionCategory::ARITH_LOGIC_IMM;
-    instruction_categories_["sltiu"] = InstructionCategory::ARITH_LOGIC_IMM;
-    instruction_categories_["andi"] = InstructionCategory::ARITH_LOGIC_IMM;
-    instruction_categories_["ori"] = InstructionCategory::ARITH_LOGIC_IMM;
-    instruction_categories_["xori"] = InstructionCategory::ARITH_LOGIC_IMM;
-    
-    instruction_categories_["llo"] = InstructionCategory::LOAD_IMM;
-    instruction_categories_["lhi"] = InstructionCategory::LOAD_IMM;
+    {"sll", InstructionType::R_TYPE, InstructionCategory::SHIFT, 0, 0b000000},
+    {"srl", InstructionType::R_TYPE, InstructionCategory::SHIFT, 0, 0b000010},
+    {"sra", InstructionType::R_TYPE, InstructionCategory::SHIFT, 0, 0b000011},
+    {"sllv", InstructionType::R_TYPE, InstructionCategory::SHIFT_REG, 0, 0b000100},
+    {"srlv", InstructionType::R_TYPE, InstructionCategory::SHIFT_REG, 0, 0b000110},
+    {"srav", InstructionType::R_TYPE, InstructionCategory::SHIFT_REG, 0, 0b000111},
+    {"jr", InstructionType::R_TYPE, InstructionCategory::JUMP_REG, 0, 0b001000},
+    {"jalr", InstructionType::R_TYPE, InstructionCategory::JUMP_REG, 0, 0b001001},
+    {"mfhi", InstructionType::R_TYPE, InstructionCategory::MOVE_FROM, 0, 0b010000},
+    {"mthi", InstructionType::R_TYPE, InstructionCategory::MOVE_TO, 0, 0b010001},
+    {"mflo", InstructionType::R_TYPE, InstructionCategory::MOVE_FROM, 0, 0b010010},
+    {"mtlo", InstructionType::R_TYPE, InstructionCategory::MOVE_TO, 0, 0b010011},
+    {"mult", InstructionType::R_TYPE, InstructionCategory::DIV_MULT, 0, 0b011000},
+    {"multu", InstructionType::R_TYPE, InstructionCategory::DIV_MULT, 0, 0b011001},
+    {"div", InstructionType::R_TYPE, InstructionCategory::DIV_MULT, 0, 0b011010},
+    {"divu", InstructionType::R_TYPE, InstructionCategory::DIV_MULT, 0, 0b011011},
+    {"add", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100000},
+    {"addu", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100001},
+    {"sub", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100010},
+    {"subu", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100011},
+    {"and", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100100},
+    {"or", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100101},
+    {"xor", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100110},
+    {"nor", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b100111},
+    {"slt", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b101010},
+    {"sltu", InstructionType::R_TYPE, InstructionCategory::ARITH_LOGIC, 0, 0b101011},
+    {"sync", InstructionType::R_TYPE, InstructionCategory::SYNC, 0, 0b001111},
     
-    instruction_categories_["beq"] = InstructionCategory::BRANCH;
-    instruction_categories_["bne"] = InstructionCategory::BRANCH;
-    
-    instruction_categories_["blez"] = InstructionCategory::BRANCH_ZERO;
-    instruction_categories_["bgtz"] = InstructionCategory::BRANCH_ZERO;
+    // I-type & J-type
+    {"beq", InstructionType::I_TYPE, InstructionCategory::BRANCH, 0b000100, 0},
+    {"bne", InstructionType::I_TYPE, InstructionCategory::BRANCH, 0b000101, 0},
+    {"blez", InstructionType::I_TYPE, InstructionCategory::BRANCH_ZERO, 0b000110, 0},
+    {"bgtz", InstructionType::I_TYPE, InstructionCategory::BRANCH_ZERO, 0b000111, 0},
+    {"addi", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001000, 0},
+    {"addiu", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001001, 0},
+    {"slti", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001010, 0},
+    {"sltiu", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001011, 0},
+    {"andi", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001100, 0},
+    {"ori", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001101, 0},
+    {"xori", InstructionType::I_TYPE, InstructionCategory::ARITH_LOGIC_IMM, 0b001110, 0},
+    {"llo", InstructionType::I_TYPE, InstructionCategory::LOAD_IMM, 0b011000, 0},
+    {"lhi", InstructionType::I_TYPE, InstructionCategory::LOAD_IMM, 0b011001, 0},
+    {"lb", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b100000, 0},
+    {"lh", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b100001, 0},
+    {"lw", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b100011, 0},
+    {"lbu", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b100100, 0},
+    {"lhu", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b100101, 0},
+    {"sb", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b101000, 0},
+    {"sh", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b101001, 0},
+    {"sw", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b101011, 0},
+    {"ll", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b110000, 0},
+    {"sc", InstructionType::I_TYPE, InstructionCategory::LOAD_STORE, 0b111000, 0},
+    {"j", InstructionType::J_TYPE, InstructionCategory::JUMP, 0b000010, 0},
+    {"jal", InstructionType::J_TYPE, InstructionCategory::JUMP, 0b000011, 0},
+    {"trap", InstructionType::I_TYPE, InstructionCategory::TRAP, 0b011010, 0},
+};
+
+// directive ids are DIRECTIVE_BASE + DirectiveType
+const char* const DIRECTIVE_NAMES[] = {".byte", ".half", ".word", ".ascii", ".asciiz", ".space"};
+
+uint16_t directive_id(DirectiveType type) {
+    return static_cast<uint16_t>(DIRECTIVE_BASE + static_cast<uint16_t>(type));
+}
+
+// like std::stoul but over a view, and out-of-range values are rejected
+bool parse_number(std::string_view text, uint32_t& value) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i] == '-';
+        i++;
+    }
+    uint32_t base = 10;
+    if (text.size() - i > 2 && text[i] == '0' && (text[i + 1] == 'x' || text[i + 1] == 'X')) {
+        base = 16;
+        i += 2;
+    }
+    if (i >= text.size()) return false;
+    uint64_t result = 0;
+    for (; i < text.size(); ++i) {
+        char c = text[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        result = result * base + digit;
+        if (result > 0xFFFFFFFFull) return false;
+    }
+    value = negative ? 0u - static_cast<uint32_t>(result) : static_cast<uint32_t>(result);
+    return true;
+}
+
+bool parse_register(std::string_view name, uint8_t& reg) {
+    if (name.empty() || name[0] != '$') return false;
+    try {
+        reg = static_cast<uint8_t>(string_to_register(std::string(name)));
+        return true;
+    } catch (const std::invalid_argument&) {
+        return false;
+    }
+}
+
+// whole stream in one buffer, sized up front when the stream can seek
+std::string read_all(std::istream& input) {
+    std::string text;
+    std::streampos start = input.tellg();
+    if (start != std::streampos(-1) && input.seekg(0, std::ios::end)) {
+        std::streampos end = input.tellg();
+        input.seekg(start);
+        text.resize(static_cast<size_t>(end - start));
+        input.read(&text[0], static_cast<std::streamsize>(text.size()));
+        text.resize(static_cast<size_t>(input.gcount()));
+        return text;
+    }
+    input.clear();
+    text.assign(std::istreambuf_iterator<char>(input), {});
+    return text;
+}
+
+void store_little_endian(uint8_t* out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+void put_little_endian(std::ostream& output, uint32_t value) {
+    output.put(value & 0xFF);
+    output.put((value >> 8) & 0xFF);
+    output.put((value >> 16) & 0xFF);
+    output.put((value >> 24) & 0xFF);
+}
+
+uint32_t get_little_endian(std::istream& input) {
+    uint8_t bytes[4];
+    input.read(reinterpret_cast<char*>(bytes), 4);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+} // namespace
+
+// where the single-pass assembler puts each line, in address order; fixups read back
+// and rewrite bytes written earlier
+class StreamOutput {
+public:
+    virtual ~StreamOutput() = default;
+    virtual uint8_t* append(uint32_t size) = 0; // zeroed room for the next line
+    virtual void append_zeros(uint32_t size) = 0; // .space
+    virtual void read(uint32_t address, uint8_t* out, uint32_t size) = 0;
+    virtual void write(uint32_t address, const uint8_t* data, uint32_t size) = 0;
+    virtual void finish() {}
+};
+
+namespace {
+
+class SparseOutput : public StreamOutput {
+public:
+    explicit SparseOutput(SparseBinary& binary) : binary_(binary) {}
     
-    instruction_categories_["lb"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["lh"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["lw"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["lbu"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["lhu"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["sb"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["sh"] = InstructionCategory::LOAD_STORE;
-    instruction_categories_["sw"] = InstructionCategory::LOAD_STORE;
+    uint8_t* append(uint32_t size) override { return binary_.append(size); }
+    void append_zeros(uint32_t size) override { binary_.append_zeros(size); }
+    void read(uint32_t address, uint8_t* out, uint32_t size) override {
+        std::copy_n(binary_.find(address), size, out);
+    }
+    void write(uint32_t address, const uint8_t* data, uint32_t size) override {
+        std::copy_n(data, size, binary_.find(address));
+    }
+
+private:
+    SparseBinary& binary_;
+};
+
+// lines are collected into a small buffer and written out a block at a time
+class MemoryOutput : public StreamOutput {
+public:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
     
-    instruction_categories_["j"] = InstructionCategory::JUMP;
-    instruction_categories_["jal"] = InstructionCategory::JUMP;
+    explicit MemoryOutput(MachineState& state) : state_(state), start_(0), next_(0) {
+        buffer_.reserve(BLOCK_SIZE);
+    }
     
-    instruction_categories_["trap"] = InstructionCategory::TRAP;
+    uint8_t* append(uint32_t size) override {
+        if (buffer_.size() + size > BLOCK_SIZE) {
+            finish(); // a line larger than the block grows the buffer once
+        }
+        size_t offset = buffer_.size();
+        buffer_.resize(offset + size, 0);
+        next_ += size;
+        return buffer_.data() + offset;
+    }
+    void append_zeros(uint32_t size) override {
+        finish();
+        next_ += size;
+        start_ = next_;
+    }
+    void read(uint32_t address, uint8_t* out, uint32_t size) override {
+        if (address >= start_) {
+            std::copy_n(buffer_.data() + (address - start_), size, out);
+        } else {
+            state_.read_block(address, out, size);
+        }
+    }
+    void write(uint32_t address, const uint8_t* data, uint32_t size) override {
+        if (address >= start_) {
+            std::copy_n(data, size, buffer_.data() + (address - start_));
+        } else {
+            state_.write_block(address, data, size);
+        }
+    }
+    void finish() override {
+        state_.write_block(start_, buffer_.data(), buffer_.size());
+        buffer_.clear();
+        start_ = next_;
+    }
+
+private:
+    MachineState& state_;
+    std::vector<uint8_t> buffer_; // bytes of [start_, next_)
+    uint32_t start_;
+    uint32_t next_;
+};
+
+} // namespace
+
+uint8_t* SparseBinary::append(uint32_t count) {
+    size_t offset = data.size();
+    data.resize(offset + count, 0);
+    size += count;
+    return data.data() + offset;
+}
+
+void SparseBinary::append_zeros(uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (!zero_ranges.empty() && zero_ranges.back().address + zero_ranges.back().size == size) {
+        zero_ranges.back().size += count;
+    } else {
+        zero_ranges.push_back(ZeroRange{size, count, static_cast<uint32_t>(data.size())});
+    }
+    size += count;
+}
+
+uint8_t* SparseBinary::find(uint32_t address) {
+    auto after = std::upper_bound(zero_ranges.begin(), zero_ranges.end(), address,
+                                  [](uint32_t value, const ZeroRange& range) { return value < range.address; });
+    if (after == zero_ranges.begin()) {
+        return data.data() + address;
+    }
+    const ZeroRange& range = *(after - 1);
+    return data.data() + range.data_offset + (address - range.address - range.size);
+}
+
+void SparseBinary::for_each_data_run(
+    const std::function<void(uint32_t address, const uint8_t* bytes, uint32_t count)>& visit) const {
+    uint32_t address = 0;
+    uint32_t offset = 0;
+    for (const ZeroRange& range : zero_ranges) {
+        if (range.address > address) {
+            visit(address, data.data() + offset, range.address - address);
+        }
+        offset = range.data_offset;
+        address = range.address + range.size;
+    }
+    if (size > address) {
+        visit(address, data.data() + offset, size - address);
+    }
+}
+
+std::vector<uint8_t> SparseBinary::to_dense() const {
+    std::vector<uint8_t> dense(size);
+    for_each_data_run([&](uint32_t address, const uint8_t* bytes, uint32_t count) {
+        std::copy_n(bytes, count, dense.data() + address);
+    });
+    return dense;
+}
+
+void SparseBinary::load_into(MachineState& state) const {
+    for_each_data_run([&](uint32_t address, const uint8_t* bytes, uint32_t count) {
+        state.write_block(address, bytes, count);
+    });
+    state.place_heap_above(size);
+}
+
+Assembler::Assembler()
+    : program_(new IrProgram()), mnemonic_ids_(&init_instruction_tables()), stream_output_(nullptr), main_address_(0) {}
+
+const std::unordered_map<std::string_view, uint16_t>& Assembler::init_instruction_tables() {
+    // built once by the first assembler, after that only read from any thread
+    static const std::unordered_map<std::string_view, uint16_t> ids = [] {
+        std::unordered_map<std::string_view, uint16_t> table;
+        for (size_t i = 0; i < sizeof(INSTRUCTIONS) / sizeof(INSTRUCTIONS[0]); ++i) {
+            table[INSTRUCTIONS[i].name] = static_cast<uint16_t>(i);
+        }
+        for (size_t i = 0; i < sizeof(DIRECTIVE_NAMES) / sizeof(DIRECTIVE_NAMES[0]); ++i) {
+            table[DIRECTIVE_NAMES[i]] = directive_id(static_cast<DirectiveType>(i));
+        }
+        return table;
+    }();
+    return ids;
 }
 
 std::vector<AssemblyLine> Assembler::parse_assembly(const std::string& assembly_text) {
-    std::istringstream stream(assembly_text); //conver to stream
-    return parse_assembly(stream); // create asm_lines from string
+    std::vector<AssemblyLine> lines;
+    parse_source(assembly_text, &lines); // scanned in place, no stream
+    return lines;
 }
 
 std::vector<AssemblyLine> Assembler::parse_assembly(std::istream& input) {
+    std::string text = read_all(input); // one contiguous buffer for the scanner
     std::vector<AssemblyLine> lines;
-    std::string line;
-    uint32_t line_number = 0;
-    uint32_t current_address = 0;
+    parse_source(text, &lines);
+    return lines;
+}
+
+void Assembler::parse_source(std::string_view text, std::vector<AssemblyLine>* listing, uint32_t first_line) {
+    program_.reset(new IrProgram());
+    errors_.clear();
+    main_address_ = 0;
     
-    // first pass: parse lines and collect labels
-    while (std::getline(input, line)) {
-        line_number++;
-        AssemblyLine asm_line = parse_line(line, line_number); // trims everything that is not \t, \n, \r + tokenize and store in correct asm line attribute
-        
-        // case label
-        if (!asm_line.label.empty()) {
-            labels_[asm_line.label] = current_address; // map label to adress
-            if (asm_line.label == "main") {
-                main_address_ = current_address;
-            }
+    // first pass: lines go into the IR, labels into its symbol table
+    SourceScanner scanner(text, first_line);
+    ScannedLine scanned; // reused, tokens are views into text
+    std::string_view line;
+    while (scanner.next_line(line)) {
+        SourceScanner::scan(line, scanned);
+        if (scanned.error) {
+            add_error(scanned.error, scanner.line_number());
+            continue;
         }
-        // case instruction
-        if (!asm_line.instruction.empty()) {
-            asm_line.address = current_address;
-            if (asm_line.is_directive) { //check if dir
-                // calc dir size
-                if (asm_line.instruction == ".byte") {
-                    asm_line.size = asm_line.operands.size();
-                } else if (asm_line.instruction == ".half") {
-                    asm_line.size = asm_line.operands.size() * 2;
-                } else if (asm_line.instruction == ".word") {
-                    asm_line.size = asm_line.operands.size() * 4;
-                } else if (asm_line.instruction == ".ascii") {
-                    asm_line.size = asm_line.operands.empty() ? 0 : asm_line.operands[0].length() - 2; // Remove quotes
-                } else if (asm_line.instruction == ".asciiz") {
-                    asm_line.size = asm_line.operands.empty() ? 1 : asm_line.operands[0].length() - 1; // Remove quotes, add null
-                } else if (asm_line.instruction == ".space") {
-                    asm_line.size = asm_line.operands.empty() ? 0 : std::stoul(asm_line.operands[0]);
-                }
-            } else {
-                asm_line.size = 4; // all instructions are 4 bytes
-            }
-            current_address += asm_line.size; // move address forward
-            lines.push_back(asm_line);
+        size_t index = program_->lines.size();
+        add_line(scanned.label, scanned.mnemonic, scanned.operands.data(), scanned.operands.size(),
+                 scanner.line_number());
+        
+        // the string form is only built for callers that want to see the lines
+        if (listing && program_->lines.size() > index) {
+            const IrLine& ir_line = program_->lines[index];
+            AssemblyLine asm_line;
+            asm_line.label = scanned.label;
+            asm_line.instruction = scanned.mnemonic;
+            asm_line.operands.assign(scanned.operands.begin(), scanned.operands.end());
+            asm_line.is_directive = scanned.mnemonic[0] == '.';
+            asm_line.address = ir_line.address;
+            asm_line.size = ir_line.size;
+            listing->push_back(std::move(asm_line));
         }
     }
-    
-    return lines;
 }
 
-AssemblyLine Assembler::parse_line(const std::string& line, uint32_t /* line_number */) {
-    AssemblyLine asm_line;
-    asm_line.address = 0;
-    asm_line.size = 0;
-    asm_line.is_directive = false;
-    
-    std::string trimmed = trim(line); 
+void Assembler::add_line(std::string_view label, std::string_view mnemonic, const std::string_view* operands,
+                         size_t num_operands, uint32_t line_number) {
+    IrProgram& program = *program_;
     
-    // skip empty lines and comments
-    if (trimmed.empty() || trimmed[0] == '#') {
-        return asm_line;
+    // case label, the first definition stands in every path so a duplicate is an error
+    if (!label.empty()) {
+        uint32_t symbol = program.symbols.intern(label);
+        if (program.symbols.defined(symbol)) {
+            add_error("Duplicate label: " + std::string(label), line_number);
+        } else {
+            program.symbols.define(symbol, program.end_address);
+            if (label == "main") {
+                main_address_ = program.end_address;
+            }
+            if (stream_output_) {
+                apply_fixups(symbol);
+            }
+        }
     }
-    
-    std::vector<std::string> tokens = tokenize(trimmed);
-    if (tokens.empty()) {
-        return asm_line;
+    if (mnemonic.empty()) {
+        return;
     }
     
-    size_t token_index = 0;
+    // case instruction
+    if (num_operands > UINT16_MAX) {
+        add_error("Too many operands", line_number);
+        num_operands = UINT16_MAX;
+    }
+    IrLine line;
+    line.address = program.end_address;
+    line.first_operand = static_cast<uint32_t>(program.operands.size());
+    line.num_operands = static_cast<uint16_t>(num_operands);
+    line.line_number = line_number;
+    line.name = SymbolTable::NONE;
+    auto id_it = mnemonic_ids_->find(mnemonic);
+    if (id_it != mnemonic_ids_->end()) {
+        line.op = id_it->second;
+    } else {
+        line.op = mnemonic[0] == '.' ? UNKNOWN_DIRECTIVE : UNKNOWN_INSTRUCTION;
+        line.name = program.symbols.intern(mnemonic);
+    }
     
-    // label
-    if (tokens[token_index].back() == ':') {
-        asm_line.label = tokens[token_index].substr(0, tokens[token_index].length() - 1);
-        token_index++;
+    bool is_string = line.op == directive_id(DirectiveType::ASCII) || line.op == directive_id(DirectiveType::ASCIIZ);
+    for (size_t i = 0; i < num_operands; ++i) {
+        program.operands.push_back(decode_operand(operands[i], is_string && i == 0));
     }
     
-    // check for inst/dir
-    if (token_index < tokens.size()) {
-        asm_line.instruction = tokens[token_index];
-        asm_line.is_directive = (asm_line.instruction[0] == '.');
-        token_index++;
-        
-        // collect operands
-        while (token_index < tokens.size()) {
-            asm_line.operands.push_back(tokens[token_index]);
-            token_index++;
+    // calc size
+    if (line.op == UNKNOWN_DIRECTIVE) {
+        line.size = 0;
+    } else if (line.op < DIRECTIVE_BASE || line.op == UNKNOWN_INSTRUCTION) {
+        line.size = 4; // all instructions are 4 bytes
+    } else {
+        switch (static_cast<DirectiveType>(line.op - DIRECTIVE_BASE)) {
+            case DirectiveType::BYTE:
+                line.size = num_operands;
+                break;
+            case DirectiveType::HALF:
+                line.size = num_operands * 2;
+                break;
+            case DirectiveType::WORD:
+                line.size = num_operands * 4;
+                break;
+            case DirectiveType::ASCII:
+                line.size = num_operands == 0 ? 0 : program.strings[program.operands[line.first_operand].value].size();
+                break;
+            case DirectiveType::ASCIIZ:
+                line.size = num_operands == 0 ? 1 : program.strings[program.operands[line.first_operand].value].size() + 1; // add null
+                break;
+            case DirectiveType::SPACE: {
+                line.size = 0;
+                if (num_operands > 0) {
+                    const IrOperand& size = program.operands[line.first_operand];
+                    if (size.kind == OperandKind::IMMEDIATE) {
+                        line.size = size.value;
+                    } else {
+                        add_error("Invalid .space size: " + operand_text(size), line_number);
+                    }
+                }
+                break;
+            }
         }
     }
-    
-    return asm_line;
+    if (line.size > MAX_END_ADDRESS - program.end_address) {
+        add_error("Program does not fit in the 32-bit address space", line_number);
+        return; // dropped, so the addresses never wrap
+    }
+    program.end_address += line.size; // move address forward
+    program.lines.push_back(line);
 }
 
-std::vector<std::string> Assembler::tokenize(const std::string& line) {
-    std::vector<std::string> tokens;
-    std::istringstream stream(line);
-    std::string token;
+IrOperand Assembler::decode_operand(std::string_view text, bool as_string) {
+    IrProgram& program = *program_;
+    IrOperand operand{OperandKind::SYMBOL, 0, 0};
+    if (as_string || text[0] == '"') {
+        operand.kind = OperandKind::STRING;
+        operand.value = static_cast<uint32_t>(program.strings.size());
+        program.strings.push_back(program.arena.copy(SourceScanner::decode_string(text)));
+        return operand;
+    }
+    if (parse_register(text, operand.reg)) {
+        operand.kind = OperandKind::REGISTER;
+        return operand;
+    }
     
-    while (stream >> token) {
-        // handle commas
-        if (token.back() == ',') {
-            token.pop_back();
+    // offset(register)
+    size_t paren_pos = text.find('(');
+    if (paren_pos != std::string_view::npos && text.back() == ')'
+        && parse_register(text.substr(paren_pos + 1, text.size() - paren_pos - 2), operand.reg)) {
+        std::string_view offset = text.substr(0, paren_pos);
+        if (offset.empty() || parse_number(offset, operand.value)) {
+            operand.kind = OperandKind::MEMORY;
+        } else {
+            operand.kind = OperandKind::MEMORY_SYMBOL;
+            operand.value = program.symbols.intern(offset);
         }
-        tokens.push_back(token);
+        return operand;
     }
-    
-    return tokens;
+
+    if (parse_number(text, operand.value)) {
+        operand.kind = OperandKind::IMMEDIATE;
+    } else {
+        operand.value = program.symbols.intern(text); // a label, or checked when it is used
+    }
+    return operand;
 }
 
-std::string Assembler::trim(const std::string& str) {
-    size_t start = str.find_first_not_of(" \t\r\n");
-    if (start == std::string::npos) return "";
-    size_t end = str.find_last_not_of(" \t\r\n");
-    return str.substr(start, end - start + 1);
+std::vector<uint8_t> Assembler::assemble(const std::vector<AssemblyLine>& lines) {
+    // errors add to those of parse_assembly, the symbols it defined are kept and its
+    // labels are defined again here, duplicates were reported by the parse
+    program_->clear_lines();
+    program_->end_address = 0;
+    std::vector<std::string_view> operands;
+    for (const auto& line : lines) {
+        if (!line.label.empty()) {
+            program_->symbols.define(program_->symbols.intern(line.label), program_->end_address);
+            if (line.label == "main") {
+                main_address_ = program_->end_address;
+            }
+        }
+        operands.assign(line.operands.begin(), line.operands.end());
+        add_line(std::string_view(), line.instruction, operands.data(), operands.size(), 0);
+    }
+    return emit();
 }
 
-bool Assembler::is_register(const std::string& token) {
-    return token[0] == '$';
+std::vector<uint8_t> Assembler::assemble_text(const std::string& assembly_text) {
+    parse_source(assembly_text, nullptr);
+    return emit();
 }
 
-bool Assembler::is_immediate(const std::string& token) {
-    return std::isdigit(token[0]) || token[0] == '-' || token[0] == '+';
+std::vector<uint8_t> Assembler::assemble_stream(std::istream& input) {
+    SparseBinary binary = assemble_sparse(input);
+    if (binary.zero_ranges.empty()) {
+        return std::move(binary.data); // already dense, no copy
+    }
+    return binary.to_dense();
 }
 
-bool Assembler::is_label(const std::string& token) {
-    return !is_register(token) && !is_immediate(token) && token.find('(') == std::string::npos;
+SparseBinary Assembler::assemble_sparse(std::istream& input) {
+    SparseBinary binary;
+    SparseOutput output(binary);
+    stream(input, output);
+    return binary;
 }
 
-std::vector<uint8_t> Assembler::assemble(const std::vector<AssemblyLine>& lines) {
-    std::vector<uint8_t> binary_data;
+uint32_t Assembler::assemble_into(std::istream& input, MachineState& state) {
+    MemoryOutput output(state);
+    uint32_t size = stream(input, output);
+    state.place_heap_above(size);
+    return size;
+}
+
+uint32_t Assembler::stream(std::istream& input, StreamOutput& output) {
+    program_.reset(new IrProgram());
     errors_.clear();
+    main_address_ = 0;
+    fixups_.clear();
     
-    for (const auto& line : lines) {
-        if (line.is_directive) {
-            std::vector<uint8_t> directive_data = assemble_directive(line);
-            binary_data.insert(binary_data.end(), directive_data.begin(), directive_data.end());
-        } else {
-            Instruction instr = assemble_instruction(line); // transfer data to instr fields
-            uint32_t encoded = instr.encode(); // convert to 32b
-            
-            // store as little-endian, shiift right, then mask 8b
-            binary_data.push_back(encoded & 0xFF); // 0-7
-            binary_data.push_back((encoded >> 8) & 0xFF); // 8-15
-            binary_data.push_back((encoded >> 16) & 0xFF); // 16-23    
-            binary_data.push_back((encoded >> 24) & 0xFF); // 24-31
+    // single pass: each line is emitted as soon as it is read, so only the output, the
+    // symbols and the unresolved references are kept
+    stream_output_ = &output;
+    struct StreamGuard {
+        StreamOutput*& output;
+        ~StreamGuard() { output = nullptr; } // a bad register throws out of the loop
+    } guard{stream_output_};
+    
+    StreamLineReader reader(input);
+    ScannedLine scanned;
+    std::string_view line;
+    IrProgram& program = *program_;
+    while (reader.next_line(line)) {
+        SourceScanner::scan(line, scanned);
+        if (scanned.error) {
+            add_error(scanned.error, reader.line_number());
+            continue;
+        }
+        add_line(scanned.label, scanned.mnemonic, scanned.operands.data(), scanned.operands.size(),
+                 reader.line_number());
+        if (program.lines.size() > 0) {
+            const IrLine& ir_line = program.lines[0];
+            if (ir_line.op == directive_id(DirectiveType::SPACE)) {
+                output.append_zeros(ir_line.size); // never materialised
+            } else {
+                emit_line(ir_line, output.append(ir_line.size));
+            }
+            program.clear_lines(); // the line is done, its records are reused
         }
     }
+    output.finish();
     
-    return binary_data;
-}
-
-std::vector<uint8_t> Assembler::assemble_text(const std::string& assembly_text) {
-    auto lines = parse_assembly(assembly_text);
-    return assemble(lines);
+    // whatever is still waiting was never defined
+    std::vector<std::pair<Fixup, uint32_t>> unresolved;
+    for (const auto& entry : fixups_) {
+        for (const Fixup& fixup : entry.second) {
+            unresolved.emplace_back(fixup, entry.first);
+        }
+    }
+    std::sort(unresolved.begin(), unresolved.end(), [](const auto& a, const auto& b) {
+        return a.first.address < b.first.address;
+    });
+    for (const auto& entry : unresolved) {
+        bool is_label = entry.first.kind == FixupKind::BRANCH || entry.first.kind == FixupKind::JUMP;
+        add_error((is_label ? "Undefined label: " : "Invalid immediate value: ")
+                  + std::string(program.symbols.name(entry.second)), entry.first.line_number);
+    }
+    fixups_.clear();
+    return program.end_address;
 }
 
-std::vector<uint8_t> Assembler::assemble_stream(std::istream& input) {
-    auto lines = parse_assembly(input);
-    return assemble(lines);
+std::vector<uint8_t> Assembler::assemble_parallel(const std::string& assembly_text, ThreadPool& pool) {
+    // whole lines per chunk, a few chunks per thread so uneven ones even out
+    const size_t MIN_CHUNK = 1 << 20;
+    std::string_view text(assembly_text);
+    size_t target = std::max(MIN_CHUNK, text.size() / (pool.size() * 4) + 1);
+    std::vector<std::string_view> chunks;
+    for (size_t start = 0; start < text.size();) {
+        size_t end = start + target >= text.size() ? std::string_view::npos : text.find('\n', start + target);
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        chunks.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    if (chunks.size() <= 1) {
+        return assemble_text(assembly_text); // nothing to split
+    }
+    
+    size_t num_chunks = chunks.size();
+    std::vector<std::unique_ptr<Assembler>> parts(num_chunks);
+    std::vector<std::exception_ptr> failures(num_chunks);
+    auto for_each_chunk = [&](const std::function<void(size_t)>& task) {
+        for (size_t i = 0; i < num_chunks; ++i) {
+            pool.submit([&task, &failures, i] {
+                try {
+                    task(i);
+                } catch (...) {
+                    failures[i] = std::current_exception();
+                }
+            });
+        }
+        pool.wait_idle();
+        for (const auto& failure : failures) {
+            if (failure) std::rethrow_exception(failure); // the first one in source order
+        }
+    };
+    
+    // 1. line counts for the error messages, then every chunk parsed and sized from address 0
+    std::vector<uint32_t> first_line(num_chunks);
+    for_each_chunk([&](size_t i) {
+        first_line[i] = static_cast<uint32_t>(std::count(chunks[i].begin(), chunks[i].end(), '\n'));
+    });
+    uint32_t line = 1;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        uint32_t count = first_line[i];
+        first_line[i] = line;
+        line += count;
+    }
+    std::vector<size_t> parse_errors(num_chunks);
+    for_each_chunk([&](size_t i) {
+        parts[i].reset(new Assembler());
+        parts[i]->parse_source(chunks[i], nullptr, first_line[i]);
+        parse_errors[i] = parts[i]->errors_.size();
+    });
+    
+    // 2. chunk base addresses by prefix sum, then the first definition of every label
+    // like in the serial assembler
+    std::vector<uint32_t> base(num_chunks);
+    uint32_t end_address = 0;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        if (parts[i]->program_->end_address > MAX_END_ADDRESS - end_address) {
+            return assemble_text(assembly_text); // too large, the serial pass finds the line
+        }
+        base[i] = end_address;
+        end_address += parts[i]->program_->end_address;
+    }
+    std::unordered_map<std::string_view, uint32_t> labels;
+    size_t num_symbols = 0;
+    for (const auto& part : parts) {
+        num_symbols += part->program_->symbols.size();
+    }
+    labels.reserve(num_symbols);
+    std::vector<std::vector<std::string_view>> duplicates(num_chunks); // defined by an earlier chunk
+    for (size_t i = 0; i < num_chunks; ++i) {
+        const SymbolTable& symbols = parts[i]->program_->symbols;
+        for (uint32_t id = 0; id < symbols.size(); ++id) {
+            if (symbols.defined(id) && !labels.emplace(symbols.name(id), base[i] + symbols.address(id)).second) {
+                duplicates[i].push_back(symbols.name(id));
+            }
+        }
+    }
+    
+    // such a label is an error at its first definition in the later chunk; rare, so the
+    // chunk is scanned again for the line, the error goes in among its parse errors
+    for (size_t i = 0; i < num_chunks; ++i) {
+        std::vector<std::string>& errors = parts[i]->errors_;
+        SourceScanner scanner(chunks[i], first_line[i]);
+        ScannedLine scanned;
+        std::string_view text;
+        while (!duplicates[i].empty() && scanner.next_line(text)) {
+            SourceScanner::scan(text, scanned);
+            auto name_it = std::find(duplicates[i].begin(), duplicates[i].end(), scanned.label);
+            if (scanned.error || scanned.label.empty() || name_it == duplicates[i].end()) {
+                continue;
+            }
+            duplicates[i].erase(name_it);
+            uint32_t number = scanner.line_number();
+            auto position = std::find_if(errors.begin(), errors.begin() + parse_errors[i], [&](const std::string& error) {
+                return std::stoul(error.substr(5)) >= number; // "Line <n>: ..."
+            });
+            errors.insert(position, "Line " + std::to_string(number) + ": Duplicate label: " + std::string(scanned.label));
+            parse_errors[i]++;
+        }
+    }
+    
+    // 3. every chunk takes the merged addresses and encodes into its own slice
+    std::vector<uint8_t> binary_data(end_address);
+    for_each_chunk([&](size_t i) {
+        Assembler& part = *parts[i];
+        IrProgram& program = *part.program_;
+        for (uint32_t id = 0; id < program.symbols.size(); ++id) {
+            auto label_it = labels.find(program.symbols.name(id));
+            if (label_it != labels.end()) {
+                program.symbols.define(id, label_it->second);
+            }
+        }
+        for (size_t l = 0; l < program.lines.size(); ++l) {
+            program.lines[l].address += base[i];
+            part.emit_line(program.lines[l], binary_data.data() + program.lines[l].address);
+        }
+    });
+    
+    // diagnostics in serial order, parse errors first
+    program_.reset(new IrProgram());
+    errors_.clear();
+    for (int phase = 0; phase < 2; ++phase) {
+        for (size_t i = 0; i < num_chunks; ++i) {
+            const auto& errors = parts[i]->errors_;
+            auto begin = errors.begin() + (phase == 0 ? 0 : parse_errors[i]);
+            auto end = phase == 0 ? errors.begin() + parse_errors[i] : errors.end();
+            errors_.insert(errors_.end(), begin, end);
+        }
+    }
+    auto main_it = labels.find("main");
+    main_address_ = main_it != labels.end() ? main_it->second : 0;
+    return binary_data;
 }
 
 void Assembler::add_error(const std::string& error, uint32_t line_number) {
@@ -346,6 +790,30 @@ void BinaryFormat::write_binary_file(const std::vector<uint8_t>& data, const std
     write_binary(data, file, main_address);
 }
 
+void BinaryFormat::write_binary(const SparseBinary& binary, std::ostream& output, uint32_t main_address) {
+    if (binary.zero_ranges.empty()) {
+        write_binary(binary.data, output, main_address); // same bytes as a dense program
+        return;
+    }
+    put_little_endian(output, main_address);
+    put_little_endian(output, SPARSE_MARKER);
+    put_little_endian(output, binary.size);
+    put_little_endian(output, static_cast<uint32_t>(binary.zero_ranges.size()));
+    for (const auto& range : binary.zero_ranges) {
+        put_little_endian(output, range.address);
+        put_little_endian(output, range.size);
+    }
+    output.write(reinterpret_cast<const char*>(binary.data.data()), binary.data.size());
+}
+
+void BinaryFormat::write_binary_file(const SparseBinary& binary, const std::string& filename, uint32_t main_address) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for writing: " + filename);
+    }
+    write_binary(binary, file, main_address);
+}
+
 std::vector<uint8_t> BinaryFormat::read_binary(std::istream& input, uint32_t& main_address) {
     // read main address (4 bytes, little-endian)
     uint8_t bytes[4];
@@ -355,6 +823,9 @@ std::vector<uint8_t> BinaryFormat::read_binary(std::istream& input, uint32_t& ma
     // read data size (4 bytes, little-endian)
     input.read(reinterpret_cast<char*>(bytes), 4);
     uint32_t size = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+    if (size == SPARSE_MARKER) {
+        return read_zero_ranges(input).to_dense();
+    }
     
     // read data
     std::vector<uint8_t> data(size);
@@ -363,6 +834,43 @@ std::vector<uint8_t> BinaryFormat::read_binary(std::istream& input, uint32_t& ma
     return data;
 }
 
+SparseBinary BinaryFormat::read_sparse(std::istream& input, uint32_t& main_address) {
+    main_address = get_little_endian(input);
+    uint32_t size = get_little_endian(input);
+    if (size == SPARSE_MARKER) {
+        return read_zero_ranges(input);
+    }
+    SparseBinary binary;
+    binary.size = size;
+    binary.data.resize(size);
+    input.read(reinterpret_cast<char*>(binary.data.data()), size);
+    return binary;
+}
+
+SparseBinary BinaryFormat::read_zero_ranges(std::istream& input) {
+    SparseBinary binary;
+    binary.size = get_little_endian(input);
+    uint32_t num_ranges = get_little_endian(input);
+    uint64_t zeros = 0;
+    uint32_t end = 0; // of the previous range
+    for (uint32_t i = 0; i < num_ranges && input; ++i) {
+        uint32_t address = get_little_endian(input);
+        uint32_t size = get_little_endian(input);
+        if (address < end || static_cast<uint64_t>(address) + size > binary.size) {
+            throw std::runtime_error("Malformed binary: zero range out of order or out of bounds");
+        }
+        binary.zero_ranges.push_back(SparseBinary::ZeroRange{address, size, static_cast<uint32_t>(address - zeros)});
+        zeros += size;
+        end = address + size;
+    }
+    binary.data.resize(binary.size - zeros);
+    input.read(reinterpret_cast<char*>(binary.data.data()), binary.data.size());
+    if (!input) {
+        throw std::runtime_error("Malformed binary: truncated sparse data");
+    }
+    return binary;
+}
+
 std::vector<uint8_t> BinaryFormat::read_binary_file(const std::string& filename, uint32_t& main_address) {
     std::ifstream file(filename, std::ios::binary);
     if (!file) {
@@ -371,291 +879,323 @@ std::vector<uint8_t> BinaryFormat::read_binary_file(const std::string& filename,
     return read_binary(file, main_address);
 }
 
+SparseBinary BinaryFormat::read_sparse_file(const std::string& filename, uint32_t& main_address) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for reading: " + filename);
+    }
+    return read_sparse(file, main_address);
+}
+
 // instruction assembly implementation
-Instruction Assembler::assemble_instruction(const AssemblyLine& line) {
-    Instruction instr;
-    instr.name = line.instruction; // add name
+std::vector<uint8_t> Assembler::emit() {
+    const IrProgram& program = *program_;
+    std::vector<uint8_t> binary_data(program.end_address); // .space and the .asciiz null are already zero
     
-    // find instruction category
-    auto cat_it = instruction_categories_.find(line.instruction);
-    if (cat_it == instruction_categories_.end()) { // not found
-        add_error("Unknown instruction: " + line.instruction);
-        return instr;
+    for (size_t i = 0; i < program.lines.size(); ++i) {
+        emit_line(program.lines[i], binary_data.data() + program.lines[i].address);
     }
-    instr.category = cat_it->second; // add category
     
-    // case r type
-    if (instruction_functions_.find(line.instruction) != instruction_functions_.end()) {
-        instr.opcode = 0;
-        instr.function = instruction_functions_[line.instruction];
-        instr.type = InstructionType::R_TYPE;
-        
-        switch (instr.category) {
-            case InstructionCategory::ARITH_LOGIC:
-                if (line.operands.size() != 3) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rd = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rs = static_cast<uint8_t>(string_to_register(line.operands[1]));
-                instr.rt = static_cast<uint8_t>(string_to_register(line.operands[2]));
-                instr.shamt = 0;
-                break;
-                
-            case InstructionCategory::SHIFT:
-                if (line.operands.size() != 3) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rd = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rt = static_cast<uint8_t>(string_to_register(line.operands[1]));
-                instr.shamt = std::stoul(line.operands[2]);
-                instr.rs = 0;
-                break;
-                
-            case InstructionCategory::SHIFT_REG:
-                if (line.operands.size() != 3) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rd = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rt = static_cast<uint8_t>(string_to_register(line.operands[1]));
-                instr.rs = static_cast<uint8_t>(string_to_register(line.operands[2]));
-                instr.shamt = 0;
-                break;
-                
-            case InstructionCategory::DIV_MULT:
-                if (line.operands.size() != 2) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rs = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rt = static_cast<uint8_t>(string_to_register(line.operands[1]));
-                instr.rd = 0;
-                instr.shamt = 0;
-                break;
-                
-            case InstructionCategory::JUMP_REG:
-                if (line.operands.size() != 1) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rs = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rt = 0;
-                instr.rd = 0;
-                instr.shamt = 0;
-                break;
-                
-            case InstructionCategory::MOVE_FROM:
-                if (line.operands.size() != 1) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rd = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rs = 0;
-                instr.rt = 0;
-                instr.shamt = 0;
-                break;
-                
-            case InstructionCategory::MOVE_TO:
-                if (line.operands.size() != 1) {
-                    add_error("Invalid operand count for " + line.instruction);
-                    break;
-                }
-                instr.rs = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                instr.rt = 0;
-                instr.rd = 0;
-                instr.shamt = 0;
-                break;
-            default:
-                add_error("Unhandled R-type instruction category for " + line.instruction);
-                break;
-        }
+    return binary_data;
+}
+
+void Assembler::emit_line(const IrLine& line, uint8_t* out) {
+    if (line.op < DIRECTIVE_BASE || line.op == UNKNOWN_INSTRUCTION) {
+        store_little_endian(out, encode_instruction(line), 4);
+    } else if (line.size > 0 || line.num_operands > 0) {
+        emit_directive(line, out);
     }
-    // case j or i type
-    else if (instruction_opcodes_.find(line.instruction) != instruction_opcodes_.end()) {
-        instr.opcode = instruction_opcodes_[line.instruction]; // 1. opcode to binary
-        
-        if (instr.category == InstructionCategory::JUMP) {
-            instr.type = InstructionType::J_TYPE;
-            if (line.operands.size() != 1) {
-                add_error("Invalid operand count for " + line.instruction);
-            } else {
-                instr.address = resolve_address(line.operands[0], line.address) >> 2;
+}
+
+uint32_t Assembler::encode_instruction(const IrLine& line) {
+    const IrProgram& program = *program_;
+    if (line.op == UNKNOWN_INSTRUCTION) {
+        add_error("Unknown instruction: " + std::string(program.symbols.name(line.name)), line.line_number);
+        return 0;
+    }
+    const InstructionInfo& info = INSTRUCTIONS[line.op];
+    
+    // operand count per category
+    size_t expected = 0;
+    switch (info.category) {
+        case InstructionCategory::ARITH_LOGIC:
+        case InstructionCategory::SHIFT:
+        case InstructionCategory::SHIFT_REG:
+        case InstructionCategory::ARITH_LOGIC_IMM:
+        case InstructionCategory::BRANCH:
+            expected = 3;
+            break;
+        case InstructionCategory::DIV_MULT:
+        case InstructionCategory::LOAD_IMM:
+        case InstructionCategory::BRANCH_ZERO:
+        case InstructionCategory::LOAD_STORE:
+            expected = 2;
+            break;
+        case InstructionCategory::SYNC:
+            expected = 0;
+            break;
+        default:
+            expected = 1;
+            break;
+    }
+    if (line.num_operands != expected) {
+        add_error("Invalid operand count for " + std::string(info.name), line.line_number);
+        return 0;
+    }
+    auto operand = [&](size_t index) -> const IrOperand& {
+        return program.operands[line.first_operand + index];
+    };
+    
+    // registers are read left to right so the first bad one is reported
+    switch (info.category) {
+        case InstructionCategory::ARITH_LOGIC: {
+            uint32_t rd = operand_register(operand(0));
+            uint32_t rs = operand_register(operand(1));
+            uint32_t rt = operand_register(operand(2));
+            return encode_r_type(0, rs, rt, rd, 0, info.function);
+        }
+        case InstructionCategory::SHIFT: {
+            uint32_t rd = operand_register(operand(0));
+            uint32_t rt = operand_register(operand(1));
+            if (operand(2).kind != OperandKind::IMMEDIATE) {
+                add_error("Invalid shift amount: " + operand_text(operand(2)), line.line_number);
+                return 0;
             }
-        } else {
-            instr.type = InstructionType::I_TYPE;
-            
-            switch (instr.category) { // convert to register based on category + resolve immediate
-                case InstructionCategory::ARITH_LOGIC_IMM:
-                    if (line.operands.size() != 3) { // arithmetic type = 3
-                        add_error("Invalid operand count for " + line.instruction); 
-                        break;
-                    }
-                    // 2. map to registers to enum (binary)
-                    instr.rt = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                    instr.rs = static_cast<uint8_t>(string_to_register(line.operands[1]));
-                    instr.immediate = resolve_immediate(line.operands[2], line.address);
-                    break;
-                    
-                case InstructionCategory::LOAD_IMM:
-                    if (line.operands.size() != 2) { // pseudo inst. = 2
-                        add_error("Invalid operand count for " + line.instruction);
-                        break;
-                    }
-                    instr.rt = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                    instr.rs = 0;
-                    instr.immediate = resolve_immediate(line.operands[1], line.address);
-                    break;
-                    
-                case InstructionCategory::BRANCH:
-                    if (line.operands.size() != 3) { // branch = 3
-                        add_error("Invalid operand count for " + line.instruction);
-                        break;
-                    }
-                    instr.rs = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                    instr.rt = static_cast<uint8_t>(string_to_register(line.operands[1]));
-                    instr.immediate = (resolve_address(line.operands[2], line.address) - line.address - 4) >> 2;
-                    break;
-                    
-                case InstructionCategory::BRANCH_ZERO: // branch zero = 2
-                    if (line.operands.size() != 2) {
-                        add_error("Invalid operand count for " + line.instruction);
-                        break;
-                    }
-                    instr.rs = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                    instr.rt = 0;
-                    instr.immediate = (resolve_address(line.operands[1], line.address) - line.address - 4) >> 2;
-                    break;
-                    
-                case InstructionCategory::LOAD_STORE: { // load store = 2
-                    if (line.operands.size() != 2) {
-                        add_error("Invalid operand count for " + line.instruction);
-                        break;
-                    }
-                    instr.rt = static_cast<uint8_t>(string_to_register(line.operands[0]));
-                    
-                    // parse offset(register) format
-                    std::string mem_operand = line.operands[1];
-                    size_t paren_pos = mem_operand.find('(');
-                    if (paren_pos != std::string::npos) {
-                        std::string offset_str = mem_operand.substr(0, paren_pos);
-                        std::string reg_str = mem_operand.substr(paren_pos + 1);
-                        reg_str.pop_back(); // remove closing parenthesis
-                        
-                        instr.immediate = resolve_immediate(offset_str, line.address);
-                        instr.rs = static_cast<uint8_t>(string_to_register(reg_str));
-                    } else {
-                        add_error("Invalid memory operand format: " + mem_operand);
-                    }
-                    break;
-                }
-                    
-                case InstructionCategory::TRAP:
-                    if (line.operands.size() != 1) { // trap = 1
-                        add_error("Invalid operand count for " + line.instruction);
-                        break;
-                    }
-                    instr.rs = 0;
-                    instr.rt = 0;
-                    instr.immediate = resolve_immediate(line.operands[0], line.address);
-                    break;
-                default:
-                    add_error("Unhandled I-type instruction category for " + line.instruction);
-                    break;
+            return encode_r_type(0, 0, rt, rd, operand(2).value, info.function);
+        }
+        case InstructionCategory::SHIFT_REG: {
+            uint32_t rd = operand_register(operand(0));
+            uint32_t rt = operand_register(operand(1));
+            uint32_t rs = operand_register(operand(2));
+            return encode_r_type(0, rs, rt, rd, 0, info.function);
+        }
+        case InstructionCategory::DIV_MULT: {
+            uint32_t rs = operand_register(operand(0));
+            uint32_t rt = operand_register(operand(1));
+            return encode_r_type(0, rs, rt, 0, 0, info.function);
+        }
+        case InstructionCategory::JUMP_REG:
+        case InstructionCategory::MOVE_TO:
+            return encode_r_type(0, operand_register(operand(0)), 0, 0, 0, info.function);
+        case InstructionCategory::MOVE_FROM:
+            return encode_r_type(0, 0, 0, operand_register(operand(0)), 0, info.function);
+        case InstructionCategory::SYNC:
+            return encode_r_type(0, 0, 0, 0, 0, info.function);
+        case InstructionCategory::JUMP: {
+            uint32_t target = 0;
+            operand_address(operand(0), FixupKind::JUMP, line, target);
+            return encode_j_type(info.opcode, target >> 2);
+        }
+        case InstructionCategory::ARITH_LOGIC_IMM: {
+            uint32_t rt = operand_register(operand(0));
+            uint32_t rs = operand_register(operand(1));
+            return encode_i_type(info.opcode, rs, rt, operand_immediate(operand(2), FixupKind::IMMEDIATE, line));
+        }
+        case InstructionCategory::LOAD_IMM: {
+            uint32_t rt = operand_register(operand(0));
+            return encode_i_type(info.opcode, 0, rt, operand_immediate(operand(1), FixupKind::IMMEDIATE, line));
+        }
+        case InstructionCategory::BRANCH: {
+            uint32_t rs = operand_register(operand(0));
+            uint32_t rt = operand_register(operand(1));
+            uint32_t target = 0;
+            bool known = operand_address(operand(2), FixupKind::BRANCH, line, target);
+            return encode_i_type(info.opcode, rs, rt, known ? (target - line.address - 4) >> 2 : 0);
+        }
+        case InstructionCategory::BRANCH_ZERO: {
+            uint32_t rs = operand_register(operand(0));
+            uint32_t target = 0;
+            bool known = operand_address(operand(1), FixupKind::BRANCH, line, target);
+            return encode_i_type(info.opcode, rs, 0, known ? (target - line.address - 4) >> 2 : 0);
+        }
+        case InstructionCategory::LOAD_STORE: {
+            uint32_t rt = operand_register(operand(0));
+            const IrOperand& memory = operand(1);
+            uint32_t offset = 0;
+            if (memory.kind == OperandKind::MEMORY) {
+                offset = memory.value;
+            } else if (memory.kind == OperandKind::MEMORY_SYMBOL) {
+                resolve_symbol(memory.value, FixupKind::IMMEDIATE, line.address, line.line_number, offset);
+            } else {
+                add_error("Invalid memory operand format: " + operand_text(memory), line.line_number);
+                return 0;
             }
+            return encode_i_type(info.opcode, memory.reg, rt, offset);
         }
+        case InstructionCategory::TRAP:
+            return encode_i_type(info.opcode, 0, 0, operand_immediate(operand(0), FixupKind::IMMEDIATE, line));
+        default:
+            add_error("Unhandled instruction category for " + std::string(info.name), line.line_number);
+            return 0;
     }
-    
-    return instr;
 }
 
-std::vector<uint8_t> Assembler::assemble_directive(const AssemblyLine& line) {
-    std::vector<uint8_t> data;
+void Assembler::emit_directive(const IrLine& line, uint8_t* out) {
+    const IrProgram& program = *program_;
+    if (line.op == UNKNOWN_DIRECTIVE) {
+        return;
+    }
+    DirectiveType type = static_cast<DirectiveType>(line.op - DIRECTIVE_BASE);
     
-    if (line.instruction == ".byte") {
-        for (const auto& operand : line.operands) {
-            uint8_t value = static_cast<uint8_t>(resolve_immediate(operand, line.address));
-            data.push_back(value);
-        }
-    } else if (line.instruction == ".half") {
-        for (const auto& operand : line.operands) {
-            uint16_t value = static_cast<uint16_t>(resolve_immediate(operand, line.address));
-            data.push_back(value & 0xFF);
-            data.push_back((value >> 8) & 0xFF);
-        }
-    } else if (line.instruction == ".word") {
-        for (const auto& operand : line.operands) {
-            uint32_t value = resolve_immediate(operand, line.address);
-            data.push_back(value & 0xFF);
-            data.push_back((value >> 8) & 0xFF);
-            data.push_back((value >> 16) & 0xFF);
-            data.push_back((value >> 24) & 0xFF);
-        }
-    } else if (line.instruction == ".ascii") {
-        if (!line.operands.empty()) {
-            std::string str = line.operands[0];
-            // Remove quotes
-            if (str.length() >= 2 && str[0] == '"' && str.back() == '"') {
-                str = str.substr(1, str.length() - 2);
-            }
-            for (char c : str) {
-                data.push_back(static_cast<uint8_t>(c));
-            }
-        }
-    } else if (line.instruction == ".asciiz") {
-        if (!line.operands.empty()) {
-            std::string str = line.operands[0];
-            // Remove quotes
-            if (str.length() >= 2 && str[0] == '"' && str.back() == '"') {
-                str = str.substr(1, str.length() - 2);
-            }
-            for (char c : str) {
-                data.push_back(static_cast<uint8_t>(c));
+    size_t width = 0;
+    FixupKind kind = FixupKind::WORD;
+    switch (type) {
+        case DirectiveType::BYTE:
+            width = 1;
+            kind = FixupKind::BYTE;
+            break;
+        case DirectiveType::HALF:
+            width = 2;
+            kind = FixupKind::HALF;
+            break;
+        case DirectiveType::WORD:
+            width = 4;
+            kind = FixupKind::WORD;
+            break;
+        case DirectiveType::ASCII:
+        case DirectiveType::ASCIIZ:
+            if (line.num_operands > 0) {
+                std::string_view str = program.strings[program.operands[line.first_operand].value];
+                std::copy(str.begin(), str.end(), out);
             }
-            data.push_back(0); // Null terminator
+            return;
+        case DirectiveType::SPACE:
+            return; // zero filled
+    }
+    for (size_t i = 0; i < line.num_operands; ++i) {
+        const IrOperand& operand = program.operands[line.first_operand + i];
+        uint32_t value = 0;
+        if (operand.kind == OperandKind::SYMBOL) {
+            resolve_symbol(operand.value, kind, line.address + i * width, line.line_number, value);
         } else {
-            data.push_back(0); // Just null terminator
+            value = operand_immediate(operand, kind, line);
         }
-    } else if (line.instruction == ".space") {
-        uint32_t size = line.operands.empty() ? 0 : resolve_immediate(line.operands[0], line.address);
-        data.resize(size, 0);
+        store_little_endian(out + i * width, value, width);
     }
-    
-    return data;
 }
 
-uint32_t Assembler::resolve_immediate(const std::string& imm_str, uint32_t /* current_address */) {
-    if (imm_str.empty()) return 0;
+uint32_t Assembler::operand_register(const IrOperand& operand) {
+    if (operand.kind != OperandKind::REGISTER) {
+        throw std::invalid_argument("Invalid register name: " + operand_text(operand));
+    }
+    return operand.reg;
+}
+
+uint32_t Assembler::operand_immediate(const IrOperand& operand, FixupKind kind, const IrLine& line) {
     // label OR number OR invalid
-    
-    // Check if it's a label
-    auto label_it = labels_.find(imm_str);
-    if (label_it != labels_.end()) {
-        return label_it->second;
+    uint32_t value = 0;
+    if (operand.kind == OperandKind::IMMEDIATE) {
+        value = operand.value;
+    } else if (operand.kind == OperandKind::SYMBOL) {
+        resolve_symbol(operand.value, kind, line.address, line.line_number, value);
+    } else {
+        add_error("Invalid immediate value: " + operand_text(operand), line.line_number);
     }
-    
-    // Parse as number
-    try {
-        if (imm_str.substr(0, 2) == "0x" || imm_str.substr(0, 2) == "0X") {
-            return std::stoul(imm_str, nullptr, 16);
-        } else {
-            return std::stoul(imm_str);
+    return value;
+}
+
+bool Assembler::operand_address(const IrOperand& operand, FixupKind kind, const IrLine& line, uint32_t& target) {
+    if (operand.kind == OperandKind::SYMBOL) {
+        return resolve_symbol(operand.value, kind, line.address, line.line_number, target);
+    }
+    add_error("Undefined label: " + operand_text(operand), line.line_number);
+    return false;
+}
+
+bool Assembler::resolve_symbol(uint32_t symbol, FixupKind kind, uint32_t address, uint32_t line_number, uint32_t& value) {
+    const SymbolTable& symbols = program_->symbols;
+    if (symbols.defined(symbol)) {
+        value = symbols.address(symbol);
+        return true;
+    }
+    if (stream_output_) {
+        fixups_[symbol].push_back(Fixup{kind, address, line_number}); // patched when the label shows up
+    } else if (kind == FixupKind::BRANCH || kind == FixupKind::JUMP) {
+        add_error("Undefined label: " + std::string(symbols.name(symbol)), line_number);
+    } else {
+        add_error("Invalid immediate value: " + std::string(symbols.name(symbol)), line_number);
+    }
+    value = 0;
+    return false;
+}
+
+void Assembler::apply_fixups(uint32_t symbol) {
+    auto it = fixups_.find(symbol);
+    if (it == fixups_.end()) {
+        return;
+    }
+    uint32_t target = program_->symbols.address(symbol);
+    for (const Fixup& fixup : it->second) {
+        // the field was emitted as zero, so the value is or'ed in
+        uint8_t out[4] = {0, 0, 0, 0};
+        uint32_t width = fixup.kind == FixupKind::BYTE ? 1 : fixup.kind == FixupKind::HALF ? 2 : 4;
+        stream_output_->read(fixup.address, out, width);
+        uint32_t word = out[0] | (out[1] << 8) | (out[2] << 16) | (static_cast<uint32_t>(out[3]) << 24);
+        switch (fixup.kind) {
+            case FixupKind::BRANCH:
+                store_little_endian(out, word | (((target - fixup.address - 4) >> 2) & 0xFFFF), 4);
+                break;
+            case FixupKind::JUMP:
+                store_little_endian(out, word | ((target >> 2) & 0x3FFFFFF), 4);
+                break;
+            case FixupKind::IMMEDIATE:
+                store_little_endian(out, word | (target & 0xFFFF), 4);
+                break;
+            case FixupKind::BYTE:
+                store_little_endian(out, target, 1);
+                break;
+            case FixupKind::HALF:
+                store_little_endian(out, target, 2);
+                break;
+            case FixupKind::WORD:
+                store_little_endian(out, target, 4);
+                break;
         }
-    } catch (const std::exception&) {
-        add_error("Invalid immediate value: " + imm_str);
-        return 0;
+        stream_output_->write(fixup.address, out, width);
     }
+    fixups_.erase(it);
 }
 
-uint32_t Assembler::resolve_address(const std::string& label, uint32_t /* current_address */) {
-    auto label_it = labels_.find(label);
-    if (label_it != labels_.end()) {
-        return label_it->second;
+bool Assembler::is_branch(const IrLine& line) {
+    if (line.op >= DIRECTIVE_BASE) {
+        return false;
     }
-    
-    add_error("Undefined label: " + label);
-    return 0;
+    InstructionCategory category = INSTRUCTIONS[line.op].category;
+    return category == InstructionCategory::BRANCH || category == InstructionCategory::BRANCH_ZERO;
+}
+
+std::string Assembler::operand_text(const IrOperand& operand) const {
+    const IrProgram& program = *program_;
+    switch (operand.kind) {
+        case OperandKind::REGISTER:
+            return register_to_string(static_cast<Register>(operand.reg));
+        case OperandKind::IMMEDIATE:
+            return std::to_string(static_cast<int32_t>(operand.value));
+        case OperandKind::SYMBOL:
+            return std::string(program.symbols.name(operand.value));
+        case OperandKind::MEMORY:
+            return std::to_string(static_cast<int32_t>(operand.value)) + "("
+                + register_to_string(static_cast<Register>(operand.reg)) + ")";
+        case OperandKind::MEMORY_SYMBOL:
+            return std::string(program.symbols.name(operand.value)) + "("
+                + register_to_string(static_cast<Register>(operand.reg)) + ")";
+        case OperandKind::STRING:
+            return "\"" + std::string(program.strings[operand.value]) + "\"";
+    }
+    return std::string();
+}
+
+// instruction encoding
+uint32_t Assembler::encode_r_type(uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t rd, uint32_t shamt, uint32_t function) {
+    return (opcode << 26) | (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | function;
+}
+
+uint32_t Assembler::encode_i_type(uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t immediate) {
+    return (opcode << 26) | (rs << 21) | (rt << 16) | (immediate & 0xFFFF);
+}
+
+uint32_t Assembler::encode_j_type(uint32_t opcode, uint32_t address) {
+    return (opcode << 26) | (address & 0x3FFFFFF);
 }
 
 } // namespace mips
@@ -1,7 +1,13 @@
 #pragma once
 
 #include "mips_core.h"
+#include "asm_scanner.h"
+#include "asm_ir.h"
+#include "thread_pool.h"
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <sstream>
@@ -41,9 +47,43 @@ struct AssemblyLine {
     uint32_t size;
 };
 
+// assembler output with the zero runs of .space left out, so a large buffer costs
+// nothing until the guest touches it
+struct SparseBinary {
+    struct ZeroRange {
+        uint32_t address;
+        uint32_t size;
+        uint32_t data_offset; // bytes of data before the range
+    };
+    
+    std::vector<uint8_t> data;          // every byte outside the zero ranges, in address order
+    std::vector<ZeroRange> zero_ranges; // sorted, adjacent ranges are merged
+    uint32_t size = 0;                  // address after the last byte
+    
+    uint8_t* append(uint32_t count);    // zeroed bytes at size
+    void append_zeros(uint32_t count);
+    uint8_t* find(uint32_t address);    // address must lie outside the zero ranges
+    
+    // the stretches between the zero ranges, empty ones skipped
+    void for_each_data_run(const std::function<void(uint32_t address, const uint8_t* bytes, uint32_t count)>& visit) const;
+    std::vector<uint8_t> to_dense() const;
+    void load_into(MachineState& state) const; // data runs only, the zero ranges are left untouched
+};
+
+// destination of the single-pass assembler, see assembler.cpp
+class StreamOutput;
+
 // assembler class
 class Assembler {
 public:
+    // bumped whenever the same source would assemble to different bytes, cached
+    // programs from another version are not used (see assembly_cache.h)
+    static constexpr uint32_t VERSION = 1;
+    
+    // a program must end at or below this address: the binary header stores the end in
+    // 32 bits, where 0xFFFFFFFF marks a sparse binary. a line past it is an error
+    static constexpr uint32_t MAX_END_ADDRESS = 0xFFFFFFFE;
+    
     Assembler();
     
     // parse assembly text
@@ -53,59 +93,94 @@ public:
     // assemble to binary
     std::vector<uint8_t> assemble(const std::vector<AssemblyLine>& lines);
     std::vector<uint8_t> assemble_text(const std::string& assembly_text);
-    std::vector<uint8_t> assemble_stream(std::istream& input);
+    std::vector<uint8_t> assemble_stream(std::istream& input); // one pass, see below
+    SparseBinary assemble_sparse(std::istream& input);         // same, .space left as zero ranges
+    
+    // one pass straight into guest memory, no output buffer; .space is not stored so the
+    // memory it covers should still be zero, as in a fresh MachineState. returns the
+    // address after the last byte
+    uint32_t assemble_into(std::istream& input, MachineState& state);
+    
+    // same bytes and errors as assemble_text, with the source split at line boundaries
+    // and the chunks parsed and encoded on the pool; program() is left empty
+    std::vector<uint8_t> assemble_parallel(const std::string& assembly_text, ThreadPool& pool);
     
     // get main label address
     uint32_t get_main_address() const { return main_address_; }
     
+    // compact form of the last parsed or assembled program, see asm_ir.h
+    const IrProgram& program() const { return *program_; }
+    
     // error handling
     const std::vector<std::string>& get_errors() const { return errors_; }
     bool has_errors() const { return !errors_.empty(); }
     
 private:
-    std::unordered_map<std::string, uint32_t> labels_;
-    std::unordered_map<std::string, uint32_t> instruction_opcodes_;
-    std::unordered_map<std::string, uint32_t> instruction_functions_;
-    std::unordered_map<std::string, InstructionCategory> instruction_categories_;
+    friend class AssemblySession; // keeps a program and re-encodes parts of it
+    
+    std::unique_ptr<IrProgram> program_; // labels are its symbols
+    const std::unordered_map<std::string_view, uint16_t>* mnemonic_ids_; // shared, read-only
+    
+    // assemble_stream emits each line as it is read; a reference to a label that is
+    // not defined yet waits here and is patched into the output once it is
+    StreamOutput* stream_output_;
+    std::unordered_map<uint32_t, std::vector<Fixup>> fixups_; // by symbol id
     std::vector<std::string> errors_;
     uint32_t main_address_;
     
     // parsing helpers
-    AssemblyLine parse_line(const std::string& line, uint32_t line_number);
-    std::vector<std::string> tokenize(const std::string& line);
-    std::string trim(const std::string& str);
-    bool is_register(const std::string& token);
-    bool is_immediate(const std::string& token);
-    bool is_label(const std::string& token);
+    void parse_source(std::string_view text, std::vector<AssemblyLine>* listing, uint32_t first_line = 1);
+    void add_line(std::string_view label, std::string_view mnemonic, const std::string_view* operands,
+                  size_t num_operands, uint32_t line_number);
+    IrOperand decode_operand(std::string_view text, bool as_string);
     
     // assembly helpers
-    uint32_t resolve_immediate(const std::string& imm_str, uint32_t current_address);
-    uint32_t resolve_address(const std::string& label, uint32_t current_address);
-    Instruction assemble_instruction(const AssemblyLine& line);
-    std::vector<uint8_t> assemble_directive(const AssemblyLine& line);
+    uint32_t stream(std::istream& input, StreamOutput& output);
+    std::vector<uint8_t> emit();
+    void emit_line(const IrLine& line, uint8_t* out); // out = the line's first byte
+    uint32_t encode_instruction(const IrLine& line);
+    void emit_directive(const IrLine& line, uint8_t* out);
+    uint32_t operand_register(const IrOperand& operand);
+    uint32_t operand_immediate(const IrOperand& operand, FixupKind kind, const IrLine& line);
+    bool operand_address(const IrOperand& operand, FixupKind kind, const IrLine& line, uint32_t& target);
+    bool resolve_symbol(uint32_t symbol, FixupKind kind, uint32_t address, uint32_t line_number, uint32_t& value);
+    void apply_fixups(uint32_t symbol);
+    std::string operand_text(const IrOperand& operand) const;
+    static bool is_branch(const IrLine& line); // encoded relative to its own address
     
     // instruction encoding
     uint32_t encode_r_type(uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t rd, uint32_t shamt, uint32_t function);
     uint32_t encode_i_type(uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t immediate);
     uint32_t encode_j_type(uint32_t opcode, uint32_t address);
     
-    // initialize instruction tables
-    void init_instruction_tables();
+    // initialize instruction tables, once per process
+    static const std::unordered_map<std::string_view, uint16_t>& init_instruction_tables();
     
     // error reporting
     void add_error(const std::string& error, uint32_t line_numbe = 0);
 };
 
-// binary format I/O
+// binary format I/O: main address and data size, then the data. a sparse binary with
+// zero ranges has SPARSE_MARKER in the size field, followed by the real size, the
+// number of ranges, each range as address and size, and the data outside them
 class BinaryFormat {
 public:
+    static constexpr uint32_t SPARSE_MARKER = 0xFFFFFFFF;
+    
     // write binary format
     static void write_binary(const std::vector<uint8_t>& data, std::ostream& output, uint32_t main_address = 0);
     static void write_binary_file(const std::vector<uint8_t>& data, const std::string& filename, uint32_t main_address = 0);
+    static void write_binary(const SparseBinary& binary, std::ostream& output, uint32_t main_address = 0); // dense without zero ranges
+    static void write_binary_file(const SparseBinary& binary, const std::string& filename, uint32_t main_address = 0);
     
-    // read binary format
+    // read binary format, either layout
     static std::vector<uint8_t> read_binary(std::istream& input, uint32_t& main_address);
     static std::vector<uint8_t> read_binary_file(const std::string& filename, uint32_t& main_address);
+    static SparseBinary read_sparse(std::istream& input, uint32_t& main_address); // throws on a malformed range table
+    static SparseBinary read_sparse_file(const std::string& filename, uint32_t& main_address);
+
+private:
+    static SparseBinary read_zero_ranges(std::istream& input); // after the marker
 };
 
 } // namespace mips
@@ -0,0 +1,207 @@
+#include "assembly_cache.h"
+#include "assembler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mips {
+
+namespace {
+
+std::atomic<uint64_t> temp_counter(0);
+
+uint32_t read_little_endian(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+} // namespace
+
+CachedBinary::CachedBinary(void* mapping, size_t mapping_size)
+    : mapping_(mapping), mapping_size_(mapping_size), data_(nullptr), size_(0), main_address_(0) {
+}
+
+CachedBinary::~CachedBinary() {
+    munmap(mapping_, mapping_size_);
+}
+
+void CachedBinary::load_into(MachineState& state) const {
+    uint32_t address = 0;
+    const uint8_t* bytes = data_;
+    for (const auto& [zero_address, zero_size] : zero_ranges_) {
+        state.write_block(address, bytes, zero_address - address);
+        bytes += zero_address - address;
+        address = zero_address + zero_size;
+    }
+    state.write_block(address, bytes, static_cast<uint32_t>(size_ - address));
+    state.place_heap_above(size_);
+}
+
+AssemblyCache::AssemblyCache(const std::string& directory, uint64_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes) {
+}
+
+uint64_t AssemblyCache::hash(std::string_view source) {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        value = (value ^ ((Assembler::VERSION >> shift) & 0xFF)) * 0x100000001b3ULL;
+    }
+    for (unsigned char c : source) {
+        value = (value ^ c) * 0x100000001b3ULL;
+    }
+    return value;
+}
+
+std::string AssemblyCache::entry_path(uint64_t key) const {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return directory_ + "/" + name;
+}
+
+std::unique_ptr<CachedBinary> AssemblyCache::find(std::string_view source) const {
+    uint64_t key = hash(source);
+    int fd = open(entry_path(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    const size_t min_size = sizeof(AssemblyCacheHeader) + source.size() + 8;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < min_size) {
+        close(fd);
+        return nullptr;
+    }
+    size_t mapping_size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    futimens(fd, nullptr); // the modification time is the last use, for eviction
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    std::unique_ptr<CachedBinary> binary(new CachedBinary(mapping, mapping_size));
+    
+    // anything that does not match exactly is a miss, the next store replaces it
+    AssemblyCacheHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    const uint8_t* stored_source = static_cast<const uint8_t*>(mapping) + sizeof(header);
+    const uint8_t* format = stored_source + source.size();
+    const uint8_t* end = static_cast<const uint8_t*>(mapping) + mapping_size;
+    if (header.magic != ASSEMBLY_CACHE_MAGIC || header.assembler_version != Assembler::VERSION
+        || header.source_size != source.size() || header.source_hash != key
+        || std::memcmp(stored_source, source.data(), source.size()) != 0) {
+        return nullptr;
+    }
+    binary->main_address_ = read_little_endian(format);
+    uint32_t size = read_little_endian(format + 4);
+    if (size != BinaryFormat::SPARSE_MARKER) {
+        if (size != mapping_size - min_size) {
+            return nullptr;
+        }
+        binary->data_ = format + 8;
+        binary->size_ = size;
+        return binary;
+    }
+    
+    // sparse: total size, range count, the ranges, then the data outside them
+    if (end - format < 16) {
+        return nullptr;
+    }
+    size = read_little_endian(format + 8);
+    uint32_t num_ranges = read_little_endian(format + 12);
+    const uint8_t* ranges = format + 16;
+    if (static_cast<size_t>(end - ranges) / 8 < num_ranges) {
+        return nullptr;
+    }
+    uint64_t zeros = 0;
+    uint32_t previous_end = 0;
+    for (uint32_t i = 0; i < num_ranges; ++i) {
+        uint32_t address = read_little_endian(ranges + 8 * i);
+        uint32_t range_size = read_little_endian(ranges + 8 * i + 4);
+        if (address < previous_end || static_cast<uint64_t>(address) + range_size > size) {
+            return nullptr;
+        }
+        binary->zero_ranges_.emplace_back(address, range_size);
+        zeros += range_size;
+        previous_end = address + range_size;
+    }
+    binary->data_ = ranges + 8 * static_cast<size_t>(num_ranges);
+    if (static_cast<uint64_t>(end - binary->data_) != size - zeros) {
+        return nullptr;
+    }
+    binary->size_ = size;
+    return binary;
+}
+
+void AssemblyCache::store(std::string_view source, const SparseBinary& binary, uint32_t main_address) const {
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    
+    // written under a name of its own and renamed over the entry, a reader sees the old
+    // file or the whole new one
+    uint64_t key = hash(source);
+    std::string path = entry_path(key);
+    std::string temp = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(temp_counter++);
+    {
+        std::ofstream file(temp, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open file for writing: " + temp);
+        }
+        AssemblyCacheHeader header{ASSEMBLY_CACHE_MAGIC, Assembler::VERSION, source.size(), key};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(source.data(), static_cast<std::streamsize>(source.size()));
+        BinaryFormat::write_binary(binary, file, main_address);
+        if (!file.flush()) {
+            std::remove(temp.c_str());
+            throw std::runtime_error("Cannot write cache entry: " + temp);
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Cannot rename cache entry: " + path);
+    }
+    evict();
+}
+
+void AssemblyCache::evict() const {
+    // least recently used first; other processes may be deleting the same files, a
+    // file that is already gone is simply skipped
+    namespace fs = std::filesystem;
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code error;
+    for (fs::directory_iterator it(directory_, error), end; !error && it != end; it.increment(error)) {
+        if (it->path().extension() != ".bin") {
+            continue; // entries being written
+        }
+        std::error_code entry_error;
+        Entry entry{it->path(), it->last_write_time(entry_error), it->file_size(entry_error)};
+        if (!entry_error) {
+            total += entry.size;
+            entries.push_back(entry);
+        }
+    }
+    if (total <= max_bytes_) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= max_bytes_) {
+            break;
+        }
+        fs::remove(entry.path, error);
+        total -= entry.size;
+    }
+}
+
+} // namespace mips
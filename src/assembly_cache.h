@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mips {
+
+class MachineState;
+struct SparseBinary;
+
+// Layout of a cache entry, <directory>/<key as 16 hex digits>.bin:
+//
+//   offset 0   AssemblyCacheHeader
+//   offset 24  the source, source_size bytes, compared on lookup since the key is only a hash
+//   then       BinaryFormat bytes: main address, data size, data, or the sparse layout
+//              with its zero ranges when the program has .space
+//
+// Fields are in host byte order, a cache directory belongs to one machine.
+struct AssemblyCacheHeader {
+    uint32_t magic;              // ASSEMBLY_CACHE_MAGIC
+    uint32_t assembler_version;  // Assembler::VERSION
+    uint64_t source_size;
+    uint64_t source_hash;        // the key, checked again against the file name
+};
+
+static constexpr uint32_t ASSEMBLY_CACHE_MAGIC = 0x32534143; // "CAS2", entries without the source were "CASM"
+
+// a cache entry mapped read-only, still valid if the file is evicted or replaced meanwhile
+class CachedBinary {
+public:
+    ~CachedBinary();
+    CachedBinary(const CachedBinary&) = delete;
+    CachedBinary& operator=(const CachedBinary&) = delete;
+    
+    uint32_t main_address() const { return main_address_; }
+    const uint8_t* data() const { return data_; } // the bytes outside the zero ranges, in address order
+    size_t size() const { return size_; }         // address after the last byte
+    
+    // writes the bytes at address 0; the zero ranges are skipped, memory there should still be zero
+    void load_into(MachineState& state) const;
+
+private:
+    friend class AssemblyCache;
+    CachedBinary(void* mapping, size_t mapping_size);
+    
+    void* mapping_;
+    size_t mapping_size_;
+    const uint8_t* data_;
+    size_t size_;
+    uint32_t main_address_;
+    std::vector<std::pair<uint32_t, uint32_t>> zero_ranges_; // address, size
+};
+
+// assembled programs on disk keyed by a hash of their source and the assembler version,
+// so running the same file again skips the assembler. any number of processes may share
+// a directory: entries are written under a private name and renamed into place, and
+// once the entries pass max_bytes the least recently used ones are deleted
+class AssemblyCache {
+public:
+    explicit AssemblyCache(const std::string& directory, uint64_t max_bytes = 256ull << 20);
+    
+    // null on a miss, or if the entry was built from another source (a hash collision)
+    std::unique_ptr<CachedBinary> find(std::string_view source) const;
+    
+    // adds the assembled source and evicts down to max_bytes, throws std::runtime_error
+    // if the entry cannot be written
+    void store(std::string_view source, const SparseBinary& binary, uint32_t main_address) const;
+    
+    const std::string& directory() const { return directory_; }
+    
+    static uint64_t hash(std::string_view source); // 64-bit FNV-1a, assembler version included
+
+private:
+    std::string directory_;
+    uint64_t max_bytes_;
+    
+    std::string entry_path(uint64_t key) const;
+    void evict() const;
+};
+
+} // namespace mips
@@ -0,0 +1,125 @@
+#include "async_output.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace mips {
+
+AsyncOutput::AsyncOutput(std::ostream& sink, size_t capacity)
+    : sink_(sink), head_(0), tail_(0), writer_waiting_(false), producer_waiting_(false),
+      flush_requested_(0), flush_completed_(0), stop_(false) {
+    // round capacity up to a power of two so positions are a mask away
+    size_t size = 16;
+    while (size < capacity) size <<= 1;
+    buffer_.resize(size);
+    mask_ = size - 1;
+    
+    writer_ = std::thread(&AsyncOutput::writer_loop, this);
+}
+
+AsyncOutput::~AsyncOutput() {
+    drain();
+    stop_.store(true);
+    wake_writer();
+    writer_.join();
+}
+
+void AsyncOutput::write(const char* data, size_t size) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    
+    while (size > 0) {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t space = buffer_.size() - (head - tail);
+        
+        if (space == 0) {
+            // ring full: backpressure until the writer frees some space
+            std::unique_lock<std::mutex> lock(mutex_);
+            producer_waiting_.store(true);
+            producer_cv_.wait_for(lock, std::chrono::milliseconds(10), [&] {
+                return tail_.load() != tail;
+            });
+            producer_waiting_.store(false);
+            continue;
+        }
+        
+        // copy up to the end of the buffer, the rest wraps on the next round
+        size_t position = head & mask_;
+        size_t chunk = std::min({size, space, buffer_.size() - position});
+        std::memcpy(buffer_.data() + position, data, chunk);
+        head += chunk;
+        data += chunk;
+        size -= chunk;
+        head_.store(head, std::memory_order_release);
+        wake_writer();
+    }
+}
+
+void AsyncOutput::drain() {
+    uint64_t ticket = flush_requested_.fetch_add(1) + 1;
+    wake_writer();
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    producer_waiting_.store(true);
+    while (flush_completed_.load() < ticket) {
+        producer_cv_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    producer_waiting_.store(false);
+}
+
+void AsyncOutput::writer_loop() {
+    while (true) {
+        // the request is read before the head: a drain() that got its ticket after
+        // its write() is then guaranteed to see that write's bytes below
+        uint64_t requested = flush_requested_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        
+        if (head != tail) {
+            size_t position = tail & mask_;
+            size_t chunk = std::min(head - tail, buffer_.size() - position);
+            sink_.write(buffer_.data() + position, chunk);
+            tail_.store(tail + chunk, std::memory_order_release);
+            wake_producer();
+            continue;
+        }
+        
+        // ring is empty, so everything requested so far has been written
+        if (flush_completed_.load() < requested) {
+            sink_.flush();
+            flush_completed_.store(requested);
+            wake_producer();
+            continue;
+        }
+        
+        if (stop_.load()) {
+            break;
+        }
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        writer_waiting_.store(true);
+        writer_cv_.wait_for(lock, std::chrono::milliseconds(10), [&] {
+            return head_.load() != tail || flush_requested_.load() != requested || stop_.load();
+        });
+        writer_waiting_.store(false);
+    }
+    sink_.flush();
+}
+
+// notifications only go through the mutex when the other side is actually asleep
+void AsyncOutput::wake_writer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst); // order the index store before the flag load
+    if (writer_waiting_.load()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writer_cv_.notify_one();
+    }
+}
+
+void AsyncOutput::wake_producer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producer_waiting_.load()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        producer_cv_.notify_one();
+    }
+}
+
+} // namespace mips
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace mips {
+
+// guest output buffered in a single-producer/single-consumer lock-free ring,
+// a writer thread drains it to the real stream so the interpreter never blocks on I/O
+class AsyncOutput {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+    
+    explicit AsyncOutput(std::ostream& sink, size_t capacity = DEFAULT_CAPACITY);
+    ~AsyncOutput(); // drains the ring and joins the writer
+    
+    AsyncOutput(const AsyncOutput&) = delete;
+    AsyncOutput& operator=(const AsyncOutput&) = delete;
+    
+    // producer side (interpreter thread only), waits for space when the ring is full
+    void write(const char* data, size_t size);
+    
+    // blocks until everything written so far has reached the sink and the sink is flushed
+    void drain();
+    
+    size_t capacity() const { return buffer_.size(); }
+    
+private:
+    std::ostream& sink_;
+    std::vector<char> buffer_;
+    size_t mask_;
+    
+    // ring indices grow monotonically, position = index & mask_
+    alignas(64) std::atomic<size_t> head_; // written by the producer
+    alignas(64) std::atomic<size_t> tail_; // written by the writer thread
+    
+    // slow path only: sleeping and wake-ups when the ring is empty or full
+    std::mutex mutex_;
+    std::condition_variable writer_cv_;
+    std::condition_variable producer_cv_;
+    std::atomic<bool> writer_waiting_;
+    std::atomic<bool> producer_waiting_;
+    std::atomic<uint64_t> flush_requested_;
+    std::atomic<uint64_t> flush_completed_;
+    std::atomic<bool> stop_;
+    std::thread writer_;
+    
+    void writer_loop();
+    void wake_writer();
+    void wake_producer();
+};
+
+} // namespace mips
@@ -1,5 +1,12 @@
 #include "mips_core.h"
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <charconv>
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <mutex>
 
 namespace mips {
 
@@ -305,9 +312,30 @@ void CPU::execute_load_store(const Instruction& instr) {
         case 0b101011: // sw
             state_.store_word(address, state_.get_register(rt_reg));
             break;
+        case 0b110000: // ll
+            if (address & 3) {
+                throw std::runtime_error("Unaligned ll address " + std::to_string(address));
+            }
+            reservation_value_ = state_.load_word(address);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            reservation_address_ = address;
+            reservation_valid_ = true;
+            state_.set_register(rt_reg, reservation_value_);
+            break;
+        case 0b111000: { // sc, rt = 1 on success, 0 if the word changed since the ll
+            bool stored = reservation_valid_ && reservation_address_ == address &&
+                          state_.compare_exchange_word(address, reservation_value_, state_.get_register(rt_reg));
+            reservation_valid_ = false;
+            state_.set_register(rt_reg, stored ? 1 : 0);
+            break;
+        }
     }
 }
 
+void CPU::execute_sync(const Instruction&) {
+    std::atomic_thread_fence(std::memory_order_seq_cst); // mfence on x86-64
+}
+
 void CPU::execute_jump(const Instruction& instr) {
     switch (instr.opcode) {
         case 0b000010: // j
@@ -320,46 +348,150 @@ void CPU::execute_jump(const Instruction& instr) {
     }
 }
 
+namespace {
+
+// true if a token is buffered on the stream, skips leading whitespace like operator>> does
+bool input_available(std::istream& input) {
+    input.clear(); // more data may have been appended after a previous eof
+    auto* buffer = input.rdbuf();
+    while (buffer->in_avail() > 0) {
+        if (!std::isspace(static_cast<unsigned char>(buffer->sgetc()))) {
+            return true;
+        }
+        buffer->sbumpc();
+    }
+    return false;
+}
+
+// true if a whole integer is buffered, i.e. something that cannot extend it follows the
+// digits; "1" alone may still become "12" with the next provide_input
+bool integer_available(std::istream& input) {
+    if (!input_available(input)) {
+        return false;
+    }
+    auto* buffer = input.rdbuf();
+    auto start = buffer->pubseekoff(0, std::ios::cur, std::ios::in);
+    if (start == std::streampos(-1)) {
+        return true; // cannot look ahead, let operator>> take what is there
+    }
+    bool complete = false;
+    for (bool first = true; buffer->in_avail() > 0; first = false) {
+        char c = static_cast<char>(buffer->sbumpc());
+        bool sign = first && (c == '-' || c == '+');
+        if (!sign && !std::isdigit(static_cast<unsigned char>(c))) {
+            complete = true;
+            break;
+        }
+    }
+    buffer->pubseekpos(start, std::ios::in);
+    return complete;
+}
+
+} // namespace
+
 void CPU::execute_trap(const Instruction& instr) {
     uint32_t syscall_num = instr.immediate;
+    waiting_for_input_ = false;
     
-    switch (syscall_num) {
-        case 0: { // print_int
-            uint32_t value = state_.get_register(Register::A0);
-            *state_.output_stream << static_cast<int32_t>(value);
-            break;
-        }
-        case 1: { // print_character
-            uint32_t value = state_.get_register(Register::A0);
-            *state_.output_stream << static_cast<char>(value & 0xFF);
-            break;
+    if (syscall_num >= syscalls_.size() || !syscalls_[syscall_num]) {
+        throw std::runtime_error("Unknown trap code: " + std::to_string(syscall_num));
+    }
+    syscalls_[syscall_num](*this, state_);
+}
+
+void CPU::register_builtin_syscalls() {
+    register_syscall(static_cast<uint32_t>(TrapCode::PRINT_INT), [](CPU&, MachineState& state) {
+        char buffer[16];
+        int32_t value = static_cast<int32_t>(state.get_register(Register::A0));
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        state.write_output(buffer, result.ptr - buffer);
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::PRINT_CHARACTER), [](CPU&, MachineState& state) {
+        char c = static_cast<char>(state.get_register(Register::A0) & 0xFF);
+        state.write_output(&c, 1);
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::PRINT_STRING), [](CPU&, MachineState& state) {
+        uint32_t address = state.get_register(Register::A0);
+        uint32_t length = state.string_length(address);
+        char buffer[256];
+        while (length > 0) {
+            uint32_t chunk = std::min<uint32_t>(length, sizeof(buffer));
+            state.read_block(address, reinterpret_cast<uint8_t*>(buffer), chunk);
+            state.write_output(buffer, chunk);
+            address += chunk;
+            length -= chunk;
         }
-        case 2: { // print_string
-            uint32_t address = state_.get_register(Register::A0);
-            while (true) {
-                uint8_t c = state_.load_byte(address);
-                if (c == 0) break;
-                *state_.output_stream << static_cast<char>(c);
-                address++;
-            }
-            break;
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::READ_INT), [](CPU& cpu, MachineState& state) {
+        state.flush_output(); // prompts must be visible before blocking on input
+        std::lock_guard<std::mutex> lock(state.input_mutex());
+        if (!cpu.has_blocking_input() && !integer_available(*state.input_stream)) {
+            cpu.wait_for_input();
+            return;
         }
-        case 3: { // read_int
-            int32_t value;
-            *state_.input_stream >> value;
-            state_.set_register(Register::V0, static_cast<uint32_t>(value));
-            break;
+        int32_t value = 0; // stays 0 at eof
+        *state.input_stream >> value;
+        state.set_register(Register::V0, static_cast<uint32_t>(value));
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::READ_CHARACTER), [](CPU& cpu, MachineState& state) {
+        state.flush_output();
+        std::lock_guard<std::mutex> lock(state.input_mutex());
+        if (!cpu.has_blocking_input() && !input_available(*state.input_stream)) {
+            cpu.wait_for_input();
+            return;
         }
-        case 4: { // read_character
-            char c;
-            *state_.input_stream >> c;
-            state_.set_register(Register::V0, static_cast<uint32_t>(c));
-            break;
+        char c = 0;
+        *state.input_stream >> c;
+        state.set_register(Register::V0, static_cast<uint32_t>(c));
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::EXIT), [](CPU& cpu, MachineState& state) {
+        state.flush_output();
+        cpu.halt();
+    });
+    
+    // bulk memory routines, run natively over guest pages
+    auto copy = [](CPU&, MachineState& state) {
+        state.copy_memory(state.get_register(Register::A0), state.get_register(Register::A1),
+                          state.get_register(Register::A2));
+    };
+    register_syscall(static_cast<uint32_t>(TrapCode::MEMCPY), copy);
+    register_syscall(static_cast<uint32_t>(TrapCode::MEMMOVE), copy);
+    register_syscall(static_cast<uint32_t>(TrapCode::MEMSET), [](CPU&, MachineState& state) {
+        state.fill_memory(state.get_register(Register::A0),
+                          static_cast<uint8_t>(state.get_register(Register::A1) & 0xFF),
+                          state.get_register(Register::A2));
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::MEMCMP), [](CPU&, MachineState& state) {
+        int result = state.compare_memory(state.get_register(Register::A0), state.get_register(Register::A1),
+                                          state.get_register(Register::A2));
+        state.set_register(Register::V0, static_cast<uint32_t>(result));
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::STRLEN), [](CPU&, MachineState& state) {
+        state.set_register(Register::V0, state.string_length(state.get_register(Register::A0)));
+    });
+    
+    // heap management, the heap is shared by every hart of the machine
+    register_syscall(static_cast<uint32_t>(TrapCode::SBRK), [](CPU&, MachineState& state) {
+        int32_t increment = static_cast<int32_t>(state.get_register(Register::A0));
+        std::lock_guard<std::mutex> lock(state.heap_mutex());
+        state.set_register(Register::V0, state.heap().sbrk(increment));
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::MALLOC), [](CPU&, MachineState& state) {
+        std::lock_guard<std::mutex> lock(state.heap_mutex());
+        state.set_register(Register::V0, state.heap().allocate(state.get_register(Register::A0)));
+    });
+    register_syscall(static_cast<uint32_t>(TrapCode::FREE), [](CPU&, MachineState& state) {
+        uint32_t address = state.get_register(Register::A0);
+        std::lock_guard<std::mutex> lock(state.heap_mutex());
+        if (!state.heap().release(address)) {
+            throw std::runtime_error("Invalid free of address " + std::to_string(address));
         }
-        case 5: // exit
-            halted_ = true;
-            break;
-    }
+    });
+    
+    // harts, spawn and join are provided by SmpMachine
+    register_syscall(static_cast<uint32_t>(TrapCode::HART_ID), [](CPU& cpu, MachineState& state) {
+        state.set_register(Register::V0, cpu.get_hart_id());
+    });
 }
 
 } // namespace mips
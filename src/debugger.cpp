@@ -8,7 +8,8 @@
 namespace mips {
 
 Debugger::Debugger() 
-    : prev_pc_(0), prev_hi_(0), prev_lo_(0), running_(false), program_loaded_(false) {
+    : loaded_start_(0), loaded_end_(0), prev_pc_(0), prev_hi_(0), prev_lo_(0), running_(false),
+      program_loaded_(false) {
     prev_registers_.fill(0);
 }
 
@@ -18,6 +19,7 @@ bool Debugger::load_program(const std::string& assembly_file) {
         std::cerr << "Error: Could not open file " << assembly_file << std::endl;
         return false;
     }
+    program_file_ = assembly_file;
     
     std::string assembly_text((std::istreambuf_iterator<char>(file)),
                               std::istreambuf_iterator<char>());
@@ -28,59 +30,65 @@ bool Debugger::load_program(const std::string& assembly_file) {
 
 bool Debugger::load_program_from_string(const std::string& assembly_text) {
     try {
-        // parse assembly
-        assembly_lines_ = assembler_.parse_assembly(assembly_text);
-        if (assembler_.has_errors()) {
-            std::cerr << "Assembly errors:" << std::endl;
-            for (const auto& error : assembler_.get_errors()) {
-                std::cerr << "  " << error << std::endl;
+        // assemble, a reload only re-parses and re-encodes what the edit touched
+        if (program_loaded_) {
+            session_.update(assembly_text);
+        } else {
+            session_.load(assembly_text);
+        }
+        
+        // instruction text for the replaced lines only, the others keep theirs
+        const AssemblySession::Edit& edit = session_.last_edit();
+        line_assembly_.erase(line_assembly_.begin() + edit.first, line_assembly_.begin() + edit.first + edit.old_count);
+        line_assembly_.insert(line_assembly_.begin() + edit.first, edit.count, std::string());
+        ScannedLine line;
+        for (size_t index = edit.first; index < edit.first + edit.count; ++index) {
+            SourceScanner::scan(session_.line_text(index), line);
+            if (!line.mnemonic.empty()) {
+                std::string& text = line_assembly_[index];
+                text = std::string(line.mnemonic);
+                if (!line.operands.empty()) {
+                    text += " ";
+                    for (size_t i = 0; i < line.operands.size(); ++i) {
+                        if (i > 0) text += ", ";
+                        text += std::string(line.operands[i]);
+                    }
+                }
             }
-            return false;
         }
         
-        // assemble to binary
-        std::vector<uint8_t> binary = assembler_.assemble(assembly_lines_);
-        if (assembler_.has_errors()) {
+        if (session_.has_errors()) {
             std::cerr << "Assembly errors:" << std::endl;
-            for (const auto& error : assembler_.get_errors()) {
+            for (const auto& error : session_.get_errors()) {
                 std::cerr << "  " << error << std::endl;
             }
             return false;
         }
+        const std::vector<uint8_t>& binary = session_.binary();
         
-        // load binary into CPU memory
-        uint32_t main_address = assembler_.get_main_address();
-        for (size_t i = 0; i < binary.size(); ++i) {
-            cpu_.get_state().store_byte(main_address + i, binary[i]);
+        // load binary into CPU memory; what an earlier, longer version left outside it is
+        // cleared so no stale instruction stays reachable
+        MachineState& state = cpu_.get_state();
+        uint32_t main_address = session_.get_main_address();
+        uint32_t end = main_address + static_cast<uint32_t>(binary.size());
+        state.write_block(main_address, binary.data(), binary.size());
+        if (loaded_start_ < std::min(main_address, loaded_end_)) {
+            state.fill_memory(loaded_start_, 0, std::min(main_address, loaded_end_) - loaded_start_);
         }
-        cpu_.get_state().set_pc(main_address);
-        
-        // build address-to-assembly mapping and labels
-        address_to_assembly_.clear();
-        labels_.clear();
-        
-        for (const auto& line : assembly_lines_) {
-            if (!line.instruction.empty()) {
-                address_to_assembly_[line.address] = line.instruction;
-                if (!line.operands.empty()) {
-                    address_to_assembly_[line.address] += " ";
-                    for (size_t i = 0; i < line.operands.size(); ++i) {
-                        if (i > 0) address_to_assembly_[line.address] += ", ";
-                        address_to_assembly_[line.address] += line.operands[i];
-                    }
-                }
-            }
-            if (!line.label.empty()) {
-                labels_[line.label] = line.address;
-            }
+        if (std::max(end, loaded_start_) < loaded_end_) {
+            state.fill_memory(std::max(end, loaded_start_), 0, loaded_end_ - std::max(end, loaded_start_));
         }
+        state.place_heap_above(end);
+        loaded_start_ = main_address;
+        loaded_end_ = end;
+        state.set_pc(main_address);
         
         // capture initial state
         capture_state();
         program_loaded_ = true;
         
         std::cout << "Program loaded successfully. Entry point: 0x" 
-                  << std::hex << std::uppercase << assembler_.get_main_address() << std::endl;
+                  << std::hex << std::uppercase << session_.get_main_address() << std::endl;
         
         return true;
         
@@ -130,6 +138,9 @@ void Debugger::run() {
             case DebugCommand::CONTINUE:
                 handle_continue();
                 break;
+            case DebugCommand::RELOAD:
+                handle_reload();
+                break;
             case DebugCommand::HELP:
                 handle_help();
                 break;
@@ -216,9 +227,10 @@ void Debugger::handle_break(const std::string& label_or_address) {
     uint32_t address;
     
     // try to parse as label first
-    auto label_it = labels_.find(label_or_address);
-    if (label_it != labels_.end()) {
-        address = label_it->second;
+    const SymbolTable& symbols = session_.program().symbols;
+    uint32_t symbol = symbols.find(label_or_address);
+    if (symbol != SymbolTable::NONE && symbols.defined(symbol)) {
+        address = symbols.address(symbol);
     } else {
         // try to parse as address
         try {
@@ -262,6 +274,18 @@ void Debugger::handle_continue() {
     std::cout << "Program halted." << std::endl;
 }
 
+void Debugger::handle_reload() {
+    if (program_file_.empty()) {
+        std::cout << "No program file to reload." << std::endl;
+        return;
+    }
+    
+    // memory and the pc are loaded again, registers and breakpoints are kept
+    if (load_program(program_file_)) {
+        print_current_instruction();
+    }
+}
+
 void Debugger::handle_help() {
     std::cout << "Available commands:" << std::endl;
     std::cout << "  step                    - Execute current instruction and move to next" << std::endl;
@@ -271,6 +295,7 @@ void Debugger::handle_help() {
     std::cout << "  mem32 <address>         - Show 32-bit value at memory address" << std::endl;
     std::cout << "  break <label|address>   - Set breakpoint at label or address" << std::endl;
     std::cout << "  continue                - Continue execution until breakpoint or halt" << std::endl;
+    std::cout << "  reload                  - Re-assemble the program file after an edit" << std::endl;
     std::cout << "  help                    - Show this help message" << std::endl;
     std::cout << "  quit                    - Exit debugger" << std::endl;
 }
@@ -367,6 +392,8 @@ ParsedCommand Debugger::parse_command(const std::string& input) {
         iss >> result.argument;
     } else if (cmd == "continue" || cmd == "c") {
         result.type = DebugCommand::CONTINUE;
+    } else if (cmd == "reload") {
+        result.type = DebugCommand::RELOAD;
     } else if (cmd == "help" || cmd == "h") {
         result.type = DebugCommand::HELP;
     } else if (cmd == "quit" || cmd == "q") {
@@ -430,9 +457,25 @@ void Debugger::print_prompt() {
 }
 
 std::string Debugger::format_instruction_at_address(uint32_t address) {
-    auto it = address_to_assembly_.find(address);
-    if (it != address_to_assembly_.end()) {
-        return it->second;
+    // lines that emit nothing share the address of the next one, the last with text wins
+    size_t low = 0;
+    size_t high = session_.num_lines();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (session_.line_address(middle) < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    const std::string* text = nullptr;
+    for (size_t index = low; index < session_.num_lines() && session_.line_address(index) == address; ++index) {
+        if (!line_assembly_[index].empty()) {
+            text = &line_assembly_[index];
+        }
+    }
+    if (text) {
+        return *text;
     }
     
     // if no assembly found, try to decode the instruction from memory
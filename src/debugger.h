@@ -2,6 +2,7 @@
 
 #include "mips_core.h"
 #include "assembler.h"
+#include "asm_session.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -18,6 +19,7 @@ enum class DebugCommand {
     MEM32,
     BREAK,
     CONTINUE,
+    RELOAD,
     QUIT,
     HELP,
     INVALID
@@ -35,7 +37,8 @@ class Debugger {
 public:
     Debugger();
     
-    // load and prepare program for debugging
+    // load and prepare program for debugging, loading again only re-assembles the lines
+    // that changed
     bool load_program(const std::string& assembly_file);
     bool load_program_from_string(const std::string& assembly_text);
     
@@ -50,18 +53,22 @@ public:
     void handle_mem32(uint32_t address);
     void handle_break(const std::string& label_or_address);
     void handle_continue();
+    void handle_reload();
     void handle_help();
     
     // state inspection
     void print_current_instruction();
     void print_machine_state_changes();
+    std::string format_instruction_at_address(uint32_t address);
+    const MachineState& get_state() const { return cpu_.get_state(); }
     
 private:
     CPU cpu_;
-    Assembler assembler_;
-    std::vector<AssemblyLine> assembly_lines_;
-    std::unordered_map<uint32_t, std::string> address_to_assembly_;
-    std::unordered_map<std::string, uint32_t> labels_;
+    AssemblySession session_;
+    std::string program_file_;
+    std::vector<std::string> line_assembly_; // instruction text of each source line, empty if none
+    uint32_t loaded_start_;                  // guest memory the program occupies
+    uint32_t loaded_end_;
     std::vector<uint32_t> breakpoints_;
     
     // prev state for change detection
@@ -80,7 +87,6 @@ private:
     uint32_t parse_address(const std::string& addr_str);
     void capture_state();
     void print_prompt();
-    std::string format_instruction_at_address(uint32_t address);
     bool is_at_breakpoint(uint32_t pc);
 };
 
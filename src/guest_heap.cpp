@@ -0,0 +1,150 @@
+#include "guest_heap.h"
+#include <stdexcept>
+#include <iterator>
+
+namespace mips {
+
+GuestHeap::GuestHeap(uint32_t base, uint32_t limit)
+    : base_(base), limit_(limit), break_(base), bytes_in_use_(0), peak_bytes_in_use_(0), free_bytes_(0) {
+    // base 0 is reserved as the allocation failure value
+    if (base == 0 || base % ALIGNMENT != 0 || limit < base) {
+        throw std::invalid_argument("Invalid heap segment");
+    }
+}
+
+uint32_t GuestHeap::sbrk(int32_t increment) {
+    uint32_t old_break = break_;
+    int64_t new_break = static_cast<int64_t>(break_) + increment;
+    if (new_break < base_ || new_break > limit_) {
+        return SBRK_FAILED;
+    }
+    
+    if (increment < 0) {
+        // never shrink below a live allocation
+        if (!allocations_.empty()) {
+            auto last = allocations_.rbegin();
+            if (static_cast<int64_t>(last->first) + last->second > new_break) {
+                return SBRK_FAILED;
+            }
+        }
+        // drop free blocks that now lie above the break
+        while (!free_by_address_.empty()) {
+            auto last = std::prev(free_by_address_.end());
+            uint32_t address = last->first;
+            uint32_t size = last->second;
+            if (static_cast<int64_t>(address) + size <= new_break) break;
+            erase_free(address, size);
+            if (address < new_break) {
+                insert_free(address, static_cast<uint32_t>(new_break - address));
+            }
+        }
+    }
+    
+    break_ = static_cast<uint32_t>(new_break);
+    return old_break;
+}
+
+uint32_t GuestHeap::allocate(uint32_t size) {
+    if (size == 0) size = 1;
+    if (size > limit_ - base_) return 0;
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    
+    uint32_t address = 0;
+    auto fit = free_by_size_.lower_bound(size); // best fit
+    if (fit != free_by_size_.end()) {
+        address = fit->second;
+        uint32_t block_size = fit->first;
+        erase_free(address, block_size);
+        if (block_size > size) {
+            insert_free(address + size, block_size - size); // split off the tail
+        }
+    } else {
+        // extend the break, reusing a free block that touches it
+        uint32_t start = break_;
+        if (!free_by_address_.empty()) {
+            auto last = std::prev(free_by_address_.end());
+            if (last->first + last->second == break_) {
+                start = last->first;
+            }
+        }
+        if (static_cast<uint64_t>(start) + size > limit_) {
+            return 0;
+        }
+        if (start != break_) {
+            erase_free(start, break_ - start);
+        }
+        address = start;
+        break_ = start + size;
+    }
+    
+    allocations_[address] = size;
+    bytes_in_use_ += size;
+    if (bytes_in_use_ > peak_bytes_in_use_) {
+        peak_bytes_in_use_ = bytes_in_use_;
+    }
+    return address;
+}
+
+bool GuestHeap::release(uint32_t address) {
+    if (address == 0) return true; // free(NULL)
+    
+    auto it = allocations_.find(address);
+    if (it == allocations_.end()) {
+        return false;
+    }
+    uint32_t size = it->second;
+    allocations_.erase(it);
+    bytes_in_use_ -= size;
+    
+    // coalesce with neighbouring free blocks
+    auto next = free_by_address_.find(address + size);
+    if (next != free_by_address_.end()) {
+        uint32_t next_size = next->second;
+        erase_free(address + size, next_size);
+        size += next_size;
+    }
+    auto prev = free_by_address_.lower_bound(address);
+    if (prev != free_by_address_.begin()) {
+        --prev;
+        if (prev->first + prev->second == address) {
+            uint32_t prev_address = prev->first;
+            uint32_t prev_size = prev->second;
+            erase_free(prev_address, prev_size);
+            address = prev_address;
+            size += prev_size;
+        }
+    }
+    insert_free(address, size);
+    return true;
+}
+
+HeapStats GuestHeap::get_stats() const {
+    HeapStats stats;
+    stats.bytes_in_use = bytes_in_use_;
+    stats.peak_bytes_in_use = peak_bytes_in_use_;
+    stats.free_bytes = free_bytes_;
+    stats.largest_free_block = free_by_size_.empty() ? 0 : free_by_size_.rbegin()->first;
+    stats.allocation_count = static_cast<uint32_t>(allocations_.size());
+    stats.heap_size = break_ - base_;
+    return stats;
+}
+
+void GuestHeap::insert_free(uint32_t address, uint32_t size) {
+    free_by_address_[address] = size;
+    free_by_size_.emplace(size, address);
+    free_bytes_ += size;
+}
+
+void GuestHeap::erase_free(uint32_t address, uint32_t size) {
+    free_by_address_.erase(address);
+    auto range = free_by_size_.equal_range(size);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == address) {
+            free_by_size_.erase(it);
+            break;
+        }
+    }
+    free_bytes_ -= size;
+}
+
+} // namespace mips
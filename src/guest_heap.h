@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+namespace mips {
+
+// heap usage counters
+struct HeapStats {
+    uint32_t bytes_in_use;        // payload bytes of live allocations
+    uint32_t peak_bytes_in_use;
+    uint32_t free_bytes;          // bytes sitting in the free list below the break
+    uint32_t largest_free_block;
+    uint32_t allocation_count;    // live allocations
+    uint32_t heap_size;           // break - base
+    
+    // 0 = all free memory in one block, close to 1 = free memory split into many small blocks
+    double fragmentation() const {
+        return free_bytes == 0 ? 0.0 : 1.0 - static_cast<double>(largest_free_block) / free_bytes;
+    }
+};
+
+// host-side allocator for the guest heap segment, metadata never lives in guest memory
+class GuestHeap {
+public:
+    static constexpr uint32_t DEFAULT_BASE = 0x10000000; // raised above larger programs on load
+    static constexpr uint32_t DEFAULT_LIMIT = 0x80000000;
+    static constexpr uint32_t ALIGNMENT = 8;
+    static constexpr uint32_t SBRK_FAILED = 0xFFFFFFFF;
+    
+    GuestHeap(uint32_t base = DEFAULT_BASE, uint32_t limit = DEFAULT_LIMIT);
+    
+    // move the break, returns the old break or SBRK_FAILED
+    uint32_t sbrk(int32_t increment);
+    
+    // malloc/free, allocate returns 0 when the segment is exhausted
+    uint32_t allocate(uint32_t size);
+    bool release(uint32_t address);
+    
+    uint32_t get_base() const { return base_; }
+    uint32_t get_break() const { return break_; }
+    uint32_t get_limit() const { return limit_; }
+    HeapStats get_stats() const;
+    
+private:
+    uint32_t base_;
+    uint32_t limit_;
+    uint32_t break_;
+    uint32_t bytes_in_use_;
+    uint32_t peak_bytes_in_use_;
+    uint32_t free_bytes_;
+    
+    std::map<uint32_t, uint32_t> allocations_;          // address -> size
+    std::map<uint32_t, uint32_t> free_by_address_;      // address -> size (for coalescing)
+    std::multimap<uint32_t, uint32_t> free_by_size_;    // size -> address (for best fit)
+    
+    void insert_free(uint32_t address, uint32_t size);
+    void erase_free(uint32_t address, uint32_t size);
+};
+
+} // namespace mips
@@ -0,0 +1,73 @@
+#include "guest_session.h"
+
+namespace mips {
+
+GuestSession::GuestSession(std::shared_ptr<const ProgramImage> image)
+    : state_(SessionState::READY), instructions_(0) {
+    start(std::move(image));
+}
+
+void GuestSession::reset(std::shared_ptr<const ProgramImage> image) {
+    cpu_.reset();
+    input_.str("");
+    input_.clear();
+    output_.str("");
+    state_ = SessionState::READY;
+    instructions_ = 0;
+    error_.clear();
+    start(std::move(image));
+}
+
+void GuestSession::start(std::shared_ptr<const ProgramImage> image) {
+    MachineState& state = cpu_.get_state();
+    state.input_stream = &input_;
+    state.output_stream = &output_;
+    state.set_pc(image->main_address());
+    state.set_register(Register::SP, 0xFFFFFFFC);
+    state.map_image(std::move(image));
+    cpu_.set_blocking_input(false); // park on the trap instead of blocking the caller
+}
+
+SessionState GuestSession::resume(uint64_t max_instructions) {
+    if (state_ == SessionState::HALTED || state_ == SessionState::FAULTED) {
+        return state_;
+    }
+    // a parked input trap is retried by the next run
+    uint64_t start = cpu_.instruction_count();
+    StopReason reason = cpu_.run(max_instructions);
+    instructions_ += cpu_.instruction_count() - start;
+    
+    switch (reason) {
+        case StopReason::HALTED:
+            state_ = SessionState::HALTED;
+            break;
+        case StopReason::WAITING_FOR_INPUT:
+            state_ = SessionState::NEEDS_INPUT;
+            break;
+        case StopReason::FAULT:
+            error_ = cpu_.fault_message();
+            state_ = SessionState::FAULTED;
+            break;
+        default:
+            state_ = SessionState::READY; // budget used up, or a breakpoint set on cpu()
+            break;
+    }
+    return state_;
+}
+
+void GuestSession::provide_input(const std::string& text) {
+    input_.clear(); // a previous read may have hit eof
+    input_ << text;
+}
+
+void GuestSession::close_input() {
+    cpu_.set_blocking_input(true); // reads now see eof on the exhausted stream
+}
+
+std::string GuestSession::take_output() {
+    std::string text = output_.str();
+    output_.str("");
+    return text;
+}
+
+} // namespace mips
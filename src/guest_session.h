@@ -0,0 +1,59 @@
+#pragma once
+
+#include "mips_core.h"
+#include "program_image.h"
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace mips {
+
+enum class SessionState {
+    READY,          // new, or stopped because its instruction budget ran out
+    NEEDS_INPUT,    // suspended on an input trap with nothing buffered
+    HALTED,
+    FAULTED
+};
+
+// one guest run as a resumable state machine: resume() executes until the guest halts,
+// faults, uses up its budget or reaches an input trap with no data, and returns to the
+// caller instead of blocking; after provide_input() the next resume() retries that trap.
+// a single host thread can interleave any number of sessions
+class GuestSession {
+public:
+    explicit GuestSession(std::shared_ptr<const ProgramImage> image);
+    
+    GuestSession(const GuestSession&) = delete;
+    GuestSession& operator=(const GuestSession&) = delete;
+    
+    // starts image from scratch on this session's CPU, so a pool of sessions can be
+    // reused without rebuilding CPUs (registered traps are kept)
+    void reset(std::shared_ptr<const ProgramImage> image);
+    
+    // max_instructions = 0 runs until the guest halts, faults or needs input
+    SessionState resume(uint64_t max_instructions = 0);
+    
+    // READ_INT only takes a number once a delimiter follows it, text may split anywhere
+    void provide_input(const std::string& text);
+    void close_input(); // input traps read end-of-file from now on instead of suspending
+    
+    std::string output() const { return output_.str(); } // everything written so far
+    std::string take_output(); // output since the last call
+    
+    SessionState state() const { return state_; }
+    const std::string& error() const { return error_; }
+    uint64_t instructions() const { return instructions_; }
+    CPU& cpu() { return cpu_; }
+
+private:
+    CPU cpu_;
+    std::stringstream input_{std::ios::in | std::ios::out | std::ios::ate}; // appends go to the end
+    std::ostringstream output_;
+    SessionState state_;
+    uint64_t instructions_;
+    std::string error_;
+    
+    void start(std::shared_ptr<const ProgramImage> image);
+};
+
+} // namespace mips
@@ -0,0 +1,411 @@
+#include "job_server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mips {
+
+namespace {
+
+constexpr size_t MAX_HEADER = 256;
+constexpr uint64_t SLICE = 1 << 20; // instructions between output flushes
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+void send_all(int fd, const std::string& data, int flags = 0) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL | flags);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            throw std::runtime_error(std::string("send failed: ") + std::strerror(errno));
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+std::string error_response(const std::string& message) {
+    return "error " + std::to_string(message.size()) + "\n" + message;
+}
+
+} // namespace
+
+struct JobServer::Request {
+    ProgramCache::Kind kind;
+    std::string program;
+    std::string input;
+    uint64_t max_steps;
+};
+
+// a client socket: the polling thread receives without blocking until a whole request
+// is buffered, the worker running that request writes the response
+class JobServer::Connection {
+public:
+    explicit Connection(int fd) : fd_(fd), closed_(false) {}
+    ~Connection() { close(fd_); }
+    
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    
+    int fd() const { return fd_; }
+    bool closed() const { return closed_; } // the client sent everything it will send
+    
+    // takes what the socket has right now
+    void receive() {
+        char chunk[64 * 1024];
+        while (true) {
+            ssize_t n = recv(fd_, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (n < 0) {
+                throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+            }
+            if (n == 0) {
+                closed_ = true;
+            }
+            pending_.append(chunk, static_cast<size_t>(n));
+            return; // poll() reports the rest, other connections get their turn
+        }
+    }
+    
+    // moves a complete request off the front of the buffer, throws on a bad header
+    bool take_request(Request& request) {
+        size_t newline = pending_.find('\n');
+        if (newline == std::string::npos) {
+            if (pending_.size() > MAX_HEADER) {
+                throw std::runtime_error("Request header too long");
+            }
+            return false;
+        }
+        std::string header = pending_.substr(0, newline);
+        std::istringstream fields(header);
+        std::string kind;
+        size_t program_size = 0;
+        size_t input_size = 0;
+        uint64_t max_steps = 0;
+        if (newline > MAX_HEADER || !(fields >> kind >> program_size >> input_size >> max_steps) ||
+            (kind != "asm" && kind != "bin") || program_size > MAX_PAYLOAD || input_size > MAX_PAYLOAD) {
+            throw std::runtime_error("Bad request header: " + header.substr(0, MAX_HEADER));
+        }
+        size_t body = newline + 1;
+        if (pending_.size() - body < program_size + input_size) {
+            return false;
+        }
+        request.kind = kind == "asm" ? ProgramCache::Kind::ASSEMBLY : ProgramCache::Kind::BINARY;
+        request.program = pending_.substr(body, program_size);
+        request.input = pending_.substr(body + program_size, input_size);
+        request.max_steps = max_steps;
+        pending_.erase(0, body + program_size + input_size);
+        return true;
+    }
+    
+    void write(const std::string& data) { send_all(fd_, data); }
+    
+    // for protocol errors on the polling thread, which must not wait on the client
+    void try_write(const std::string& data) {
+        try {
+            send_all(fd_, data, MSG_DONTWAIT);
+        } catch (const std::exception&) {
+        }
+    }
+
+private:
+    int fd_;
+    bool closed_;
+    std::string pending_;
+};
+
+JobServer::JobServer(const std::string& socket_path, size_t num_threads, size_t cache_size,
+                     uint64_t default_steps, uint64_t step_limit)
+    : socket_path_(socket_path), listen_fd_(-1), wake_fds_{-1, -1}, default_steps_(std::min(default_steps, step_limit)),
+      step_limit_(step_limit), stopping_(false), cache_(cache_size), pool_(num_threads) {
+    sockaddr_un address = socket_address(socket_path);
+    if (pipe2(wake_fds_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        int error = errno;
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(error));
+    }
+    unlink(socket_path.c_str()); // stale socket from an earlier run
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd_, 64) < 0) {
+        int error = errno;
+        close(listen_fd_);
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+        throw std::runtime_error("Cannot listen on " + socket_path + ": " + std::strerror(error));
+    }
+}
+
+JobServer::~JobServer() {
+    stopping_ = true;
+    pool_.wait_idle(); // running jobs see stopping_ and finish early
+    close(listen_fd_);
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+    unlink(socket_path_.c_str());
+}
+
+void JobServer::stop() {
+    stopping_ = true;
+    wake();
+}
+
+void JobServer::wake() {
+    char byte = 0;
+    ssize_t ignored = ::write(wake_fds_[1], &byte, 1); // a full pipe already wakes the poller
+    (void)ignored;
+}
+
+void JobServer::run() {
+    std::vector<std::unique_ptr<Connection>> idle;
+    std::vector<pollfd> fds;
+    while (!stopping_.load()) {
+        std::vector<std::unique_ptr<Connection>> served;
+        {
+            std::lock_guard<std::mutex> lock(served_mutex_);
+            served.swap(served_);
+        }
+        for (auto& connection : served) {
+            dispatch(std::move(connection), idle); // a pipelined request may be waiting
+        }
+        
+        fds.assign({pollfd{listen_fd_, POLLIN, 0}, pollfd{wake_fds_[0], POLLIN, 0}});
+        for (const auto& connection : idle) {
+            fds.push_back(pollfd{connection->fd(), POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        }
+        if (fds[1].revents != 0) {
+            char bytes[64];
+            while (read(wake_fds_[0], bytes, sizeof(bytes)) > 0) {
+            }
+        }
+        
+        // readable or closed, the bytes are taken here and a worker gets only whole requests
+        std::vector<std::unique_ptr<Connection>> ready;
+        for (size_t i = idle.size(); i-- > 0;) {
+            if (fds[i + 2].revents != 0) {
+                ready.push_back(std::move(idle[i]));
+                idle.erase(idle.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+        for (auto& connection : ready) {
+            try {
+                connection->receive();
+            } catch (const std::exception&) {
+                continue; // the socket is gone, so is the connection
+            }
+            dispatch(std::move(connection), idle);
+        }
+        if (fds[0].revents != 0) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                idle.push_back(std::make_unique<Connection>(fd));
+            } else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) {
+                throw std::runtime_error(std::string("accept failed: ") + std::strerror(errno));
+            }
+        }
+    }
+}
+
+void JobServer::dispatch(std::unique_ptr<Connection> connection, std::vector<std::unique_ptr<Connection>>& idle) {
+    auto request = std::make_unique<Request>();
+    try {
+        if (!connection->take_request(*request)) {
+            if (!connection->closed()) {
+                idle.push_back(std::move(connection)); // more bytes to come
+            }
+            return; // a client that closed mid-request is dropped
+        }
+    } catch (const std::exception& e) {
+        connection->try_write(error_response(e.what())); // protocol errors end the connection
+        return;
+    }
+    Connection* raw_connection = connection.release();
+    Request* raw_request = request.release();
+    pool_.submit([this, raw_connection, raw_request] { serve(raw_connection, raw_request); });
+}
+
+void JobServer::serve(Connection* connection, Request* request) {
+    std::unique_ptr<Connection> owned(connection);
+    std::unique_ptr<Request> owned_request(request);
+    try {
+        run_job(*owned, *owned_request);
+    } catch (const std::exception&) {
+        return; // the client stopped reading
+    }
+    {
+        std::lock_guard<std::mutex> lock(served_mutex_);
+        served_.push_back(std::move(owned));
+    }
+    wake();
+}
+
+void JobServer::run_job(Connection& connection, Request& request) {
+    std::shared_ptr<const ProgramImage> image;
+    try {
+        image = cache_.get(request.kind, request.program);
+    } catch (const std::exception& e) {
+        connection.write(error_response(e.what()));
+        return;
+    }
+    
+    auto session = acquire_session(std::move(image));
+    session->provide_input(request.input);
+    session->close_input(); // all input arrives with the request
+    
+    // every job has a budget, so none can keep its worker for good
+    uint64_t max_steps = request.max_steps == 0 ? default_steps_ : std::min(request.max_steps, step_limit_);
+    SessionState state = SessionState::READY;
+    while (state == SessionState::READY && session->instructions() < max_steps && !stopping_.load()) {
+        state = session->resume(std::min(SLICE, max_steps - session->instructions()));
+        std::string output = session->take_output();
+        if (!output.empty()) {
+            connection.write("output " + std::to_string(output.size()) + "\n" + output);
+        }
+    }
+    
+    if (state == SessionState::HALTED) {
+        connection.write("halted " + std::to_string(session->instructions()) + "\n");
+    } else if (state == SessionState::FAULTED) {
+        connection.write(error_response(session->error()));
+    } else if (session->instructions() < max_steps) {
+        connection.write(error_response("Server stopped"));
+    } else {
+        connection.write("limit " + std::to_string(session->instructions()) + "\n");
+    }
+    release_session(std::move(session));
+}
+
+std::unique_ptr<GuestSession> JobServer::acquire_session(std::shared_ptr<const ProgramImage> image) {
+    std::unique_ptr<GuestSession> session;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        if (!idle_sessions_.empty()) {
+            session = std::move(idle_sessions_.back());
+            idle_sessions_.pop_back();
+        }
+    }
+    if (!session) {
+        return std::make_unique<GuestSession>(std::move(image));
+    }
+    session->reset(std::move(image));
+    return session;
+}
+
+void JobServer::release_session(std::unique_ptr<GuestSession> session) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    if (idle_sessions_.size() < pool_.size()) {
+        idle_sessions_.push_back(std::move(session));
+    }
+}
+
+// client
+JobClient::JobClient(const std::string& socket_path) {
+    sockaddr_un address = socket_address(socket_path);
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+    }
+    if (connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        int error = errno;
+        close(fd_);
+        throw std::runtime_error("Cannot connect to " + socket_path + ": " + std::strerror(error));
+    }
+}
+
+JobClient::~JobClient() {
+    close(fd_);
+}
+
+JobClient::Result JobClient::run(ProgramCache::Kind kind, const std::string& program, const std::string& input,
+                                 uint64_t max_steps, const std::function<void(const std::string&)>& on_output) {
+    send_all(fd_, std::string(kind == ProgramCache::Kind::ASSEMBLY ? "asm" : "bin") + " " +
+                  std::to_string(program.size()) + " " + std::to_string(input.size()) + " " +
+                  std::to_string(max_steps) + "\n" + program + input);
+    Result result{Status::ERROR, 0, "", ""};
+    while (true) {
+        std::istringstream fields(read_line());
+        std::string tag;
+        uint64_t value = 0;
+        fields >> tag >> value;
+        if (tag == "output") {
+            std::string chunk = read_bytes(value);
+            if (on_output) {
+                on_output(chunk);
+            } else {
+                result.output += chunk;
+            }
+        } else if (tag == "error") {
+            result.error = read_bytes(value);
+            return result;
+        } else if (tag == "halted" || tag == "limit") {
+            result.status = tag == "halted" ? Status::HALTED : Status::LIMIT;
+            result.instructions = value;
+            return result;
+        } else {
+            throw std::runtime_error("Bad response: " + tag);
+        }
+    }
+}
+
+std::string JobClient::read_line() {
+    size_t newline;
+    while ((newline = buffer_.find('\n')) == std::string::npos) {
+        if (buffer_.size() > MAX_HEADER) {
+            throw std::runtime_error("Response line too long");
+        }
+        fill();
+    }
+    std::string line = buffer_.substr(0, newline);
+    buffer_.erase(0, newline + 1);
+    return line;
+}
+
+std::string JobClient::read_bytes(size_t size) {
+    while (buffer_.size() < size) {
+        fill();
+    }
+    std::string bytes = buffer_.substr(0, size);
+    buffer_.erase(0, size);
+    return bytes;
+}
+
+void JobClient::fill() {
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+        }
+        if (n == 0) {
+            throw std::runtime_error("Server closed the connection");
+        }
+        buffer_.append(chunk, static_cast<size_t>(n));
+        return;
+    }
+}
+
+} // namespace mips
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "guest_session.h"
+#include "program_cache.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mips {
+
+// protocol of mips-serve, one connection carries any number of jobs in turn:
+//   request:  <asm|bin> <program_bytes> <input_bytes> <max_steps>\n<program><input>
+//   response: any number of "output <n>\n<n bytes>" chunks as the guest runs, then one of
+//             "halted <instructions>\n", "limit <instructions>\n" or "error <n>\n<message>"
+// max_steps 0 asks for the server's default budget, larger requests are cut to its limit
+
+// runs jobs for clients on a Unix domain socket. one thread polls every connection and
+// receives requests without blocking; only a complete request takes a pool worker, so
+// clients that are idle, slow or stuck mid-request never hold one
+class JobServer {
+public:
+    static constexpr uint64_t DEFAULT_STEPS = 100000000;
+    static constexpr uint64_t STEP_LIMIT = 1000000000;
+    static constexpr size_t MAX_PAYLOAD = 64 * 1024 * 1024; // program or input bytes
+    
+    // listens right away, a stale socket file at path is replaced; 0 threads = one per
+    // hardware thread
+    JobServer(const std::string& socket_path, size_t num_threads = 0, size_t cache_size = 256,
+              uint64_t default_steps = DEFAULT_STEPS, uint64_t step_limit = STEP_LIMIT);
+    ~JobServer();
+    
+    JobServer(const JobServer&) = delete;
+    JobServer& operator=(const JobServer&) = delete;
+    
+    // serves until stop(), throws if polling the sockets fails
+    void run();
+    void stop(); // any thread, running jobs end with an error response
+    
+    size_t num_workers() const { return pool_.size(); }
+    ProgramCache& cache() { return cache_; }
+
+private:
+    class Connection;
+    struct Request;
+    
+    std::string socket_path_;
+    int listen_fd_;
+    int wake_fds_[2]; // a byte in the pipe interrupts poll()
+    uint64_t default_steps_;
+    uint64_t step_limit_;
+    std::atomic<bool> stopping_;
+    ProgramCache cache_;
+    
+    // sessions that finished a job, reset and handed to the next one so CPUs and their
+    // trap tables are built once per worker instead of once per job
+    std::mutex sessions_mutex_;
+    std::vector<std::unique_ptr<GuestSession>> idle_sessions_;
+    
+    // connections a worker finished a job on, picked up by the polling thread
+    std::mutex served_mutex_;
+    std::vector<std::unique_ptr<Connection>> served_;
+    
+    ThreadPool pool_; // last, so it drains before the members its jobs use go away
+    
+    void wake();
+    void dispatch(std::unique_ptr<Connection> connection, std::vector<std::unique_ptr<Connection>>& idle);
+    void serve(Connection* connection, Request* request);
+    void run_job(Connection& connection, Request& request);
+    std::unique_ptr<GuestSession> acquire_session(std::shared_ptr<const ProgramImage> image);
+    void release_session(std::unique_ptr<GuestSession> session);
+};
+
+// client side of the protocol, one connection that runs jobs in turn
+class JobClient {
+public:
+    enum class Status { HALTED, LIMIT, ERROR };
+    
+    struct Result {
+        Status status;
+        uint64_t instructions; // 0 for ERROR
+        std::string output;    // empty when an output callback was given
+        std::string error;
+    };
+    
+    explicit JobClient(const std::string& socket_path); // throws if it cannot connect
+    ~JobClient();
+    
+    JobClient(const JobClient&) = delete;
+    JobClient& operator=(const JobClient&) = delete;
+    
+    // on_output sees each output chunk as it arrives; throws if the connection breaks
+    Result run(ProgramCache::Kind kind, const std::string& program, const std::string& input = "",
+               uint64_t max_steps = 0, const std::function<void(const std::string&)>& on_output = nullptr);
+
+private:
+    int fd_;
+    std::string buffer_; // received, not consumed yet
+    
+    std::string read_line();
+    std::string read_bytes(size_t size);
+    void fill(); // waits for more bytes
+};
+
+} // namespace mips
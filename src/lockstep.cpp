@@ -0,0 +1,371 @@
+#include "lockstep.h"
+#include <stdexcept>
+#include <string>
+
+namespace mips {
+
+namespace {
+
+// one guest register across all lanes, lowered to a single ymm op under AVX2
+// and to pairs of xmm ops otherwise
+typedef uint32_t LaneVector __attribute__((vector_size(LockstepBatch::LANES * sizeof(uint32_t))));
+typedef int32_t SignedLaneVector __attribute__((vector_size(LockstepBatch::LANES * sizeof(uint32_t))));
+
+__attribute__((always_inline)) inline uint32_t lane_bits(const SignedLaneVector& condition) {
+    uint32_t bits = 0;
+    for (size_t lane = 0; lane < LockstepBatch::LANES; ++lane) {
+        bits |= (condition[lane] ? 1u : 0u) << lane;
+    }
+    return bits;
+}
+
+inline int32_t branch_offset(uint32_t word) {
+    return static_cast<int32_t>(static_cast<int16_t>(word & 0xFFFF)) << 2;
+}
+
+} // namespace
+
+struct LockstepBatch::LaneRegisters {
+    LaneVector r[MachineState::NUM_REGISTERS];
+    LaneVector hi;
+    LaneVector lo;
+};
+
+namespace {
+
+// runs instructions that need no per-lane work from pc until the budget is used up or
+// the next instruction is a load/store, trap or a branch the lanes disagree on, returns
+// the number executed; the decode mirrors CPU::determine_instruction_info
+__attribute__((always_inline)) inline uint64_t run_vector_block(LaneVector* r, const MachineState& code,
+                                                                uint32_t& pc, uint32_t active, uint64_t budget) {
+    uint64_t steps = 0;
+    while (steps < budget) {
+        uint32_t word = code.load_word(pc);
+        if (word == 0) {
+            pc += 4; // null instruction, same as CPU::run_single_step
+            ++steps;
+            continue;
+        }
+        uint32_t opcode = (word >> 26) & 0x3F;
+        uint32_t rs = (word >> 21) & 0x1F;
+        uint32_t rt = (word >> 16) & 0x1F;
+        uint32_t rd = (word >> 11) & 0x1F;
+        uint32_t shamt = (word >> 6) & 0x1F;
+        uint32_t uimm = word & 0xFFFF;
+        uint32_t simm = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(uimm)));
+        LaneVector result;
+        uint32_t target = rd;
+        
+        if (opcode == 0) {
+            SignedLaneVector srs = (SignedLaneVector)r[rs];
+            SignedLaneVector srt = (SignedLaneVector)r[rt];
+            switch (word & 0x3F) {
+                case 0b000000: result = r[rt] << shamt; break; // sll
+                case 0b000010: result = r[rt] >> shamt; break; // srl
+                case 0b000011: result = (LaneVector)(srt >> (int32_t)shamt); break; // sra
+                case 0b000100: result = r[rt] << (r[rs] & 31); break; // sllv
+                case 0b000110: result = r[rt] >> (r[rs] & 31); break; // srlv
+                case 0b000111: result = (LaneVector)(srt >> (SignedLaneVector)(r[rs] & 31)); break; // srav
+                case 0b100000: // add
+                case 0b100001: result = r[rs] + r[rt]; break; // addu
+                case 0b100010: // sub
+                case 0b100011: result = r[rs] - r[rt]; break; // subu
+                case 0b100100: result = r[rs] & r[rt]; break; // and
+                case 0b100101: result = r[rs] | r[rt]; break; // or
+                case 0b100110: result = r[rs] ^ r[rt]; break; // xor
+                case 0b100111: result = ~(r[rs] | r[rt]); break; // nor
+                case 0b101010: result = (LaneVector)(srs < srt) & 1; break; // slt
+                case 0b101011: result = (LaneVector)(r[rs] < r[rt]) & 1; break; // sltu
+                default: return steps; // hi/lo, jumps through registers, sync
+            }
+        } else {
+            target = rt;
+            switch (opcode) {
+                case 0b000010: // j
+                    pc = (word & 0x3FFFFFF) << 2;
+                    ++steps;
+                    continue;
+                case 0b000011: // jal
+                    r[31] = LaneVector{} + (pc + 4);
+                    pc = (word & 0x3FFFFFF) << 2;
+                    ++steps;
+                    continue;
+                case 0b000100: // beq
+                case 0b000101: // bne
+                case 0b000110: // blez
+                case 0b000111: { // bgtz
+                    SignedLaneVector taken;
+                    if (opcode == 0b000100) taken = (SignedLaneVector)(r[rs] == r[rt]);
+                    else if (opcode == 0b000101) taken = (SignedLaneVector)(r[rs] != r[rt]);
+                    else if (opcode == 0b000110) taken = (SignedLaneVector)r[rs] <= 0;
+                    else taken = (SignedLaneVector)r[rs] > 0;
+                    uint32_t bits = lane_bits(taken) & active;
+                    if (bits != 0 && bits != active) {
+                        return steps; // lanes disagree
+                    }
+                    pc += 4 + (bits ? branch_offset(word) : 0);
+                    ++steps;
+                    continue;
+                }
+                case 0b001000: // addi
+                case 0b001001: result = r[rs] + simm; break; // addiu
+                case 0b001010: result = (LaneVector)((SignedLaneVector)r[rs] < (int32_t)simm) & 1; break; // slti
+                case 0b001011: result = (LaneVector)(r[rs] < simm) & 1; break; // sltiu
+                case 0b001100: result = r[rs] & uimm; break; // andi
+                case 0b001101: result = r[rs] | uimm; break; // ori
+                case 0b001110: result = r[rs] ^ uimm; break; // xori
+                case 0b011000: result = (r[rt] & 0xFFFF0000u) | uimm; break; // llo
+                case 0b011001: result = (r[rt] & 0x0000FFFFu) | (uimm << 16); break; // lhi
+                default: return steps; // memory, traps
+            }
+        }
+        if (target != 0) {
+            r[target] = result;
+        }
+        pc += 4;
+        ++steps;
+    }
+    return steps;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+uint64_t run_vector_block_avx2(LaneVector* r, const MachineState& code, uint32_t& pc, uint32_t active, uint64_t budget) {
+    return run_vector_block(r, code, pc, active, budget);
+}
+#endif
+
+uint64_t run_vector_block_baseline(LaneVector* r, const MachineState& code, uint32_t& pc, uint32_t active, uint64_t budget) {
+    return run_vector_block(r, code, pc, active, budget);
+}
+
+} // namespace
+
+bool LockstepBatch::host_has_avx2() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+LockstepBatch::LockstepBatch(const std::vector<CPU*>& cpus, LockstepIsa isa)
+    : regs_(std::make_unique<LaneRegisters>()), pc_(0), active_mask_(0), group_steps_(0), isa_(isa) {
+    if (cpus.empty() || cpus.size() > LANES) {
+        throw std::invalid_argument("Lockstep batch takes 1 to " + std::to_string(LANES) + " CPUs");
+    }
+    if (isa_ == LockstepIsa::AUTO) {
+        isa_ = host_has_avx2() ? LockstepIsa::AVX2 : LockstepIsa::BASELINE;
+    } else if (isa_ == LockstepIsa::AVX2 && !host_has_avx2()) {
+        throw std::invalid_argument("AVX2 is not available on this host");
+    }
+    
+    pc_ = cpus[0]->get_state().get_pc();
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        if (cpus[i]->get_state().get_pc() != pc_ || cpus[i]->is_halted()) {
+            throw std::invalid_argument("Lockstep lanes must start running at the same PC");
+        }
+        LockstepLane lane;
+        lane.cpu = cpus[i];
+        lanes_.push_back(lane);
+        active_mask_ |= 1u << i;
+        reload(i);
+    }
+}
+
+LockstepBatch::~LockstepBatch() = default;
+
+void LockstepBatch::run(uint64_t max_steps) {
+    while (active_mask_ != 0) {
+        uint64_t budget = max_steps == 0 ? UINT64_MAX : max_steps - group_steps_;
+        if (budget == 0) {
+            break;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa_ == LockstepIsa::AVX2) {
+            group_steps_ += run_vector_block_avx2(regs_->r, leader(), pc_, active_mask_, budget);
+        } else
+#endif
+        {
+            group_steps_ += run_vector_block_baseline(regs_->r, leader(), pc_, active_mask_, budget);
+        }
+        if (max_steps == 0 || group_steps_ < max_steps) {
+            step_lanes();
+        }
+    }
+    
+    // lanes still in the group ran out of steps
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if (lanes_[i].active) {
+            spill(i, pc_);
+            retire(i);
+        }
+    }
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if (lanes_[i].diverged) {
+            finish_scalar(i, max_steps);
+        }
+    }
+}
+
+const MachineState& LockstepBatch::leader() const {
+    return lanes_[__builtin_ctz(active_mask_)].cpu->get_state();
+}
+
+// one instruction the vector block stopped at, executed lane by lane
+void LockstepBatch::step_lanes() {
+    uint32_t word = leader().load_word(pc_);
+    uint32_t opcode = (word >> 26) & 0x3F;
+    uint32_t function = word & 0x3F;
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint32_t rd = (word >> 11) & 0x1F;
+    uint32_t simm = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(word & 0xFFFF)));
+    LaneVector* r = regs_->r;
+    
+    uint32_t next_pc[LANES];
+    uint32_t halted = 0;
+    uint32_t faulted = 0;
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if (!(active_mask_ & (1u << i))) continue;
+        MachineState& state = lanes_[i].cpu->get_state();
+        uint32_t address = r[rs][i] + simm;
+        next_pc[i] = pc_ + 4;
+        try {
+            switch (opcode == 0 ? 0x40 | function : opcode) {
+                case 0b100000: if (rt) r[rt][i] = static_cast<uint32_t>(static_cast<int8_t>(state.load_byte(address))); break; // lb
+                case 0b100001: if (rt) r[rt][i] = static_cast<uint32_t>(static_cast<int16_t>(state.load_half(address))); break; // lh
+                case 0b100011: if (rt) r[rt][i] = state.load_word(address); break; // lw
+                case 0b100100: if (rt) r[rt][i] = state.load_byte(address); break; // lbu
+                case 0b100101: if (rt) r[rt][i] = state.load_half(address); break; // lhu
+                case 0b101000: state.store_byte(address, static_cast<uint8_t>(r[rt][i])); break; // sb
+                case 0b101001: state.store_half(address, static_cast<uint16_t>(r[rt][i])); break; // sh
+                case 0b101011: state.store_word(address, r[rt][i]); break; // sw
+                case 0b000100: // beq
+                case 0b000101: // bne
+                case 0b000110: // blez
+                case 0b000111: { // bgtz
+                    int32_t value = static_cast<int32_t>(r[rs][i]);
+                    bool taken = opcode == 0b000100 ? r[rs][i] == r[rt][i] :
+                                 opcode == 0b000101 ? r[rs][i] != r[rt][i] :
+                                 opcode == 0b000110 ? value <= 0 : value > 0;
+                    if (taken) next_pc[i] += branch_offset(word);
+                    break;
+                }
+                case 0x40 | 0b001000: next_pc[i] = r[rs][i]; break; // jr
+                case 0x40 | 0b001001: // jalr
+                    next_pc[i] = r[rs][i];
+                    r[31][i] = pc_ + 4;
+                    break;
+                case 0x40 | 0b010000: if (rd) r[rd][i] = regs_->hi[i]; break; // mfhi
+                case 0x40 | 0b010010: if (rd) r[rd][i] = regs_->lo[i]; break; // mflo
+                case 0x40 | 0b010001: regs_->hi[i] = r[rs][i]; break; // mthi
+                case 0x40 | 0b010011: regs_->lo[i] = r[rs][i]; break; // mtlo
+                case 0x40 | 0b011000: { // mult
+                    int64_t product = static_cast<int64_t>(static_cast<int32_t>(r[rs][i])) *
+                                      static_cast<int64_t>(static_cast<int32_t>(r[rt][i]));
+                    regs_->lo[i] = static_cast<uint32_t>(product);
+                    regs_->hi[i] = static_cast<uint32_t>(static_cast<uint64_t>(product) >> 32);
+                    break;
+                }
+                case 0x40 | 0b011001: { // multu
+                    uint64_t product = static_cast<uint64_t>(r[rs][i]) * r[rt][i];
+                    regs_->lo[i] = static_cast<uint32_t>(product);
+                    regs_->hi[i] = static_cast<uint32_t>(product >> 32);
+                    break;
+                }
+                default: {
+                    // traps, div, ll/sc and anything unusual go through the lane's own CPU
+                    CPU& cpu = *lanes_[i].cpu;
+                    spill(i, pc_);
+                    cpu.run_single_step();
+                    reload(i);
+                    next_pc[i] = state.get_pc();
+                    if (cpu.is_halted()) halted |= 1u << i;
+                    break;
+                }
+            }
+        } catch (const std::exception& e) {
+            lanes_[i].error = e.what();
+            faulted |= 1u << i;
+        }
+    }
+    
+    // a faulting instruction does not count, like the scalar step loops
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if (faulted & (1u << i)) {
+            spill(i, pc_);
+            retire(i);
+        }
+    }
+    group_steps_++;
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if (halted & (1u << i)) retire(i);
+    }
+    regroup(next_pc);
+}
+
+// keeps the PC most active lanes agree on, the rest continue on the scalar path
+void LockstepBatch::regroup(const uint32_t* next_pc) {
+    if (active_mask_ == 0) return;
+    size_t best = LANES;
+    int best_count = 0;
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if (!(active_mask_ & (1u << i))) continue;
+        int count = 0;
+        for (size_t j = 0; j < lanes_.size(); ++j) {
+            count += (active_mask_ & (1u << j)) && next_pc[j] == next_pc[i];
+        }
+        if (count > best_count) {
+            best = i;
+            best_count = count;
+        }
+    }
+    pc_ = next_pc[best];
+    for (size_t i = 0; i < lanes_.size(); ++i) {
+        if ((active_mask_ & (1u << i)) && next_pc[i] != pc_) {
+            spill(i, next_pc[i]);
+            retire(i);
+            lanes_[i].diverged = true;
+        }
+    }
+}
+
+void LockstepBatch::spill(size_t lane, uint32_t pc) {
+    MachineState& state = lanes_[lane].cpu->get_state();
+    for (size_t reg = 1; reg < MachineState::NUM_REGISTERS; ++reg) {
+        state.set_register(static_cast<Register>(reg), regs_->r[reg][lane]);
+    }
+    state.set_hi(regs_->hi[lane]);
+    state.set_lo(regs_->lo[lane]);
+    state.set_pc(pc);
+}
+
+void LockstepBatch::reload(size_t lane) {
+    const MachineState& state = lanes_[lane].cpu->get_state();
+    for (size_t reg = 0; reg < MachineState::NUM_REGISTERS; ++reg) {
+        regs_->r[reg][lane] = state.get_register(static_cast<Register>(reg));
+    }
+    regs_->hi[lane] = state.get_hi();
+    regs_->lo[lane] = state.get_lo();
+}
+
+void LockstepBatch::retire(size_t lane) {
+    lanes_[lane].active = false;
+    lanes_[lane].instructions = group_steps_;
+    active_mask_ &= ~(1u << lane);
+}
+
+void LockstepBatch::finish_scalar(size_t lane, uint64_t max_steps) {
+    LockstepLane& state = lanes_[lane];
+    if (max_steps > 0 && state.instructions >= max_steps) return;
+    
+    uint64_t start = state.cpu->instruction_count();
+    StopReason reason = state.cpu->run(max_steps > 0 ? max_steps - state.instructions : 0);
+    state.instructions += state.cpu->instruction_count() - start;
+    if (reason == StopReason::FAULT) {
+        state.error = state.cpu->fault_message();
+    }
+}
+
+} // namespace mips
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "mips_core.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mips {
+
+// vector instruction set used for the lockstep lanes
+enum class LockstepIsa {
+    AUTO,       // AVX2 when the host has it
+    AVX2,       // one 256-bit op per instruction
+    BASELINE    // what the target always has (two SSE2 ops on x86-64)
+};
+
+struct LockstepLane {
+    CPU* cpu = nullptr;
+    uint64_t instructions = 0;
+    bool active = true;      // still executing in the lockstep group
+    bool diverged = false;   // split off to the scalar path
+    std::string error;       // set if the lane faulted
+};
+
+// runs up to LANES instances of the same program together: registers live in a
+// structure-of-arrays and, while the lanes share a PC, every ALU instruction is one
+// vector op across all of them. memory stays in each lane's own CPU, loads, stores and
+// traps are done lane by lane; a lane whose next PC differs from the group's is split
+// off and finished on its CPU
+class LockstepBatch {
+public:
+    static constexpr size_t LANES = 8;
+    
+    // every cpu must have its program loaded and stand at the same PC
+    explicit LockstepBatch(const std::vector<CPU*>& cpus, LockstepIsa isa = LockstepIsa::AUTO);
+    ~LockstepBatch();
+    
+    LockstepBatch(const LockstepBatch&) = delete;
+    LockstepBatch& operator=(const LockstepBatch&) = delete;
+    
+    // runs every lane until it halts, faults or has executed max_steps (0 = no limit);
+    // the lanes' CPUs hold the final register state afterwards
+    void run(uint64_t max_steps = 0);
+    
+    const LockstepLane& lane(size_t index) const { return lanes_[index]; }
+    size_t num_lanes() const { return lanes_.size(); }
+    LockstepIsa isa() const { return isa_; }
+    uint64_t lockstep_instructions() const { return group_steps_; } // executed by the group as a whole
+    
+    static bool host_has_avx2();
+
+private:
+    struct LaneRegisters;
+    
+    std::vector<LockstepLane> lanes_;
+    std::unique_ptr<LaneRegisters> regs_;
+    uint32_t pc_;
+    uint32_t active_mask_;
+    uint64_t group_steps_;
+    LockstepIsa isa_;
+    
+    const MachineState& leader() const; // code is fetched from the first active lane
+    void step_lanes();
+    void regroup(const uint32_t* next_pc);
+    void spill(size_t lane, uint32_t pc);
+    void reload(size_t lane);
+    void retire(size_t lane);
+    void finish_scalar(size_t lane, uint64_t max_steps);
+};
+
+} // namespace mips
@@ -52,16 +52,14 @@ main:
                   << cpu.get_state().load_word(0) << std::dec << std::endl;
         
         // run with step limit to avoid infinite loop
-        int step_count = 0;
-        const int MAX_STEPS = 1000;
-        
-        while (!cpu.is_halted() && step_count < MAX_STEPS) {
-            cpu.run_single_step();
-            step_count++;
-        }
+        const uint64_t MAX_STEPS = 1000;
+        mips::StopReason reason = cpu.run(MAX_STEPS);
         
         // debug
-        if (step_count >= MAX_STEPS) {
+        if (reason == mips::StopReason::FAULT) {
+            throw std::runtime_error(cpu.fault_message());
+        }
+        if (reason == mips::StopReason::BUDGET_EXHAUSTED) {
             std::cout << "\nProgram stopped after " << MAX_STEPS << " steps (possible infinite loop)" << std::endl;
         }
         
@@ -1,14 +1,143 @@
 #include "assembler.h"
+#include "thread_pool.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// one input/output pair of a multi-file run
+struct Job {
+    std::string input_file;
+    std::string output_file;
+    
+    // results
+    std::vector<std::string> errors;
+};
+
+// every job has its own assembler, only the instruction tables are shared
+void run_job(Job& job) {
+    try {
+        std::ifstream input(job.input_file);
+        if (!input) {
+            throw std::runtime_error("Cannot open input file: " + job.input_file);
+        }
+        mips::Assembler assembler;
+        auto binary_data = assembler.assemble_sparse(input);
+        if (assembler.has_errors()) {
+            job.errors = assembler.get_errors();
+            return;
+        }
+        mips::BinaryFormat::write_binary_file(binary_data, job.output_file, assembler.get_main_address());
+    } catch (const std::exception& e) {
+        job.errors.push_back(e.what());
+    }
+}
+
+// every top-level .asm file of input_dir, sorted, written as .bin into output_dir
+std::vector<Job> directory_jobs(const std::string& input_dir, const std::string& output_dir) {
+    namespace fs = std::filesystem;
+    std::vector<Job> jobs;
+    for (const auto& entry : fs::directory_iterator(input_dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".asm") {
+            Job job;
+            job.input_file = entry.path().string();
+            job.output_file = (fs::path(output_dir) / entry.path().stem()).string() + ".bin";
+            jobs.push_back(job);
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.input_file < b.input_file; });
+    fs::create_directories(output_dir);
+    return jobs;
+}
+
+// runs all jobs on the pool, then reports in job order whatever order they finished in
+int run_jobs(std::vector<Job>& jobs, size_t num_threads) {
+    {
+        mips::ThreadPool pool(num_threads);
+        for (Job& job : jobs) {
+            pool.submit([&job] { run_job(job); });
+        }
+        pool.wait_idle();
+    }
+    
+    size_t failed = 0;
+    for (const Job& job : jobs) {
+        for (const auto& error : job.errors) {
+            std::cerr << job.input_file << ": Error: " << error << std::endl;
+        }
+        failed += job.errors.empty() ? 0 : 1;
+    }
+    std::cout << "Assembled " << jobs.size() - failed << " of " << jobs.size() << " files" << std::endl;
+    return failed > 0 ? 1 : 0;
+}
+
+} // namespace
 
 int main(int argc, char* argv[]) {
     mips::Assembler assembler;
     
+    // --threads <n> anywhere: one source is assembled in parallel chunks, several files
+    // are assembled side by side; the other arguments keep their order
+    const char* program_name = argv[0];
+    size_t num_threads = 0;
+    bool parallel = false;
+    std::vector<char*> arguments{argv[0]};
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--threads") {
+            arguments.push_back(argv[i]);
+            continue;
+        }
+        char* end = nullptr;
+        if (i + 1 < argc) {
+            num_threads = std::strtoul(argv[++i], &end, 10);
+        }
+        if (!end || *end != '\0' || end == argv[i]) {
+            std::cerr << "Error: --threads needs a thread count (0 = all)" << std::endl;
+            return 1;
+        }
+        parallel = true;
+    }
+    argc = static_cast<int>(arguments.size());
+    argv = arguments.data();
+    auto assemble = [&](std::istream& input) {
+        if (!parallel) {
+            return assembler.assemble_sparse(input); // single pass, source not kept
+        }
+        std::ostringstream text;
+        text << input.rdbuf();
+        mips::ThreadPool pool(num_threads);
+        mips::SparseBinary binary; // the chunks are encoded in place, .space stays dense
+        binary.data = assembler.assemble_parallel(text.str(), pool);
+        binary.size = static_cast<uint32_t>(binary.data.size());
+        return binary;
+    };
+    
     try {
-        if (argc == 1) {
+        if ((argc == 2 || argc == 3) && std::filesystem::is_directory(argv[1])) {
+            // every .asm file of a directory, next to the sources or into an output directory
+            auto jobs = directory_jobs(argv[1], argc == 3 ? argv[2] : argv[1]);
+            return run_jobs(jobs, num_threads);
+        }
+        else if (argc > 3 && argc % 2 == 1) {
+            // input/output pairs
+            std::vector<Job> jobs;
+            for (int i = 1; i < argc; i += 2) {
+                Job job;
+                job.input_file = argv[i];
+                job.output_file = argv[i + 1];
+                jobs.push_back(job);
+            }
+            return run_jobs(jobs, num_threads);
+        }
+        else if (argc == 1) {
             // read from stdin, write to stdout
-            auto binary_data = assembler.assemble_stream(std::cin);
+            auto binary_data = assemble(std::cin);
             if (assembler.has_errors()) {
                 for (const auto& error : assembler.get_errors()) {
                     std::cerr << "Error: " << error << std::endl;
@@ -25,7 +154,7 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
-            auto binary_data = assembler.assemble_stream(input);
+            auto binary_data = assemble(input);
             if (assembler.has_errors()) {
                 for (const auto& error : assembler.get_errors()) {
                     std::cerr << "Error: " << error << std::endl;
@@ -42,7 +171,7 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
-            auto binary_data = assembler.assemble_stream(input);
+            auto binary_data = assemble(input);
             if (assembler.has_errors()) {
                 for (const auto& error : assembler.get_errors()) {
                     std::cerr << "Error: " << error << std::endl;
@@ -55,9 +184,12 @@ int main(int argc, char* argv[]) {
         }
         else {
             std::cerr << "Usage:" << std::endl;
-            std::cerr << "  " << argv[0] << "                    # Read from stdin, write to stdout" << std::endl;
-            std::cerr << "  " << argv[0] << " input.asm         # Read from file, write to stdout" << std::endl;
-            std::cerr << "  " << argv[0] << " input.asm output.bin # Read from file, write to file" << std::endl;
+            std::cerr << "  " << program_name << "                    # Read from stdin, write to stdout" << std::endl;
+            std::cerr << "  " << program_name << " input.asm         # Read from file, write to stdout" << std::endl;
+            std::cerr << "  " << program_name << " input.asm output.bin # Read from file, write to file" << std::endl;
+            std::cerr << "  " << program_name << " a.asm a.bin b.asm b.bin ... # Assemble several files side by side" << std::endl;
+            std::cerr << "  " << program_name << " dir [out_dir]     # Assemble every .asm file of dir into .bin files" << std::endl;
+            std::cerr << "  " << program_name << " ... --threads <n> ...  # Use n threads (0 = all), anywhere in the arguments" << std::endl;
             return 1;
         }
     }
@@ -0,0 +1,253 @@
+#include "mips_core.h"
+#include "assembler.h"
+#include "thread_pool.h"
+#include "lockstep.h"
+#include "program_image.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdlib>
+
+namespace {
+
+// one manifest line: <binary> <input|-> <output|-> <max_steps>
+struct Job {
+    std::string binary_file;
+    std::string input_file;
+    std::string output_file;
+    uint64_t max_steps; // 0 = no limit
+    std::shared_ptr<const mips::ProgramImage> binary; // shared read-only by every job that runs it
+    
+    // results
+    std::string status;
+    uint64_t instructions = 0;
+    double milliseconds = 0;
+};
+
+std::vector<Job> read_manifest(const std::string& filename) {
+    std::ifstream manifest(filename);
+    if (!manifest) {
+        throw std::runtime_error("Cannot open manifest: " + filename);
+    }
+    
+    std::vector<Job> jobs;
+    std::string line;
+    uint32_t line_number = 0;
+    while (std::getline(manifest, line)) {
+        line_number++;
+        std::istringstream fields(line);
+        Job job;
+        if (!(fields >> job.binary_file) || job.binary_file[0] == '#') {
+            continue; // blank line or comment
+        }
+        if (!(fields >> job.input_file >> job.output_file >> job.max_steps)) {
+            throw std::runtime_error("Manifest line " + std::to_string(line_number) +
+                                     ": expected <binary> <input|-> <output|-> <max_steps>");
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// streams and CPU of one running job
+struct JobContext {
+    std::istringstream input;
+    std::ostringstream output;
+    mips::CPU cpu;
+};
+
+// each job gets its own CPU and in-memory streams
+void start_job(const Job& job, JobContext& context) {
+    if (job.input_file != "-") {
+        std::ifstream file(job.input_file, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open input file: " + job.input_file);
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        context.input.str(contents.str());
+    }
+    
+    mips::CPU& cpu = context.cpu;
+    cpu.get_state().input_stream = &context.input;
+    cpu.get_state().output_stream = &context.output;
+    cpu.get_state().map_image(job.binary);
+    cpu.get_state().set_pc(job.binary->main_address());
+    cpu.get_state().set_register(mips::Register::SP, 0xFFFFFFFC);
+}
+
+void finish_job(const Job& job, const JobContext& context) {
+    if (job.output_file != "-") {
+        std::ofstream file(job.output_file, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open output file: " + job.output_file);
+        }
+        const std::string& text = context.output.str();
+        file.write(text.data(), text.size());
+    }
+}
+
+void run_job(Job& job) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        JobContext context;
+        start_job(job, context);
+        
+        mips::CPU& cpu = context.cpu;
+        mips::StopReason reason = cpu.run(job.max_steps);
+        job.instructions = cpu.instruction_count();
+        if (reason == mips::StopReason::FAULT) {
+            throw std::runtime_error(cpu.fault_message());
+        }
+        job.status = reason == mips::StopReason::HALTED ? "halted" : "step limit";
+        finish_job(job, context);
+    } catch (const std::exception& e) {
+        job.status = std::string("error: ") + e.what();
+    }
+    auto end = std::chrono::steady_clock::now();
+    job.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// jobs with the same binary and step limit, run as one lockstep batch; every job
+// reports the time of the whole group
+void run_lockstep_group(const std::vector<Job*>& group) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<JobContext>> contexts;
+    std::vector<Job*> started;
+    std::vector<mips::CPU*> cpus;
+    for (Job* job : group) {
+        auto context = std::make_unique<JobContext>();
+        try {
+            start_job(*job, *context);
+        } catch (const std::exception& e) {
+            job->status = std::string("error: ") + e.what();
+            continue;
+        }
+        cpus.push_back(&context->cpu);
+        started.push_back(job);
+        contexts.push_back(std::move(context));
+    }
+    
+    if (!cpus.empty()) {
+        mips::LockstepBatch batch(cpus);
+        batch.run(started[0]->max_steps);
+        for (size_t i = 0; i < started.size(); ++i) {
+            Job& job = *started[i];
+            const mips::LockstepLane& lane = batch.lane(i);
+            job.instructions = lane.instructions;
+            try {
+                if (!lane.error.empty()) {
+                    throw std::runtime_error(lane.error);
+                }
+                job.status = lane.cpu->is_halted() ? "halted" : "step limit";
+                finish_job(job, *contexts[i]);
+            } catch (const std::exception& e) {
+                job.status = std::string("error: ") + e.what();
+            }
+        }
+    }
+    
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (Job* job : group) {
+        job->milliseconds = milliseconds;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // options
+    size_t num_threads = 0;
+    bool lockstep = false;
+    const char* manifest_file = nullptr;
+    bool usage_error = false;
+    for (int i = 1; i < argc && !usage_error; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            char* end = nullptr;
+            num_threads = std::strtoul(argv[++i], &end, 10);
+            usage_error = (*end != '\0');
+        } else if (arg == "--lockstep") {
+            lockstep = true;
+        } else if (!manifest_file && arg.rfind("--", 0) != 0) {
+            manifest_file = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || !manifest_file) {
+        std::cerr << "Usage: " << argv[0] << " [--threads <n>] [--lockstep] <manifest>" << std::endl;
+        std::cerr << "Manifest lines: <binary> <input|-> <output|-> <max_steps>" << std::endl;
+        return 1;
+    }
+    
+    try {
+        std::vector<Job> jobs = read_manifest(manifest_file);
+        
+        // load every distinct binary once
+        std::unordered_map<std::string, std::shared_ptr<const mips::ProgramImage>> binaries;
+        for (auto& job : jobs) {
+            auto& binary = binaries[job.binary_file];
+            if (!binary) {
+                binary = mips::ProgramImage::load_file(job.binary_file);
+            }
+            job.binary = binary;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<Job*>> groups;
+        {
+            mips::ThreadPool pool(num_threads);
+            if (lockstep) {
+                // jobs sharing a binary and step limit run LANES at a time in lockstep
+                std::unordered_map<std::string, size_t> open_groups;
+                for (auto& job : jobs) {
+                    std::string key = job.binary_file + '\n' + std::to_string(job.max_steps);
+                    auto it = open_groups.find(key);
+                    if (it == open_groups.end() || groups[it->second].size() == mips::LockstepBatch::LANES) {
+                        it = open_groups.insert_or_assign(key, groups.size()).first;
+                        groups.emplace_back();
+                    }
+                    groups[it->second].push_back(&job);
+                }
+                for (auto& group : groups) {
+                    pool.submit([&group] { run_lockstep_group(group); });
+                }
+            } else {
+                for (auto& job : jobs) {
+                    pool.submit([&job] { run_job(job); });
+                }
+            }
+            pool.wait_idle();
+            num_threads = pool.size();
+        }
+        auto end = std::chrono::steady_clock::now();
+        
+        // report in manifest order
+        uint64_t total_instructions = 0;
+        int failed = 0;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            const Job& job = jobs[i];
+            std::cout << "job " << i << ": " << job.binary_file << " [" << job.status << "] "
+                      << job.instructions << " instructions, " << std::fixed << std::setprecision(3)
+                      << job.milliseconds << " ms" << std::endl;
+            total_instructions += job.instructions;
+            if (job.status.rfind("error", 0) == 0) failed++;
+        }
+        double total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cout << jobs.size() << " jobs on " << num_threads << " threads in " << total_ms << " ms, "
+                  << total_instructions << " instructions ("
+                  << (total_ms > 0 ? total_instructions / total_ms / 1000.0 : 0.0) << " MIPS)" << std::endl;
+        
+        return failed > 0 ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
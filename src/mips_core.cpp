@@ -1,17 +1,89 @@
 #include "mips_core.h"
+#include "program_image.h"
+#include "snapshot.h"
 #include <stdexcept>
 #include <cstring>
 #include <algorithm>
 
 namespace mips {
 
+namespace {
+
+// guest memory is little-endian, word and half accesses go through these on the host
+inline uint32_t to_guest_order(uint32_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+inline uint16_t to_guest_order(uint16_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap16(value);
+#else
+    return value;
+#endif
+}
+
+} // namespace
+
+struct MachineState::AddressSpace {
+    PageTable pages;
+    GuestHeap heap;
+    std::mutex heap_mutex;
+    std::mutex input_mutex;
+    std::mutex output_mutex; // output streams and the console buffer
+    std::unique_ptr<AsyncOutput> async_output;
+    std::string console_buffer;
+    uint32_t console_page = 0;
+    bool console_mapped = false;
+    std::unique_ptr<SharedWindow> shared_window;
+    std::shared_ptr<const ProgramImage> image; // read-only pages below the page table
+};
+
 // machinestate implementation
 MachineState::MachineState() 
-    : pc_(0), hi_(0), lo_(0) {
+    : pc_(0), hi_(0), lo_(0), memory_(std::make_shared<AddressSpace>()) {
     registers_.fill(0); // initialize all 32 registers to 0
     
 }
 
+MachineState MachineState::share_address_space() const {
+    MachineState hart;
+    hart.memory_ = memory_;
+    hart.input_stream = input_stream;
+    hart.output_stream = output_stream;
+    return hart;
+}
+
+MachineState MachineState::clone() const {
+    MachineState copy;
+    copy.registers_ = registers_;
+    copy.pc_ = pc_;
+    copy.hi_ = hi_;
+    copy.lo_ = lo_;
+    copy.input_stream = input_stream;
+    copy.output_stream = output_stream;
+    
+    AddressSpace& memory = *copy.memory_;
+    memory_->pages.for_each([&memory](uint32_t page_index, const Page& page) {
+        memory.pages.find_or_create(page_index, page.data)->flags = page.flags & PAGE_DEVICE;
+    });
+    {
+        std::lock_guard<std::mutex> lock(memory_->heap_mutex);
+        memory.heap = memory_->heap;
+    }
+    {
+        std::lock_guard<std::mutex> lock(memory_->output_mutex);
+        memory.console_buffer = memory_->console_buffer;
+    }
+    memory.console_page = memory_->console_page;
+    memory.console_mapped = memory_->console_mapped;
+    memory.image = memory_->image;
+    return copy;
+}
+
 uint32_t MachineState::get_register(Register reg) const {
     uint8_t index = static_cast<uint8_t>(reg);
     if (index >= NUM_REGISTERS) {
@@ -42,17 +114,25 @@ uint8_t MachineState::load_byte(uint32_t address) const {
     uint32_t page_index = get_page_index(address);
     uint32_t page_offset = get_page_offset(address);
     
-    const auto* page = get_page(page_index);
+    const uint8_t* page = read_page(page_index);
     if (!page) {
         return 0; // uninitialized memory reads as 0
     }
-    return (*page)[page_offset]; // dereffrence pointer and access @ offset 
+    return __atomic_load_n(page + page_offset, __ATOMIC_ACQUIRE); // dereffrence pointer and access @ offset 
 }
 
 uint16_t MachineState::load_half(uint32_t address) const {
     if (static_cast<uint64_t>(address) + 1 >= MEMORY_SIZE) {
         throw std::out_of_range("Memory address out of bounds");
     }
+    if ((address & 1) == 0) { // aligned, never crosses a page
+        const uint8_t* page = read_page(get_page_index(address));
+        if (!page) {
+            return 0;
+        }
+        auto* cell = reinterpret_cast<const uint16_t*>(page + get_page_offset(address));
+        return to_guest_order(__atomic_load_n(cell, __ATOMIC_ACQUIRE));
+    }
     // little-endian
     return static_cast<uint16_t>(load_byte(address)) | 
            (static_cast<uint16_t>(load_byte(address + 1)) << 8);
@@ -62,6 +142,14 @@ uint32_t MachineState::load_word(uint32_t address) const {
     if (static_cast<uint64_t>(address) + 3 >= MEMORY_SIZE) {
         throw std::out_of_range("Memory address out of bounds");
     }
+    if ((address & 3) == 0) { // aligned, never crosses a page
+        const uint8_t* page = read_page(get_page_index(address));
+        if (!page) {
+            return 0;
+        }
+        auto* cell = reinterpret_cast<const uint32_t*>(page + get_page_offset(address));
+        return to_guest_order(__atomic_load_n(cell, __ATOMIC_ACQUIRE));
+    }
     // little-endian
     return static_cast<uint32_t>(load_byte(address)) |
            (static_cast<uint32_t>(load_byte(address + 1)) << 8) |
@@ -76,14 +164,26 @@ void MachineState::store_byte(uint32_t address, uint8_t value) {
     uint32_t page_index = get_page_index(address);
     uint32_t page_offset = get_page_offset(address); // location in page_index
     
-    auto* page = get_or_create_page(page_index); // page pointer to location in unorderd map
-    (*page)[page_offset] = value; // store value at page_offset in page_index
+    auto* page = get_or_create_page(page_index); // page pointer from the page table
+    if (page->flags & PAGE_DEVICE) {
+        device_store(address, value);
+        return;
+    }
+    __atomic_store_n(page->data + page_offset, value, __ATOMIC_RELEASE); // store value at page_offset in page_index
 }
 
 void MachineState::store_half(uint32_t address, uint16_t value) {
     if (static_cast<uint64_t>(address) + 1 >= MEMORY_SIZE) {
         throw std::out_of_range("Memory address out of bounds");
     }
+    if ((address & 1) == 0) {
+        auto* page = get_or_create_page(get_page_index(address));
+        if (!(page->flags & PAGE_DEVICE)) {
+            auto* cell = reinterpret_cast<uint16_t*>(page->data + get_page_offset(address));
+            __atomic_store_n(cell, to_guest_order(value), __ATOMIC_RELEASE);
+            return;
+        }
+    }
     // little-endian
     store_byte(address, static_cast<uint8_t>(value & 0xFF));
     store_byte(address + 1, static_cast<uint8_t>((value >> 8) & 0xFF));
@@ -93,6 +193,14 @@ void MachineState::store_word(uint32_t address, uint32_t value) {
     if (static_cast<uint64_t>(address) + 3 >= MEMORY_SIZE) {
         throw std::out_of_range("Memory address out of bounds");
     }
+    if ((address & 3) == 0) {
+        auto* page = get_or_create_page(get_page_index(address));
+        if (!(page->flags & PAGE_DEVICE)) {
+            auto* cell = reinterpret_cast<uint32_t*>(page->data + get_page_offset(address));
+            __atomic_store_n(cell, to_guest_order(value), __ATOMIC_RELEASE);
+            return;
+        }
+    }
     // little-endian
     store_byte(address, static_cast<uint8_t>(value & 0xFF));
     store_byte(address + 1, static_cast<uint8_t>((value >> 8) & 0xFF));
@@ -100,37 +208,451 @@ void MachineState::store_word(uint32_t address, uint32_t value) {
     store_byte(address + 3, static_cast<uint8_t>((value >> 24) & 0xFF));
 }
 
+bool MachineState::compare_exchange_word(uint32_t address, uint32_t expected, uint32_t desired) {
+    if (address & 3) {
+        throw std::runtime_error("Unaligned atomic access at address " + std::to_string(address));
+    }
+    auto* page = get_or_create_page(get_page_index(address));
+    if (page->flags & PAGE_DEVICE) {
+        throw std::runtime_error("Atomic access to device memory at address " + std::to_string(address));
+    }
+    auto* cell = reinterpret_cast<uint32_t*>(page->data + get_page_offset(address));
+    uint32_t old_value = to_guest_order(expected);
+    return __atomic_compare_exchange_n(cell, &old_value, to_guest_order(desired), false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
 void MachineState::load_memory(const std::vector<uint8_t>& data, uint32_t start_address) {
     if (start_address + data.size() > MEMORY_SIZE) {
         throw std::out_of_range("Data too large for memory");
     }
-    for (size_t i = 0; i < data.size(); ++i) {
-        store_byte(start_address + i, data[i]);
+    write_block(start_address, data.data(), data.size());
+    place_heap_above(start_address + data.size());
+}
+
+// bulk memory helpers, every loop below handles at most one page per iteration
+// and hands the chunk to the host mem* routines (vectorised by libc)
+void MachineState::check_range(uint32_t address, uint64_t size) const {
+    if (static_cast<uint64_t>(address) + size > MEMORY_SIZE) {
+        throw std::out_of_range("Memory range out of bounds");
+    }
+}
+
+void MachineState::read_block(uint32_t address, uint8_t* out, size_t size) const {
+    check_range(address, size);
+    while (size > 0) {
+        uint32_t offset = get_page_offset(address);
+        size_t chunk = std::min<size_t>(size, PAGE_SIZE - offset);
+        const uint8_t* page = read_page(get_page_index(address));
+        if (page) {
+            std::memcpy(out, page + offset, chunk);
+        } else {
+            std::memset(out, 0, chunk);
+        }
+        address += chunk;
+        out += chunk;
+        size -= chunk;
+    }
+}
+
+void MachineState::write_block(uint32_t address, const uint8_t* data, size_t size) {
+    check_range(address, size);
+    while (size > 0) {
+        uint32_t offset = get_page_offset(address);
+        size_t chunk = std::min<size_t>(size, PAGE_SIZE - offset);
+        auto* page = get_or_create_page(get_page_index(address));
+        if (page->flags & PAGE_DEVICE) {
+            for (size_t i = 0; i < chunk; ++i) device_store(address + i, data[i]);
+        } else {
+            std::memcpy(page->data + offset, data, chunk);
+        }
+        address += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void MachineState::copy_memory(uint32_t dest, uint32_t src, uint32_t size) {
+    check_range(dest, size);
+    check_range(src, size);
+    if (size == 0 || dest == src) return;
+    
+    // copy a chunk that does not cross a page on either side
+    auto copy_chunk = [this](uint32_t to, uint32_t from, uint32_t chunk) {
+        const uint8_t* src_page = read_page(get_page_index(from));
+        if (!src_page) {
+            // source is all zeros, only touch the destination if it already exists
+            if (read_page(get_page_index(to))) {
+                fill_memory(to, 0, chunk);
+            }
+            return;
+        }
+        auto* dest_page = get_or_create_page(get_page_index(to));
+        const uint8_t* from_bytes = src_page + get_page_offset(from);
+        if (dest_page->flags & PAGE_DEVICE) {
+            for (uint32_t i = 0; i < chunk; ++i) device_store(to + i, from_bytes[i]);
+        } else {
+            std::memmove(dest_page->data + get_page_offset(to), from_bytes, chunk);
+        }
+    };
+    
+    bool backwards = dest > src && dest < static_cast<uint64_t>(src) + size;
+    if (!backwards) {
+        while (size > 0) {
+            uint32_t chunk = std::min<uint32_t>({size,
+                static_cast<uint32_t>(PAGE_SIZE - get_page_offset(src)),
+                static_cast<uint32_t>(PAGE_SIZE - get_page_offset(dest))});
+            copy_chunk(dest, src, chunk);
+            dest += chunk;
+            src += chunk;
+            size -= chunk;
+        }
+    } else {
+        // overlapping with dest above src: walk from the end
+        uint64_t dest_end = static_cast<uint64_t>(dest) + size;
+        uint64_t src_end = static_cast<uint64_t>(src) + size;
+        while (size > 0) {
+            uint32_t chunk = std::min<uint32_t>({size,
+                static_cast<uint32_t>(get_page_offset(static_cast<uint32_t>(src_end - 1)) + 1),
+                static_cast<uint32_t>(get_page_offset(static_cast<uint32_t>(dest_end - 1)) + 1)});
+            dest_end -= chunk;
+            src_end -= chunk;
+            copy_chunk(static_cast<uint32_t>(dest_end), static_cast<uint32_t>(src_end), chunk);
+            size -= chunk;
+        }
     }
 }
 
-// page management helper methods
-std::array<uint8_t, MachineState::PAGE_SIZE>* MachineState::get_or_create_page(uint32_t page_index) {
-    //returns page pointer
-    auto it = memory_pages_.find(page_index); // from map 
-    if (it != memory_pages_.end()) { // case mem left in page
-        return it->second.get();
+void MachineState::fill_memory(uint32_t dest, uint8_t value, uint32_t size) {
+    check_range(dest, size);
+    while (size > 0) {
+        uint32_t offset = get_page_offset(dest);
+        uint32_t chunk = std::min<uint32_t>(size, PAGE_SIZE - offset);
+        uint32_t page_index = get_page_index(dest);
+        // zero fill of an unallocated page is a no-op
+        auto* page = (value == 0) ? get_writable_page(page_index) : get_or_create_page(page_index);
+        if (page && (page->flags & PAGE_DEVICE)) {
+            for (uint32_t i = 0; i < chunk; ++i) device_store(dest + i, value);
+        } else if (page) {
+            std::memset(page->data + offset, value, chunk);
+        }
+        dest += chunk;
+        size -= chunk;
     }
+}
+
+int MachineState::compare_memory(uint32_t lhs, uint32_t rhs, uint32_t size) const {
+    check_range(lhs, size);
+    check_range(rhs, size);
+    static const std::array<uint8_t, PAGE_SIZE> zero_page{};
     
-    // create new page, initialize 4KB (4096) to zero
-    auto new_page = std::make_unique<std::array<uint8_t, PAGE_SIZE>>();
-    new_page->fill(0);
-    auto* page_ptr = new_page.get();
-    memory_pages_[page_index] = std::move(new_page);
-    return page_ptr;
+    while (size > 0) {
+        uint32_t chunk = std::min<uint32_t>({size,
+            static_cast<uint32_t>(PAGE_SIZE - get_page_offset(lhs)),
+            static_cast<uint32_t>(PAGE_SIZE - get_page_offset(rhs))});
+        const uint8_t* lhs_page = read_page(get_page_index(lhs));
+        const uint8_t* rhs_page = read_page(get_page_index(rhs));
+        const uint8_t* a = lhs_page ? lhs_page + get_page_offset(lhs) : zero_page.data();
+        const uint8_t* b = rhs_page ? rhs_page + get_page_offset(rhs) : zero_page.data();
+        int result = std::memcmp(a, b, chunk);
+        if (result != 0) {
+            return result < 0 ? -1 : 1;
+        }
+        lhs += chunk;
+        rhs += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+uint32_t MachineState::string_length(uint32_t address) const {
+    uint64_t current = address;
+    while (current < MEMORY_SIZE) {
+        uint32_t offset = get_page_offset(static_cast<uint32_t>(current));
+        const uint8_t* page = read_page(get_page_index(static_cast<uint32_t>(current)));
+        if (!page) {
+            return static_cast<uint32_t>(current - address); // unallocated page starts with a 0 byte
+        }
+        const void* hit = std::memchr(page + offset, 0, PAGE_SIZE - offset);
+        if (hit) {
+            return static_cast<uint32_t>(current - address) +
+                   static_cast<uint32_t>(static_cast<const uint8_t*>(hit) - (page + offset));
+        }
+        current += PAGE_SIZE - offset;
+    }
+    throw std::out_of_range("Unterminated string at end of memory");
+}
+
+// guest output
+void MachineState::write_output(const char* data, size_t size) {
+    std::lock_guard<std::mutex> lock(memory_->output_mutex);
+    flush_console(); // keep console and trap output in program order
+    emit_output(data, size);
+}
+
+void MachineState::flush_output() {
+    std::lock_guard<std::mutex> lock(memory_->output_mutex);
+    flush_console();
+    if (memory_->async_output) {
+        memory_->async_output->drain();
+    }
+}
+
+void MachineState::emit_output(const char* data, size_t size) {
+    if (memory_->async_output) {
+        memory_->async_output->write(data, size);
+    } else {
+        output_stream->write(data, size);
+    }
+}
+
+void MachineState::enable_async_output(size_t capacity) {
+    std::lock_guard<std::mutex> lock(memory_->output_mutex);
+    memory_->async_output.reset(); // drain any previous writer first
+    memory_->async_output = std::make_unique<AsyncOutput>(*output_stream, capacity);
+}
+
+void MachineState::disable_async_output() {
+    std::lock_guard<std::mutex> lock(memory_->output_mutex);
+    memory_->async_output.reset();
 }
 
-const std::array<uint8_t, MachineState::PAGE_SIZE>* MachineState::get_page(uint32_t page_index) const {
-    auto it = memory_pages_.find(page_index);
-    if (it != memory_pages_.end()) {
-        return it->second.get();
+bool MachineState::has_async_output() const {
+    return memory_->async_output != nullptr;
+}
+
+std::mutex& MachineState::input_mutex() {
+    return memory_->input_mutex;
+}
+
+GuestHeap& MachineState::heap() {
+    return memory_->heap;
+}
+
+const GuestHeap& MachineState::heap() const {
+    return memory_->heap;
+}
+
+std::mutex& MachineState::heap_mutex() {
+    return memory_->heap_mutex;
+}
+
+void MachineState::place_heap_above(uint64_t program_end) {
+    std::lock_guard<std::mutex> lock(memory_->heap_mutex);
+    GuestHeap& heap = memory_->heap;
+    if (program_end <= heap.get_base()) {
+        return;
+    }
+    uint64_t base = (program_end + PAGE_SIZE - 1) & ~static_cast<uint64_t>(PAGE_SIZE - 1);
+    if (base > heap.get_limit()) {
+        throw std::out_of_range("Program reaches past the heap limit");
+    }
+    if (heap.get_break() != heap.get_base()) {
+        throw std::runtime_error("Program overlaps the guest heap in use");
+    }
+    heap = GuestHeap(static_cast<uint32_t>(base), heap.get_limit());
+}
+
+SharedWindow* MachineState::shared_window() {
+    return memory_->shared_window.get();
+}
+
+// page table, a slot only ever goes from null to its final pointer so readers
+// need nothing stronger than an acquire load
+MachineState::PageTable::PageTable() = default;
+
+MachineState::PageTable::~PageTable() {
+    for (auto& slot : directories_) {
+        Directory* directory = slot.load(std::memory_order_relaxed);
+        if (!directory) continue;
+        for (auto& page : directory->pages) {
+            delete page.load(std::memory_order_relaxed);
+        }
+        delete directory;
+    }
+}
+
+template <typename Visitor>
+void MachineState::PageTable::for_each(Visitor visit) const {
+    for (size_t d = 0; d < LEVEL_SIZE; ++d) {
+        Directory* directory = directories_[d].load(std::memory_order_acquire);
+        if (!directory) continue;
+        for (size_t p = 0; p < LEVEL_SIZE; ++p) {
+            if (Page* page = directory->pages[p].load(std::memory_order_acquire)) {
+                visit(static_cast<uint32_t>(d << LEVEL_BITS | p), *page);
+            }
+        }
     }
-    return nullptr; // Page doesn't exist
+}
+
+MachineState::Page* MachineState::PageTable::find(uint32_t page_index) const {
+    Directory* directory = directories_[page_index >> LEVEL_BITS].load(std::memory_order_acquire);
+    if (!directory) {
+        return nullptr;
+    }
+    return directory->pages[page_index & (LEVEL_SIZE - 1)].load(std::memory_order_acquire);
+}
+
+MachineState::Page* MachineState::PageTable::find_or_create(uint32_t page_index, const uint8_t* initial) {
+    auto& directory_slot = directories_[page_index >> LEVEL_BITS];
+    Directory* directory = directory_slot.load(std::memory_order_acquire);
+    if (!directory) {
+        auto* fresh = new Directory();
+        if (directory_slot.compare_exchange_strong(directory, fresh, std::memory_order_acq_rel)) {
+            directory = fresh;
+        } else {
+            delete fresh; // another hart won, directory now holds its table
+        }
+    }
+    
+    auto& page_slot = directory->pages[page_index & (LEVEL_SIZE - 1)];
+    Page* page = page_slot.load(std::memory_order_acquire);
+    if (!page) {
+        // create new page, initialize 4KB (4096) to zero or to a copy of the image page
+        auto fresh = std::make_unique<Page>();
+        fresh->storage = std::make_unique<uint8_t[]>(PAGE_SIZE); // value-initialised to 0
+        fresh->data = fresh->storage.get();
+        fresh->flags = 0;
+        if (initial) {
+            std::memcpy(fresh->data, initial, PAGE_SIZE);
+        }
+        if (page_slot.compare_exchange_strong(page, fresh.get(), std::memory_order_acq_rel)) {
+            page = fresh.release();
+            size_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return page;
+}
+
+// page management helper methods, pages of a mapped image are read in place
+// and copied into the page table on the first write
+MachineState::Page* MachineState::get_or_create_page(uint32_t page_index) {
+    Page* page = memory_->pages.find(page_index);
+    if (page) {
+        return page;
+    }
+    const ProgramImage* image = memory_->image.get();
+    return memory_->pages.find_or_create(page_index, image ? image->page_data(page_index) : nullptr);
+}
+
+const uint8_t* MachineState::read_page(uint32_t page_index) const {
+    const Page* page = memory_->pages.find(page_index);
+    if (page) {
+        return page->data;
+    }
+    const ProgramImage* image = memory_->image.get();
+    return image ? image->page_data(page_index) : nullptr; // null if the page doesn't exist
+}
+
+MachineState::Page* MachineState::get_writable_page(uint32_t page_index) {
+    Page* page = memory_->pages.find(page_index);
+    if (page) {
+        return page;
+    }
+    const ProgramImage* image = memory_->image.get();
+    if (image && image->page_data(page_index)) {
+        return memory_->pages.find_or_create(page_index, image->page_data(page_index));
+    }
+    return nullptr;
+}
+
+// program images
+void MachineState::map_image(std::shared_ptr<const ProgramImage> image) {
+    if (image) {
+        place_heap_above(image->base_address() + static_cast<uint64_t>(image->size()));
+    }
+    memory_->image = std::move(image);
+}
+
+size_t MachineState::resident_pages() const {
+    return memory_->pages.size();
+}
+
+// memory-mapped console
+void MachineState::map_console(uint32_t base_address) {
+    if (get_page_offset(base_address) != 0) {
+        throw std::invalid_argument("Console base address must be page aligned");
+    }
+    unmap_console();
+    memory_->console_page = get_page_index(base_address);
+    auto* page = get_or_create_page(memory_->console_page);
+    std::memset(page->data, 0, PAGE_SIZE); // reads from the device page return 0
+    page->flags |= PAGE_DEVICE;
+    memory_->console_mapped = true;
+}
+
+void MachineState::unmap_console() {
+    if (!memory_->console_mapped) return;
+    {
+        std::lock_guard<std::mutex> lock(memory_->output_mutex);
+        flush_console();
+    }
+    get_or_create_page(memory_->console_page)->flags &= ~PAGE_DEVICE;
+    memory_->console_mapped = false;
+}
+
+// shared memory window
+void MachineState::map_shared_window(const std::string& name, uint32_t base_address, uint32_t size) {
+    if (get_page_offset(base_address) != 0 || size % PAGE_SIZE != 0 || size == 0) {
+        throw std::invalid_argument("Shared window must cover whole pages");
+    }
+    check_range(base_address, size);
+    if (memory_->console_mapped && memory_->console_page >= get_page_index(base_address) &&
+        memory_->console_page < get_page_index(base_address) + size / PAGE_SIZE) {
+        throw std::invalid_argument("Shared window overlaps the console device");
+    }
+    
+    unmap_shared_window();
+    auto window = std::make_unique<SharedWindow>(name, base_address, size, PAGE_SIZE);
+    
+    // repoint every page of the range into the window, keeping existing contents
+    uint32_t first_page = get_page_index(base_address);
+    for (uint32_t i = 0; i < size / PAGE_SIZE; ++i) {
+        uint8_t* window_page = window->data() + static_cast<size_t>(i) * PAGE_SIZE;
+        auto* page = get_or_create_page(first_page + i);
+        std::memcpy(window_page, page->data, PAGE_SIZE);
+        page->storage.reset();
+        page->data = window_page;
+        page->flags |= PAGE_EXTERNAL;
+    }
+    memory_->shared_window = std::move(window);
+}
+
+void MachineState::unmap_shared_window() {
+    auto& window = memory_->shared_window;
+    if (!window) return;
+    
+    uint32_t first_page = get_page_index(window->guest_base());
+    for (uint32_t i = 0; i < window->size() / PAGE_SIZE; ++i) {
+        auto* page = get_writable_page(first_page + i);
+        page->storage = std::make_unique<uint8_t[]>(PAGE_SIZE);
+        std::memcpy(page->storage.get(), page->data, PAGE_SIZE);
+        page->data = page->storage.get();
+        page->flags &= ~PAGE_EXTERNAL;
+    }
+    window.reset();
+}
+
+// only reached for stores into a tagged page
+void MachineState::device_store(uint32_t address, uint8_t value) {
+    uint32_t offset = get_page_offset(address);
+    std::lock_guard<std::mutex> lock(memory_->output_mutex);
+    if (offset >= CONSOLE_DATA && offset < CONSOLE_DATA + 4) {
+        memory_->console_buffer.push_back(static_cast<char>(value));
+        if (memory_->console_buffer.size() >= CONSOLE_BUFFER_LIMIT) {
+            flush_console();
+        }
+    } else if (offset >= CONSOLE_FLUSH && offset < CONSOLE_FLUSH + 4) {
+        flush_console();
+    }
+    // other offsets in the device page ignore stores
+}
+
+void MachineState::flush_console() {
+    auto& buffer = memory_->console_buffer;
+    if (buffer.empty()) return;
+    emit_output(buffer.data(), buffer.size());
+    buffer.clear();
 }
 
 // instruction implementation
@@ -175,7 +697,20 @@ uint32_t Instruction::encode() const { // each instr = 32 bits, shift instr fiel
 }
 
 // CPU implementation
-CPU::CPU() : halted_(false) {}
+CPU::CPU()
+    : halted_(false), blocking_input_(true), waiting_for_input_(false), hart_id_(0),
+      reservation_valid_(false), reservation_address_(0), reservation_value_(0), instruction_count_(0),
+      snapshot_publisher_(nullptr), snapshot_interval_(0), next_snapshot_(0) {
+    register_builtin_syscalls();
+}
+
+CPU::CPU(const CPU& parent, uint32_t hart_id)
+    : state_(parent.state_.share_address_space()), halted_(false),
+      blocking_input_(parent.blocking_input_), waiting_for_input_(false),
+      syscalls_(parent.syscalls_), hart_id_(hart_id),
+      reservation_valid_(false), reservation_address_(0), reservation_value_(0), instruction_count_(0),
+      snapshot_publisher_(nullptr), snapshot_interval_(0), next_snapshot_(0) {
+}
 
 void CPU::execute_instruction(const Instruction& instr) {
     if (halted_) return;
@@ -222,6 +757,10 @@ void CPU::execute_instruction(const Instruction& instr) {
             break;
         case InstructionCategory::TRAP:
             execute_trap(instr);
+            if (waiting_for_input_) return; // retry the same trap once input arrives
+            break;
+        case InstructionCategory::SYNC:
+            execute_sync(instr);
             break;
     }
     
@@ -235,21 +774,29 @@ void CPU::execute_instruction(const Instruction& instr) {
 }
 
 void CPU::run() {
-    while (!halted_) {
-        run_single_step();
+    waiting_for_input_ = false;
+    while (!halted_ && !waiting_for_input_) {
+        while (!step()) {
+        }
+        maybe_publish_snapshot();
     }
+    if (snapshot_publisher_) publish_snapshot();
 }
 
 void CPU::run_single_step() {
     if (halted_) return;
-    
+    step();
+}
+
+bool CPU::step() {
     uint32_t pc = state_.get_pc();
     uint32_t instruction_word = state_.load_word(pc); // load instruction from memory
     
     // check for null instruction
     if (instruction_word == 0) {
         state_.set_pc(pc + 4); // skip null instruction 
-        return;
+        instruction_count_++;
+        return true; // ends a block so a run through empty memory still sees halt()
     }
     
     Instruction instr = Instruction::decode(instruction_word); // assign attributes to instr
@@ -258,11 +805,139 @@ void CPU::run_single_step() {
     determine_instruction_info(instr);
     
     execute_instruction(instr);
+    if (!waiting_for_input_) {
+        instruction_count_++;
+    }
+    
+    // control transfers end a block, so do traps since they may halt or park the CPU
+    switch (instr.category) {
+        case InstructionCategory::JUMP:
+        case InstructionCategory::JUMP_REG:
+        case InstructionCategory::BRANCH:
+        case InstructionCategory::BRANCH_ZERO:
+        case InstructionCategory::TRAP:
+        case InstructionCategory::SYNC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+StopReason CPU::run(uint64_t max_instructions) {
+    return run_blocks(max_instructions, true);
+}
+
+StopReason CPU::run_until(std::chrono::steady_clock::time_point deadline, uint64_t max_instructions) {
+    uint64_t start = instruction_count_;
+    bool first_slice = true;
+    while (true) {
+        uint64_t slice = DEADLINE_CHECK_INTERVAL;
+        if (max_instructions > 0) {
+            uint64_t executed = instruction_count_ - start;
+            if (executed >= max_instructions) return StopReason::BUDGET_EXHAUSTED;
+            slice = std::min(slice, max_instructions - executed);
+        }
+        StopReason reason = run_blocks(slice, first_slice);
+        if (reason != StopReason::BUDGET_EXHAUSTED) return reason;
+        if (std::chrono::steady_clock::now() >= deadline) return StopReason::BUDGET_EXHAUSTED;
+        first_slice = false;
+    }
+}
+
+StopReason CPU::run_blocks(uint64_t max_instructions, bool skip_breakpoint) {
+    uint64_t limit = max_instructions > 0 ? instruction_count_ + max_instructions : UINT64_MAX;
+    waiting_for_input_ = false;
+    fault_message_.clear();
+    StopReason reason;
+    try {
+        while (true) {
+            // stop conditions are only looked at between basic blocks
+            maybe_publish_snapshot();
+            if (halted_) {
+                reason = StopReason::HALTED;
+                break;
+            }
+            if (waiting_for_input_) {
+                reason = StopReason::WAITING_FOR_INPUT;
+                break;
+            }
+            if (instruction_count_ >= limit) {
+                reason = StopReason::BUDGET_EXHAUSTED;
+                break;
+            }
+            
+            if (breakpoints_.empty()) {
+                // the budget alone is exact, everything else waits for the block to end
+                while (!step() && instruction_count_ < limit) {
+                }
+            } else {
+                uint32_t pc = state_.get_pc();
+                if (!skip_breakpoint && std::find(breakpoints_.begin(), breakpoints_.end(), pc) != breakpoints_.end()) {
+                    reason = StopReason::BREAKPOINT;
+                    break;
+                }
+                skip_breakpoint = false;
+                step();
+            }
+        }
+    } catch (const std::exception& e) {
+        fault_message_ = e.what();
+        reason = StopReason::FAULT;
+    }
+    if (snapshot_publisher_) publish_snapshot();
+    return reason;
+}
+
+void CPU::add_breakpoint(uint32_t address) {
+    if (std::find(breakpoints_.begin(), breakpoints_.end(), address) == breakpoints_.end()) {
+        breakpoints_.push_back(address);
+    }
+}
+
+void CPU::remove_breakpoint(uint32_t address) {
+    breakpoints_.erase(std::remove(breakpoints_.begin(), breakpoints_.end(), address), breakpoints_.end());
+}
+
+void CPU::set_snapshot_publisher(SnapshotPublisher* publisher, uint64_t interval) {
+    snapshot_publisher_ = publisher;
+    snapshot_interval_ = interval > 0 ? interval : 1;
+    next_snapshot_ = instruction_count_;
+}
+
+void CPU::publish_snapshot() {
+    snapshot_publisher_->publish(*this);
+    next_snapshot_ = instruction_count_ + snapshot_interval_;
 }
 
 void CPU::reset() {
     state_ = MachineState();
     halted_ = false;
+    waiting_for_input_ = false;
+    reservation_valid_ = false;
+    instruction_count_ = 0;
+    next_snapshot_ = 0;
+    fault_message_.clear();
+    // registered syscalls and breakpoints survive a reset
+}
+
+void CPU::register_syscall(uint32_t code, SyscallHandler handler) {
+    if (code >= NUM_SYSCALLS) {
+        throw std::out_of_range("Trap code out of range: " + std::to_string(code));
+    }
+    if (code >= syscalls_.size()) {
+        syscalls_.resize(code + 1); // grow table on demand, dispatch stays a direct index
+    }
+    syscalls_[code] = std::move(handler);
+}
+
+void CPU::unregister_syscall(uint32_t code) {
+    if (code < syscalls_.size()) {
+        syscalls_[code] = nullptr;
+    }
+}
+
+bool CPU::has_syscall(uint32_t code) const {
+    return code < syscalls_.size() && static_cast<bool>(syscalls_[code]);
 }
 
 // helper funcs
@@ -331,6 +1006,7 @@ void CPU::determine_instruction_info(Instruction& instr) {
             case 0b000111: instr.name = "srav"; instr.category = InstructionCategory::SHIFT_REG; break;
             case 0b001000: instr.name = "jr"; instr.category = InstructionCategory::JUMP_REG; break;
             case 0b001001: instr.name = "jalr"; instr.category = InstructionCategory::JUMP_REG; break;
+            case 0b001111: instr.name = "sync"; instr.category = InstructionCategory::SYNC; break;
             case 0b010000: instr.name = "mfhi"; instr.category = InstructionCategory::MOVE_FROM; break;
             case 0b010001: instr.name = "mthi"; instr.category = InstructionCategory::MOVE_TO; break;
             case 0b010010: instr.name = "mflo"; instr.category = InstructionCategory::MOVE_FROM; break;
@@ -378,6 +1054,8 @@ void CPU::determine_instruction_info(Instruction& instr) {
             case 0b101000: instr.name = "sb"; instr.category = InstructionCategory::LOAD_STORE; break;
             case 0b101001: instr.name = "sh"; instr.category = InstructionCategory::LOAD_STORE; break;
             case 0b101011: instr.name = "sw"; instr.category = InstructionCategory::LOAD_STORE; break;
+            case 0b110000: instr.name = "ll"; instr.category = InstructionCategory::LOAD_STORE; break;
+            case 0b111000: instr.name = "sc"; instr.category = InstructionCategory::LOAD_STORE; break;
             default: instr.name = "unknown"; instr.category = InstructionCategory::ARITH_LOGIC; break;
         }
     }
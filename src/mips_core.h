@@ -8,9 +8,19 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "guest_heap.h"
+#include "async_output.h"
+#include "shared_window.h"
 
 namespace mips {
 
+class ProgramImage;
+class SnapshotPublisher;
+
 // MIPS register defs
 enum class Register : uint8_t {
     ZERO = 0, AT = 1, V0 = 2, V1 = 3,
@@ -45,7 +55,29 @@ enum class InstructionCategory {
     BRANCH_ZERO,
     LOAD_STORE,
     JUMP,
-    TRAP
+    TRAP,
+    SYNC
+};
+
+// built-in trap codes
+enum class TrapCode : uint32_t {
+    PRINT_INT = 0,
+    PRINT_CHARACTER = 1,
+    PRINT_STRING = 2,
+    READ_INT = 3,
+    READ_CHARACTER = 4,
+    EXIT = 5,
+    MEMCPY = 6,     // a0 = dest, a1 = src, a2 = size
+    MEMMOVE = 7,    // a0 = dest, a1 = src, a2 = size
+    MEMSET = 8,     // a0 = dest, a1 = byte, a2 = size
+    MEMCMP = 9,     // a0 = lhs, a1 = rhs, a2 = size, v0 = -1/0/1
+    STRLEN = 10,    // a0 = string, v0 = length
+    SBRK = 11,      // a0 = increment, v0 = old break or -1
+    MALLOC = 12,    // a0 = size, v0 = address or 0
+    FREE = 13,      // a0 = address
+    HART_ID = 14,   // v0 = id of the calling hart (0 for the boot hart)
+    HART_SPAWN = 15, // a0 = entry, a1 = stack pointer, a2 = argument (new hart's a0), v0 = id or -1
+    HART_JOIN = 16  // a0 = hart id, blocks until that hart halts
 };
 
 // Machine state class
@@ -58,6 +90,20 @@ public:
     
     MachineState();
     
+    // a new hart's view of this machine: fresh registers, same memory, devices and streams
+    MachineState share_address_space() const;
+    
+    // checkpoint: registers, private pages and heap metadata are copied, the program
+    // image stays shared. the console page keeps its device tag, a shared window's
+    // contents become private pages and async output is not carried over
+    MachineState clone() const;
+    
+    // copying would silently share memory, harts go through share_address_space()
+    MachineState(const MachineState&) = delete;
+    MachineState& operator=(const MachineState&) = delete;
+    MachineState(MachineState&&) = default;
+    MachineState& operator=(MachineState&&) = default;
+    
     // register access
     uint32_t get_register(Register reg) const;
     void set_register(Register reg, uint32_t value);
@@ -70,7 +116,9 @@ public:
     uint32_t get_lo() const { return lo_; }
     void set_lo(uint32_t value) { lo_ = value; }
     
-    // memory access
+    // memory access, naturally aligned accesses are single-copy atomic between harts
+    // (acquire loads and release stores, still plain movs on x86-64), unaligned ones are
+    // split into bytes
     uint8_t load_byte(uint32_t address) const;
     uint16_t load_half(uint32_t address) const;
     uint32_t load_word(uint32_t address) const;
@@ -78,25 +126,126 @@ public:
     void store_half(uint32_t address, uint16_t value);
     void store_word(uint32_t address, uint32_t value);
     
+    // word compare-and-swap for sc, sequentially consistent, address must be aligned
+    bool compare_exchange_word(uint32_t address, uint32_t expected, uint32_t desired);
+    
+    // bulk memory access, walks whole pages at a time (unallocated pages read as 0),
+    // not atomic with respect to other harts
+    void read_block(uint32_t address, uint8_t* out, size_t size) const;
+    void write_block(uint32_t address, const uint8_t* data, size_t size);
+    void copy_memory(uint32_t dest, uint32_t src, uint32_t size); // overlap-safe
+    void fill_memory(uint32_t dest, uint8_t value, uint32_t size);
+    int compare_memory(uint32_t lhs, uint32_t rhs, uint32_t size) const;
+    uint32_t string_length(uint32_t address) const;
+    
     // memory initialization
     void load_memory(const std::vector<uint8_t>& data, uint32_t start_address = 0);
     
+    // back memory with a shared read-only image in O(1), pages the guest writes are
+    // copied on first write, earlier writes and load_memory data take precedence
+    void map_image(std::shared_ptr<const ProgramImage> image);
+    size_t resident_pages() const; // privately allocated pages
+    
+    // the device and window mappings below rearrange pages and must not run while
+    // any hart of the machine is executing
+    
+    // memory-mapped console, stores to base + CONSOLE_DATA..+3 append their bytes to
+    // an output buffer, a store to base + CONSOLE_FLUSH writes the buffer out
+    static constexpr uint32_t CONSOLE_DATA = 0x0;
+    static constexpr uint32_t CONSOLE_FLUSH = 0x4;
+    static constexpr size_t CONSOLE_BUFFER_LIMIT = 4096; // flushed automatically past this
+    void map_console(uint32_t base_address); // base must be page aligned
+    void unmap_console();
+    
+    // back [base_address, base_address + size) with a POSIX shared memory object so other
+    // processes can read guest data (or feed input) zero-copy, see shared_window.h for the layout;
+    // an empty name gives an anonymous window that only this process can see
+    void map_shared_window(const std::string& name, uint32_t base_address, uint32_t size);
+    void unmap_shared_window(); // copies the window contents back into private pages
+    SharedWindow* shared_window();
+    
+    // guest heap segment, allocator metadata lives on the host
+    GuestHeap& heap();
+    const GuestHeap& heap() const;
+    std::mutex& heap_mutex(); // held by the heap traps, the heap is shared by all harts
+    
+    // program loaders report where the program ends, a program reaching past the heap
+    // base moves the heap up to the next page boundary; throws if the heap is in use
+    // or the program leaves no room below the heap limit
+    void place_heap_above(uint64_t program_end);
+    
     // I/O streams (configurable for testing)
     std::istream* input_stream = &std::cin;
     std::ostream* output_stream = &std::cout;
+    std::mutex& input_mutex(); // held by the input traps
+    
+    // guest output path used by the print traps, serialised between harts
+    void write_output(const char* data, size_t size);
+    void flush_output(); // drains buffered output, called at halt and before input traps
+    
+    // optional writer thread for output_stream (bound when enabled)
+    void enable_async_output(size_t capacity = AsyncOutput::DEFAULT_CAPACITY);
+    void disable_async_output();
+    bool has_async_output() const;
     
 private:
+    // page flags, device pages are tagged so ordinary accesses never compare addresses
+    static constexpr uint32_t PAGE_DEVICE = 0x1;
+    
+    static constexpr uint32_t PAGE_EXTERNAL = 0x2; // data points into a shared window
+    
+    struct Page {
+        uint8_t* data; // PAGE_SIZE bytes, either storage or external memory
+        uint32_t flags;
+        std::unique_ptr<uint8_t[]> storage;
+    };
+    
+    // two-level radix table over the 20-bit page index, slots are filled with a CAS so
+    // harts can fault pages in concurrently and lookups take no lock
+    class PageTable {
+    public:
+        static constexpr size_t LEVEL_BITS = 10;
+        static constexpr size_t LEVEL_SIZE = size_t(1) << LEVEL_BITS;
+        
+        PageTable();
+        ~PageTable();
+        PageTable(const PageTable&) = delete;
+        PageTable& operator=(const PageTable&) = delete;
+        
+        Page* find(uint32_t page_index) const;
+        Page* find_or_create(uint32_t page_index, const uint8_t* initial = nullptr);
+        template <typename Visitor> void for_each(Visitor visit) const; // visit(page_index, page)
+        size_t size() const { return size_.load(std::memory_order_relaxed); }
+        
+    private:
+        struct Directory {
+            std::array<std::atomic<Page*>, LEVEL_SIZE> pages{};
+        };
+        std::array<std::atomic<Directory*>, LEVEL_SIZE> directories_{};
+        std::atomic<size_t> size_{0};
+    };
+    
+    // memory and devices, shared by every hart of the machine
+    struct AddressSpace;
+    
     std::array<uint32_t, NUM_REGISTERS> registers_;
-    std::unordered_map<uint32_t, std::unique_ptr<std::array<uint8_t, PAGE_SIZE>>> memory_pages_;
     uint32_t pc_;
     uint32_t hi_;
     uint32_t lo_;
+    std::shared_ptr<AddressSpace> memory_;
     
     // helper methods for page-based memory
     uint32_t get_page_index(uint32_t address) const { return address / PAGE_SIZE; }
     uint32_t get_page_offset(uint32_t address) const { return address % PAGE_SIZE; }
-    std::array<uint8_t, PAGE_SIZE>* get_or_create_page(uint32_t page_index);
-    const std::array<uint8_t, PAGE_SIZE>* get_page(uint32_t page_index) const;
+    void check_range(uint32_t address, uint64_t size) const;
+    Page* get_or_create_page(uint32_t page_index);
+    const uint8_t* read_page(uint32_t page_index) const; // page contents, null if all zero
+    Page* get_writable_page(uint32_t page_index); // null if neither written nor in the image
+    void device_store(uint32_t address, uint8_t value);
+    
+    // callers hold the output mutex
+    void emit_output(const char* data, size_t size);
+    void flush_console();
 };
 
 // instruction representation
@@ -118,29 +267,110 @@ struct Instruction {
     uint32_t encode() const;
 };
 
+class CPU;
+
+// why a bounded run returned
+enum class StopReason {
+    HALTED,
+    BUDGET_EXHAUSTED,   // instruction budget used up or deadline passed
+    FAULT,              // the instruction at the PC threw, see CPU::fault_message
+    BREAKPOINT,         // the PC reached a breakpoint, its instruction has not run
+    WAITING_FOR_INPUT   // non-blocking input trap parked (see set_blocking_input)
+};
+
+// host-side trap handler, gets the register file and memory through MachineState
+using SyscallHandler = std::function<void(CPU& cpu, MachineState& state)>;
+
 // MIPS CPU class
 class CPU {
 public:
     CPU();
     
+    // additional hart of parent's machine, shares its memory, devices, I/O streams and
+    // syscall table but starts with its own zeroed registers
+    CPU(const CPU& parent, uint32_t hart_id);
+    
     // execute single instruction
     void execute_instruction(const Instruction& instr);
     
-    // run program
+    // run program, faults are thrown
     void run();
     void run_single_step();
     
+    // bounded runs for hosts that must not hang on a guest: stop after exactly
+    // max_instructions (0 = no limit) or once deadline has passed. the instruction count
+    // is compared after every instruction, since straight-line code (say a run through
+    // zeroed memory) may never end a block; halt, input waits and snapshots are looked
+    // at between basic blocks and the deadline every DEADLINE_CHECK_INTERVAL
+    // instructions. faults are caught and reported as StopReason::FAULT
+    StopReason run(uint64_t max_instructions);
+    StopReason run_until(std::chrono::steady_clock::time_point deadline, uint64_t max_instructions = 0);
+    static constexpr uint64_t DEADLINE_CHECK_INTERVAL = 16384;
+    
+    // instructions executed since construction or reset, a parked input trap is not counted
+    uint64_t instruction_count() const { return instruction_count_; }
+    const std::string& fault_message() const { return fault_message_; }
+    
+    // bounded runs stop before executing an instruction at a breakpoint, except the
+    // first instruction of the run so a stopped guest can be resumed
+    void add_breakpoint(uint32_t address);
+    void remove_breakpoint(uint32_t address);
+    void clear_breakpoints() { breakpoints_.clear(); }
+    
+    // live introspection: publishes a snapshot at the first block end after every
+    // interval instructions and when a run returns; null detaches
+    void set_snapshot_publisher(SnapshotPublisher* publisher, uint64_t interval = 4096);
+    
     // machine state access
     MachineState& get_state() { return state_; }
     const MachineState& get_state() const { return state_; }
     
     // control
     void reset();
+    void halt() { halted_ = true; } // may be called from another host thread
     bool is_halted() const { return halted_; }
+    uint32_t get_hart_id() const { return hart_id_; }
+    
+    // non-blocking input: an input trap with nothing buffered on input_stream parks the
+    // CPU on that trap (PC unchanged) instead of blocking the host thread
+    void set_blocking_input(bool blocking) { blocking_input_ = blocking; }
+    bool has_blocking_input() const { return blocking_input_; }
+    bool is_waiting_for_input() const { return waiting_for_input_; }
+    void wait_for_input() { waiting_for_input_ = true; }
+    
+    // syscall table, indexed directly by the 16-bit trap code
+    static constexpr size_t NUM_SYSCALLS = 0x10000;
+    void register_syscall(uint32_t code, SyscallHandler handler);
+    void unregister_syscall(uint32_t code);
+    bool has_syscall(uint32_t code) const;
     
 private:
     MachineState state_;
-    bool halted_;
+    std::atomic<bool> halted_;
+    bool blocking_input_;
+    bool waiting_for_input_;
+    std::vector<SyscallHandler> syscalls_;
+    uint32_t hart_id_;
+    
+    // ll reservation, sc succeeds if the word still holds the linked value
+    bool reservation_valid_;
+    uint32_t reservation_address_;
+    uint32_t reservation_value_;
+    
+    uint64_t instruction_count_;
+    std::string fault_message_;
+    std::vector<uint32_t> breakpoints_;
+    
+    SnapshotPublisher* snapshot_publisher_;
+    uint64_t snapshot_interval_;
+    uint64_t next_snapshot_;
+    void maybe_publish_snapshot() {
+        if (snapshot_publisher_ && instruction_count_ >= next_snapshot_) publish_snapshot();
+    }
+    void publish_snapshot();
+    
+    bool step(); // runs one instruction, true if it ends a basic block
+    StopReason run_blocks(uint64_t max_instructions, bool skip_breakpoint);
     
     // instruction execution methods
     void execute_arith_logic(const Instruction& instr);
@@ -157,6 +387,8 @@ private:
     void execute_load_store(const Instruction& instr);
     void execute_jump(const Instruction& instr);
     void execute_trap(const Instruction& instr);
+    void execute_sync(const Instruction& instr);
+    void register_builtin_syscalls();
     
     // helper functions
     int32_t sign_extend_16(uint16_t value);
@@ -1,22 +1,107 @@
 #include "mips_core.h"
 #include "assembler.h"
+#include "smp.h"
+#include "snapshot.h"
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdlib>
+
+namespace {
+
+// prints the boot CPU's latest snapshot to stderr every period without pausing it
+class Monitor {
+public:
+    Monitor(mips::CPU& cpu, std::chrono::milliseconds period) : cpu_(cpu), done_(false) {
+        cpu_.set_snapshot_publisher(&publisher_);
+        thread_ = std::thread([this, period] {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!cv_.wait_for(lock, period, [this] { return done_; })) {
+                mips::CpuSnapshot snapshot = publisher_.read();
+                std::cerr << "[monitor] pc=0x" << std::hex << snapshot.pc << std::dec
+                          << " instructions=" << snapshot.instruction_count
+                          << " pages=" << snapshot.resident_pages << std::endl;
+            }
+        });
+    }
+    
+    ~Monitor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+        cpu_.set_snapshot_publisher(nullptr);
+    }
+
+private:
+    mips::CPU& cpu_;
+    mips::SnapshotPublisher publisher_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_;
+    std::thread thread_;
+};
+
+} // namespace
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <binary_file>" << std::endl;
+    // options
+    bool async_output = false;
+    bool console = false;
+    uint32_t console_address = 0;
+    size_t max_harts = 0; // 0 = single hart, no spawn/join traps
+    uint64_t max_steps = 0; // 0 = run until the guest halts
+    unsigned long monitor_ms = 0; // 0 = no monitor
+    const char* input_file = nullptr;
+    bool usage_error = false;
+    for (int i = 1; i < argc && !usage_error; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--async-output") {
+            async_output = true;
+        } else if (arg == "--console" && i + 1 < argc) {
+            char* end = nullptr;
+            console = true;
+            console_address = static_cast<uint32_t>(std::strtoul(argv[++i], &end, 0));
+            usage_error = (*end != '\0');
+        } else if (arg == "--harts" && i + 1 < argc) {
+            char* end = nullptr;
+            max_harts = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || max_harts == 0);
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            char* end = nullptr;
+            max_steps = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || max_steps == 0);
+        } else if (arg == "--monitor" && i + 1 < argc) {
+            char* end = nullptr;
+            monitor_ms = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || monitor_ms == 0);
+        } else if (!input_file && arg.rfind("--", 0) != 0) {
+            input_file = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || !input_file || (max_harts > 0 && max_steps > 0)) {
+        std::cerr << "Usage: " << argv[0] << " [--async-output] [--console <address>] [--harts <n> | --max-steps <n>]"
+                  << " [--monitor <ms>] <binary_file>" << std::endl;
         return 1;
     }
     
     try {
         // read binary file
         uint32_t main_address;
-        auto binary_data = mips::BinaryFormat::read_binary_file(argv[1], main_address);
+        auto binary = mips::BinaryFormat::read_sparse_file(input_file, main_address);
         
         // create CPU and load program
         mips::CPU cpu;
-        cpu.get_state().load_memory(binary_data, 0);
+        binary.load_into(cpu.get_state()); // zero ranges stay unallocated
         cpu.get_state().set_pc(main_address);
         
         // init stack pointer to end of memory
@@ -26,8 +111,35 @@ int main(int argc, char* argv[]) {
         std::cout << "Starting MIPS program execution at address 0x" 
                   << std::hex << main_address << std::dec << std::endl;
         
-        cpu.run();
+        if (console) {
+            cpu.get_state().map_console(console_address); // memory-mapped console device
+        }
+        if (async_output) {
+            cpu.get_state().enable_async_output(); // print traps no longer block on stdout
+        }
+        std::unique_ptr<Monitor> monitor;
+        if (monitor_ms > 0) {
+            monitor = std::make_unique<Monitor>(cpu, std::chrono::milliseconds(monitor_ms));
+        }
+        mips::StopReason reason = mips::StopReason::HALTED;
+        if (max_harts > 0) {
+            mips::SmpMachine machine(cpu, max_harts); // guest can spawn up to max_harts - 1 more harts
+            machine.run();
+        } else if (max_steps > 0) {
+            reason = cpu.run(max_steps); // a looping guest cannot hang the tool
+        } else {
+            cpu.run();
+        }
+        monitor.reset();
+        cpu.get_state().disable_async_output();
         
+        if (reason == mips::StopReason::FAULT) {
+            throw std::runtime_error(cpu.fault_message());
+        }
+        if (reason == mips::StopReason::BUDGET_EXHAUSTED) {
+            std::cerr << "\nError: Program stopped after " << max_steps << " instructions (step limit)" << std::endl;
+            return 1;
+        }
         std::cout << "\nProgram execution completed." << std::endl;
     }
     catch (const std::exception& e) {
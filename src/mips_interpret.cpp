@@ -1,41 +1,116 @@
 #include "mips_core.h"
 #include "assembler.h"
+#include "assembly_cache.h"
+#include "smp.h"
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <cstdlib>
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <assembly_file>" << std::endl;
+    // options
+    bool async_output = false;
+    bool console = false;
+    uint32_t console_address = 0;
+    size_t max_harts = 0; // 0 = single hart, no spawn/join traps
+    const char* cache_dir = nullptr;
+    uint64_t cache_size = 256ull << 20;
+    const char* input_file = nullptr;
+    bool usage_error = false;
+    for (int i = 1; i < argc && !usage_error; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--async-output") {
+            async_output = true;
+        } else if (arg == "--console" && i + 1 < argc) {
+            char* end = nullptr;
+            console = true;
+            console_address = static_cast<uint32_t>(std::strtoul(argv[++i], &end, 0));
+            usage_error = (*end != '\0');
+        } else if (arg == "--harts" && i + 1 < argc) {
+            char* end = nullptr;
+            max_harts = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || max_harts == 0);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            char* end = nullptr;
+            cache_size = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0');
+        } else if (!input_file && arg.rfind("--", 0) != 0) {
+            input_file = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || !input_file) {
+        std::cerr << "Usage: " << argv[0] << " [--async-output] [--console <address>] [--harts <n>]"
+                  << " [--cache <dir>] [--cache-size <bytes>] <assembly_file>" << std::endl;
         return 1;
     }
     
     try {
         // read and assemble the text file
-        std::ifstream input(argv[1]);
+        std::ifstream input(input_file);
         if (!input) {
-            std::cerr << "Error: Cannot open input file: " << argv[1] << std::endl;
+            std::cerr << "Error: Cannot open input file: " << input_file << std::endl;
             return 1;
         }
         
-        mips::Assembler assembler;
-        auto binary_data = assembler.assemble_stream(input);
+        // the program goes straight into guest memory; with a cache an unchanged source
+        // is not assembled again, its binary is mapped and copied in
+        mips::CPU cpu;
+        mips::MachineState& state = cpu.get_state();
+        uint32_t main_address = 0;
+        uint32_t binary_size = 0;
+        if (cache_dir) {
+            std::ostringstream contents;
+            contents << input.rdbuf();
+            std::string source = contents.str();
+            mips::AssemblyCache cache(cache_dir, cache_size);
+            auto cached = cache.find(source);
+            if (cached) {
+                main_address = cached->main_address();
+                binary_size = static_cast<uint32_t>(cached->size());
+                cached->load_into(state);
+            } else {
+                mips::Assembler assembler;
+                std::istringstream source_input(source);
+                mips::SparseBinary binary = assembler.assemble_sparse(source_input);
+                if (assembler.has_errors()) {
+                    for (const auto& error : assembler.get_errors()) {
+                        std::cerr << "Assembly Error: " << error << std::endl;
+                    }
+                    return 1;
+                }
+                main_address = assembler.get_main_address();
+                binary_size = binary.size;
+                binary.load_into(state);
+                try {
+                    cache.store(source, binary, main_address);
+                } catch (const std::exception& e) {
+                    std::cerr << "Warning: " << e.what() << std::endl; // runs uncached
+                }
+            }
+        } else {
+            mips::Assembler assembler;
+            binary_size = assembler.assemble_into(input, state);
         
-        if (assembler.has_errors()) {
-            for (const auto& error : assembler.get_errors()) {
-                std::cerr << "Assembly Error: " << error << std::endl;
+            if (assembler.has_errors()) {
+                for (const auto& error : assembler.get_errors()) {
+                    std::cerr << "Assembly Error: " << error << std::endl;
+                }
+                return 1;
             }
-            return 1;
+            main_address = assembler.get_main_address();
         }
         
-        uint32_t main_address = assembler.get_main_address();
-        if (main_address == 0 && binary_data.size() > 0) {
+        if (main_address == 0 && binary_size > 0) {
             std::cerr << "Error: No 'main' label found in assembly file" << std::endl;
             return 1;
         }
         
-        // create CPU and load program
-        mips::CPU cpu;
-        cpu.get_state().load_memory(binary_data, 0);
         cpu.get_state().set_pc(main_address);
         
         // init stack pointer to end of memory
@@ -45,7 +120,19 @@ int main(int argc, char* argv[]) {
         std::cout << "Starting MIPS program execution at address 0x" 
                   << std::hex << main_address << std::dec << std::endl;
         
-        cpu.run();
+        if (console) {
+            cpu.get_state().map_console(console_address); // memory-mapped console device
+        }
+        if (async_output) {
+            cpu.get_state().enable_async_output(); // print traps no longer block on stdout
+        }
+        if (max_harts > 0) {
+            mips::SmpMachine machine(cpu, max_harts); // guest can spawn up to max_harts - 1 more harts
+            machine.run();
+        } else {
+            cpu.run();
+        }
+        cpu.get_state().disable_async_output();
         
         std::cout << "\nProgram execution completed." << std::endl;
     }
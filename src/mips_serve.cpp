@@ -0,0 +1,130 @@
+#include "job_server.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+
+// mips-serve runs jobs for clients on a Unix domain socket, see job_server.h for the
+// protocol; --connect makes it a client that submits one job
+
+namespace {
+
+std::string read_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// submits one job (repeat times over the same connection) and prints the guest's output
+int run_client(const std::string& path, const std::string& program_file, const std::string& input_file,
+               uint64_t max_steps, size_t repeat) {
+    mips::JobClient client(path);
+    
+    // .s/.asm files are sent as assembly, anything else as a BinaryFormat file
+    std::string extension = program_file.substr(program_file.find_last_of('.') + 1);
+    auto kind = (extension == "s" || extension == "asm") ? mips::ProgramCache::Kind::ASSEMBLY
+                                                         : mips::ProgramCache::Kind::BINARY;
+    std::string program = read_file(program_file);
+    std::string input = input_file.empty() ? std::string() : read_file(input_file);
+    
+    int status = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat; ++i) {
+        bool last = (i + 1 == repeat);
+        auto result = client.run(kind, program, input, max_steps, [last](const std::string& output) {
+            if (last) std::cout << output;
+        });
+        if (result.status == mips::JobClient::Status::ERROR) {
+            if (last) std::cerr << "Error: " << result.error << std::endl;
+            status = 1;
+        } else if (result.status == mips::JobClient::Status::LIMIT) {
+            if (last) std::cerr << "Error: step limit reached after " << result.instructions << " instructions" << std::endl;
+            status = 1;
+        }
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (repeat > 1) {
+        std::cerr << repeat << " jobs, " << elapsed / repeat << " us per job" << std::endl;
+    }
+    std::cout << std::flush;
+    return status;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // options
+    std::string socket_path = "/tmp/mips-serve.sock";
+    bool client = false;
+    std::string input_file;
+    uint64_t max_steps = 0;
+    size_t repeat = 1;
+    size_t num_threads = 0;
+    size_t cache_size = 256;
+    uint64_t default_steps = mips::JobServer::DEFAULT_STEPS;
+    uint64_t step_limit = mips::JobServer::STEP_LIMIT;
+    std::string program_file;
+    bool usage_error = false;
+    for (int i = 1; i < argc && !usage_error; ++i) {
+        std::string arg = argv[i];
+        char* end = nullptr;
+        if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--connect" && i + 1 < argc) {
+            client = true;
+            socket_path = argv[++i];
+        } else if (arg == "--input" && i + 1 < argc) {
+            input_file = argv[++i];
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            max_steps = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0');
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || repeat == 0);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0');
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_size = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || cache_size == 0);
+        } else if (arg == "--default-steps" && i + 1 < argc) {
+            default_steps = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || default_steps == 0);
+        } else if (arg == "--step-limit" && i + 1 < argc) {
+            step_limit = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || step_limit == 0);
+        } else if (client && program_file.empty() && arg.rfind("--", 0) != 0) {
+            program_file = arg;
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || (client && program_file.empty())) {
+        std::cerr << "Usage: " << argv[0] << " [--socket <path>] [--threads <n>] [--cache <programs>]"
+                  << " [--default-steps <n>] [--step-limit <n>]\n"
+                  << "       " << argv[0] << " --connect <path> [--input <file>] [--max-steps <n>] [--repeat <n>]"
+                  << " <program.s|program.bin>" << std::endl;
+        return 1;
+    }
+    
+    try {
+        if (client) {
+            return run_client(socket_path, program_file, input_file, max_steps, repeat);
+        }
+        mips::JobServer server(socket_path, num_threads, cache_size, default_steps, step_limit);
+        std::cout << "mips-serve listening on " << socket_path << " with " << server.num_workers() << " workers"
+                  << std::endl;
+        server.run();
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,153 @@
+#include "mips_core.h"
+#include "assembler.h"
+#include "replay.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // options
+    uint64_t interval = 1000000;
+    size_t num_threads = 0;
+    uint64_t max_steps = 0;
+    bool profile = false;
+    const char* input_file = nullptr;
+    const char* binary_file = nullptr;
+    bool usage_error = false;
+    for (int i = 1; i < argc && !usage_error; ++i) {
+        std::string arg = argv[i];
+        char* end = nullptr;
+        if (arg == "--interval" && i + 1 < argc) {
+            interval = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0' || interval == 0);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::strtoul(argv[++i], &end, 0);
+            usage_error = (*end != '\0');
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            max_steps = std::strtoull(argv[++i], &end, 0);
+            usage_error = (*end != '\0');
+        } else if (arg == "--input" && i + 1 < argc) {
+            input_file = argv[++i];
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (!binary_file && arg.rfind("--", 0) != 0) {
+            binary_file = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || !binary_file) {
+        std::cerr << "Usage: " << argv[0] << " [--interval <n>] [--threads <n>] [--max-steps <n>] [--input <file>]"
+                  << " [--profile] <binary_file>\n"
+                  << "Prints a trace of every executed instruction (pc and word), or with --profile the\n"
+                  << "execution count of every pc. Guest output goes to stderr." << std::endl;
+        return 1;
+    }
+    
+    try {
+        std::string input;
+        if (input_file) {
+            std::ifstream file(input_file, std::ios::binary);
+            if (!file) {
+                throw std::runtime_error("Cannot open input file: " + std::string(input_file));
+            }
+            std::ostringstream contents;
+            contents << file.rdbuf();
+            input = contents.str();
+        }
+        
+        uint32_t main_address;
+        auto binary = mips::BinaryFormat::read_sparse_file(binary_file, main_address);
+        mips::CPU cpu;
+        binary.load_into(cpu.get_state()); // zero ranges stay unallocated
+        cpu.get_state().set_pc(main_address);
+        cpu.get_state().set_register(mips::Register::SP, 0xFFFFFFFC);
+        
+        // fast pass, checkpoints only
+        auto start = std::chrono::steady_clock::now();
+        mips::CheckpointReplay replay(interval);
+        mips::StopReason reason = replay.record(cpu, input, max_steps);
+        double record_seconds = seconds_since(start);
+        
+        // detailed pass, one task per interval
+        start = std::chrono::steady_clock::now();
+        mips::ThreadPool pool(num_threads);
+        std::vector<std::string> traces(replay.num_intervals());
+        std::vector<std::unordered_map<uint32_t, uint64_t>> profiles(replay.num_intervals());
+        auto intervals = replay.replay([&](size_t index, mips::CPU& guest, uint64_t instructions) {
+            mips::MachineState& state = guest.get_state();
+            std::string& trace = traces[index];
+            auto& counts = profiles[index];
+            char line[32];
+            for (uint64_t n = 0; n < instructions && !guest.is_halted(); ++n) {
+                uint32_t pc = state.get_pc();
+                if (profile) {
+                    counts[pc]++;
+                } else {
+                    int length = std::snprintf(line, sizeof(line), "%08x %08x\n", pc, state.load_word(pc));
+                    trace.append(line, length);
+                }
+                guest.run_single_step();
+            }
+        }, pool);
+        double replay_seconds = seconds_since(start);
+        
+        // stitch the intervals back together in order
+        std::unordered_map<uint32_t, uint64_t> totals;
+        for (size_t i = 0; i < intervals.size(); ++i) {
+            if (!intervals[i].error.empty()) {
+                throw std::runtime_error("Interval " + std::to_string(i) + ": " + intervals[i].error);
+            }
+            std::cerr << intervals[i].output;
+            if (profile) {
+                for (const auto& entry : profiles[i]) {
+                    totals[entry.first] += entry.second;
+                }
+            } else {
+                std::cout << traces[i];
+            }
+        }
+        if (profile) {
+            std::vector<std::pair<uint32_t, uint64_t>> sorted(totals.begin(), totals.end());
+            std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+                return a.second != b.second ? a.second > b.second : a.first < b.first;
+            });
+            char line[48];
+            for (const auto& entry : sorted) {
+                std::snprintf(line, sizeof(line), "%08x %llu\n", entry.first,
+                              static_cast<unsigned long long>(entry.second));
+                std::cout << line;
+            }
+        }
+        std::cout << std::flush;
+        
+        std::cerr << "\n" << replay.num_intervals() << " intervals on " << pool.size() << " threads, record "
+                  << record_seconds << " s, replay " << replay_seconds << " s" << std::endl;
+        if (reason == mips::StopReason::FAULT) {
+            std::cerr << "Error: " << cpu.fault_message() << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
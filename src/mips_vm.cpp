@@ -0,0 +1,233 @@
+#include "mips_vm.h"
+#include "mips_core.h"
+#include "program_image.h"
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+namespace {
+
+// hands guest output straight to the host callback, the print traps already write
+// whole strings so no buffering here
+class CallbackOutput : public std::streambuf {
+public:
+    mips_output_callback callback = nullptr;
+    void* user_data = nullptr;
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        callback(user_data, data, static_cast<size_t>(size));
+        return size;
+    }
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char byte = traits_type::to_char_type(c);
+            callback(user_data, &byte, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+};
+
+// pulls guest input from the host callback a buffer at a time
+class CallbackInput : public std::streambuf {
+public:
+    mips_input_callback callback = nullptr;
+    void* user_data = nullptr;
+    
+    void discard() { setg(buffer_, buffer_, buffer_); }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        size_t count = callback(user_data, buffer_, sizeof(buffer_));
+        if (count == 0) {
+            return traits_type::eof();
+        }
+        setg(buffer_, buffer_, buffer_ + std::min(count, sizeof(buffer_)));
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    char buffer_[4096];
+};
+
+} // namespace
+
+struct mips_vm {
+    mips::CPU cpu;
+    std::shared_ptr<const mips::ProgramImage> image;
+    CallbackOutput output;
+    CallbackInput input;
+    std::ostream output_stream{&output};
+    std::istream input_stream{&input};
+    mutable std::string error; // set by const calls too
+    
+    // points the machine at the callbacks, or the standard streams without them
+    void bind_streams() {
+        mips::MachineState& state = cpu.get_state();
+        state.output_stream = output.callback ? &output_stream : &std::cout;
+        state.input_stream = input.callback ? &input_stream : &std::cin;
+    }
+    
+    void start() {
+        cpu.reset();
+        input.discard();
+        input_stream.clear();
+        bind_streams();
+        mips::MachineState& state = cpu.get_state();
+        if (image) {
+            state.set_pc(image->main_address());
+            state.map_image(image);
+        }
+        state.set_register(mips::Register::SP, 0xFFFFFFFC);
+    }
+    
+    void load(std::shared_ptr<const mips::ProgramImage> program) {
+        image = std::move(program);
+        start();
+    }
+};
+
+namespace {
+
+// runs body, turning exceptions into MIPS_ERROR and the VM's error message
+template <typename Body>
+mips_status guarded(const mips_vm* vm, Body body) {
+    try {
+        vm->error.clear();
+        return body();
+    } catch (const std::exception& e) {
+        vm->error = e.what();
+    } catch (...) {
+        vm->error = "Unknown error";
+    }
+    return MIPS_ERROR;
+}
+
+} // namespace
+
+extern "C" {
+
+mips_vm* mips_vm_create(void) {
+    try {
+        auto* vm = new mips_vm();
+        vm->start();
+        return vm;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void mips_vm_destroy(mips_vm* vm) {
+    delete vm;
+}
+
+const char* mips_vm_last_error(const mips_vm* vm) {
+    return vm->error.c_str();
+}
+
+mips_status mips_vm_load_assembly(mips_vm* vm, const char* text, size_t length) {
+    return guarded(vm, [&] {
+        vm->load(mips::ProgramImage::assemble(std::string(text, length)));
+        return MIPS_OK;
+    });
+}
+
+mips_status mips_vm_load_binary(mips_vm* vm, const void* data, size_t size) {
+    return guarded(vm, [&] {
+        vm->load(mips::ProgramImage::from_binary(static_cast<const uint8_t*>(data), size));
+        return MIPS_OK;
+    });
+}
+
+mips_status mips_vm_reset(mips_vm* vm) {
+    return guarded(vm, [&] {
+        vm->start();
+        return MIPS_OK;
+    });
+}
+
+mips_status mips_vm_run(mips_vm* vm, uint64_t max_steps, uint64_t* steps) {
+    mips::CPU& cpu = vm->cpu;
+    uint64_t start = cpu.instruction_count();
+    mips_status status = guarded(vm, [&] {
+        switch (cpu.run(max_steps)) {
+            case mips::StopReason::HALTED:
+                return MIPS_HALTED;
+            case mips::StopReason::FAULT:
+                vm->error = cpu.fault_message();
+                return MIPS_ERROR;
+            default:
+                return MIPS_STEP_LIMIT; // input is blocking, so only the budget is left
+        }
+    });
+    if (steps) {
+        *steps = cpu.instruction_count() - start;
+    }
+    return status;
+}
+
+void mips_vm_set_output(mips_vm* vm, mips_output_callback callback, void* user_data) {
+    vm->output.callback = callback;
+    vm->output.user_data = user_data;
+    vm->bind_streams();
+}
+
+void mips_vm_set_input(mips_vm* vm, mips_input_callback callback, void* user_data) {
+    vm->input.callback = callback;
+    vm->input.user_data = user_data;
+    vm->input.discard(); // bytes buffered from the old source are dropped
+    vm->input_stream.clear();
+    vm->bind_streams();
+}
+
+uint32_t mips_vm_get_register(const mips_vm* vm, unsigned index) {
+    return index < mips::MachineState::NUM_REGISTERS
+        ? vm->cpu.get_state().get_register(static_cast<mips::Register>(index)) : 0;
+}
+
+void mips_vm_set_register(mips_vm* vm, unsigned index, uint32_t value) {
+    if (index < mips::MachineState::NUM_REGISTERS) {
+        vm->cpu.get_state().set_register(static_cast<mips::Register>(index), value);
+    }
+}
+
+uint32_t mips_vm_get_pc(const mips_vm* vm) {
+    return vm->cpu.get_state().get_pc();
+}
+
+void mips_vm_set_pc(mips_vm* vm, uint32_t pc) {
+    vm->cpu.get_state().set_pc(pc);
+}
+
+mips_status mips_vm_read(const mips_vm* vm, uint32_t address, void* buffer, size_t size) {
+    return guarded(vm, [&] {
+        vm->cpu.get_state().read_block(address, static_cast<uint8_t*>(buffer), size);
+        return MIPS_OK;
+    });
+}
+
+mips_status mips_vm_write(mips_vm* vm, uint32_t address, const void* data, size_t size) {
+    return guarded(vm, [&] {
+        vm->cpu.get_state().write_block(address, static_cast<const uint8_t*>(data), size);
+        return MIPS_OK;
+    });
+}
+
+uint8_t* mips_vm_map_memory(mips_vm* vm, uint32_t address, uint32_t size) {
+    uint8_t* data = nullptr;
+    guarded(vm, [&] {
+        // an anonymous window, nothing for other processes to see or for a crash to leave behind
+        mips::MachineState& state = vm->cpu.get_state();
+        state.map_shared_window(std::string(), address, size);
+        data = state.shared_window()->data();
+        return MIPS_OK;
+    });
+    return data;
+}
+
+} // extern "C"
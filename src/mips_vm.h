@@ -0,0 +1,76 @@
+#ifndef MIPS_VM_H
+#define MIPS_VM_H
+
+/* C interface to the interpreter, built as the libmips_vm shared library.
+ * Functions never throw: failures return MIPS_ERROR (or NULL) and the message is kept
+ * in the VM for mips_vm_last_error. A VM must not be used by two threads at once. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define MIPS_VM_API __attribute__((visibility("default")))
+#else
+#define MIPS_VM_API
+#endif
+
+typedef struct mips_vm mips_vm;
+
+typedef enum mips_status {
+    MIPS_OK = 0,
+    MIPS_HALTED = 1,       /* the guest executed the exit trap */
+    MIPS_STEP_LIMIT = 2,   /* the step budget ran out, run again to continue */
+    MIPS_ERROR = -1        /* guest fault or bad call, see mips_vm_last_error */
+} mips_status;
+
+/* guest output, called from inside mips_vm_run */
+typedef void (*mips_output_callback)(void* user_data, const char* data, size_t size);
+
+/* fills up to capacity bytes of guest input, returns the count, 0 = end of input */
+typedef size_t (*mips_input_callback)(void* user_data, char* buffer, size_t capacity);
+
+MIPS_VM_API mips_vm* mips_vm_create(void);
+MIPS_VM_API void mips_vm_destroy(mips_vm* vm);
+
+/* the message of the last failed call, empty if none */
+MIPS_VM_API const char* mips_vm_last_error(const mips_vm* vm);
+
+/* load a program and reset the VM to its main label, the stack pointer at the top of memory */
+MIPS_VM_API mips_status mips_vm_load_assembly(mips_vm* vm, const char* text, size_t length);
+MIPS_VM_API mips_status mips_vm_load_binary(mips_vm* vm, const void* data, size_t size); /* BinaryFormat bytes */
+
+/* restarts the loaded program with fresh memory and registers, callbacks are kept */
+MIPS_VM_API mips_status mips_vm_reset(mips_vm* vm);
+
+/* runs until the guest halts, faults or has executed max_steps instructions (0 = no
+ * limit); the instructions executed by this call are stored in *steps if not NULL */
+MIPS_VM_API mips_status mips_vm_run(mips_vm* vm, uint64_t max_steps, uint64_t* steps);
+
+/* NULL callbacks restore stdout / stdin */
+MIPS_VM_API void mips_vm_set_output(mips_vm* vm, mips_output_callback callback, void* user_data);
+MIPS_VM_API void mips_vm_set_input(mips_vm* vm, mips_input_callback callback, void* user_data);
+
+/* registers 0-31 */
+MIPS_VM_API uint32_t mips_vm_get_register(const mips_vm* vm, unsigned index);
+MIPS_VM_API void mips_vm_set_register(mips_vm* vm, unsigned index, uint32_t value);
+MIPS_VM_API uint32_t mips_vm_get_pc(const mips_vm* vm);
+MIPS_VM_API void mips_vm_set_pc(mips_vm* vm, uint32_t pc);
+
+/* copies between guest memory and a host buffer */
+MIPS_VM_API mips_status mips_vm_read(const mips_vm* vm, uint32_t address, void* buffer, size_t size);
+MIPS_VM_API mips_status mips_vm_write(mips_vm* vm, uint32_t address, const void* data, size_t size);
+
+/* contiguous host view of [address, address + size), both page aligned (4096). the guest
+ * and the caller see each other's writes directly, no copies. one range per VM, mapping
+ * another replaces it; the pointer is valid until the next map, load, reset or destroy */
+MIPS_VM_API uint8_t* mips_vm_map_memory(mips_vm* vm, uint32_t address, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MIPS_VM_H */
@@ -0,0 +1,71 @@
+#include "program_cache.h"
+
+namespace mips {
+
+ProgramCache::ProgramCache(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), hits_(0), misses_(0) {
+}
+
+uint64_t ProgramCache::hash(Kind kind, const std::string& content) {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    value = (value ^ static_cast<uint8_t>(kind)) * 0x100000001b3ULL;
+    for (unsigned char c : content) {
+        value = (value ^ c) * 0x100000001b3ULL;
+    }
+    return value;
+}
+
+std::shared_ptr<const ProgramImage> ProgramCache::get(Kind kind, const std::string& content) {
+    uint64_t key = hash(kind, content);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second.kind == kind && it->second.content == content) {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+            hits_++;
+            return it->second.image;
+        }
+        misses_++;
+    }
+    
+    // built outside the lock, two threads missing on the same program both build it
+    auto image = build(kind, content);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        lru_.erase(it->second.lru_position);
+        entries_.erase(it);
+    }
+    while (entries_.size() >= capacity_) {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{kind, content, image, lru_.begin()});
+    return image;
+}
+
+std::shared_ptr<const ProgramImage> ProgramCache::build(Kind kind, const std::string& content) {
+    if (kind == Kind::BINARY) {
+        return ProgramImage::from_binary(reinterpret_cast<const uint8_t*>(content.data()), content.size());
+    }
+    return ProgramImage::assemble(content);
+}
+
+size_t ProgramCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+uint64_t ProgramCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t ProgramCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+} // namespace mips
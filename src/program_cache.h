@@ -0,0 +1,53 @@
+#pragma once
+
+#include "program_image.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mips {
+
+// thread-safe cache of built program images keyed by a hash of their source, so a
+// program submitted again skips the assembler (or binary parser) entirely. the least
+// recently used entries are dropped once capacity is reached
+class ProgramCache {
+public:
+    enum class Kind { ASSEMBLY, BINARY };
+    
+    explicit ProgramCache(size_t capacity = 256);
+    
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+    
+    // assembly text or BinaryFormat bytes, throws std::runtime_error with the
+    // assembler's messages if the program does not build
+    std::shared_ptr<const ProgramImage> get(Kind kind, const std::string& content);
+    
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+    
+    static uint64_t hash(Kind kind, const std::string& content); // 64-bit FNV-1a
+
+private:
+    struct Entry {
+        Kind kind;
+        std::string content; // compared on lookup, a hash collision is a miss
+        std::shared_ptr<const ProgramImage> image;
+        std::list<uint64_t>::iterator lru_position;
+    };
+    
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::list<uint64_t> lru_; // most recently used first
+    size_t capacity_;
+    uint64_t hits_;
+    uint64_t misses_;
+    
+    static std::shared_ptr<const ProgramImage> build(Kind kind, const std::string& content);
+};
+
+} // namespace mips
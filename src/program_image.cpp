@@ -0,0 +1,93 @@
+#include "program_image.h"
+#include "assembler.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace mips {
+
+ProgramImage::ProgramImage(const std::vector<uint8_t>& data, uint32_t main_address, uint32_t base_address)
+    : main_address_(main_address), first_page_(base_address / PAGE_SIZE),
+      num_pages_(static_cast<uint32_t>((data.size() + PAGE_SIZE - 1) / PAGE_SIZE)), size_(data.size()) {
+    if (base_address % PAGE_SIZE != 0) {
+        throw std::invalid_argument("Program image base address must be page aligned");
+    }
+    if (static_cast<uint64_t>(base_address) + data.size() > MachineState::MEMORY_SIZE) {
+        throw std::out_of_range("Program image too large for memory");
+    }
+    pages_ = std::make_unique<uint8_t[]>(static_cast<size_t>(num_pages_) * PAGE_SIZE); // zero padded
+    if (!data.empty()) {
+        std::memcpy(pages_.get(), data.data(), data.size());
+    }
+    slots_.resize(num_pages_);
+    std::iota(slots_.begin(), slots_.end(), 0);
+}
+
+ProgramImage::ProgramImage(const SparseBinary& binary, uint32_t main_address, uint32_t base_address)
+    : main_address_(main_address), first_page_(base_address / PAGE_SIZE),
+      num_pages_(static_cast<uint32_t>((static_cast<uint64_t>(binary.size) + PAGE_SIZE - 1) / PAGE_SIZE)),
+      size_(binary.size) {
+    if (base_address % PAGE_SIZE != 0) {
+        throw std::invalid_argument("Program image base address must be page aligned");
+    }
+    if (static_cast<uint64_t>(base_address) + binary.size > MachineState::MEMORY_SIZE) {
+        throw std::out_of_range("Program image too large for memory");
+    }
+    
+    // only pages that hold data get storage, the guest sees zeros elsewhere
+    slots_.assign(num_pages_, NO_PAGE);
+    uint32_t num_stored = 0;
+    binary.for_each_data_run([&](uint32_t address, const uint8_t*, uint32_t count) {
+        for (uint32_t page = address / PAGE_SIZE; page <= (address + count - 1) / PAGE_SIZE; ++page) {
+            if (slots_[page] == NO_PAGE) {
+                slots_[page] = num_stored++;
+            }
+        }
+    });
+    pages_ = std::make_unique<uint8_t[]>(static_cast<size_t>(num_stored) * PAGE_SIZE);
+    binary.for_each_data_run([&](uint32_t address, const uint8_t* bytes, uint32_t count) {
+        while (count > 0) {
+            uint32_t offset = address % PAGE_SIZE;
+            uint32_t chunk = std::min<uint32_t>(count, PAGE_SIZE - offset);
+            std::memcpy(pages_.get() + static_cast<size_t>(slots_[address / PAGE_SIZE]) * PAGE_SIZE + offset, bytes, chunk);
+            address += chunk;
+            bytes += chunk;
+            count -= chunk;
+        }
+    });
+}
+
+std::shared_ptr<const ProgramImage> ProgramImage::load_file(const std::string& filename) {
+    uint32_t main_address;
+    auto binary = BinaryFormat::read_sparse_file(filename, main_address);
+    return std::make_shared<const ProgramImage>(binary, main_address);
+}
+
+std::shared_ptr<const ProgramImage> ProgramImage::from_binary(const uint8_t* data, size_t size) {
+    // check the header first, read_binary trusts the size field of a dense binary
+    uint32_t size_field = size < 8 ? 0 : data[4] | data[5] << 8 | data[6] << 16 | static_cast<uint32_t>(data[7]) << 24;
+    if (size < 8 || (size_field != BinaryFormat::SPARSE_MARKER && size_field != size - 8)) {
+        throw std::runtime_error("Malformed binary: size does not match header");
+    }
+    std::istringstream input(std::string(reinterpret_cast<const char*>(data), size));
+    uint32_t main_address;
+    auto binary = BinaryFormat::read_sparse(input, main_address);
+    return std::make_shared<const ProgramImage>(binary, main_address);
+}
+
+std::shared_ptr<const ProgramImage> ProgramImage::assemble(const std::string& text) {
+    Assembler assembler;
+    auto data = assembler.assemble_text(text);
+    if (assembler.has_errors()) {
+        std::string message = "Assembly failed";
+        for (const auto& error : assembler.get_errors()) {
+            message += "\n" + error;
+        }
+        throw std::runtime_error(message);
+    }
+    return std::make_shared<const ProgramImage>(data, assembler.get_main_address());
+}
+
+} // namespace mips
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mips_core.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mips {
+
+struct SparseBinary;
+
+// code and static data of a binary, built once and mapped read-only into any number
+// of MachineStates (see MachineState::map_image), a guest's first write to one of its
+// pages gives that guest a private copy
+class ProgramImage {
+public:
+    static constexpr size_t PAGE_SIZE = MachineState::PAGE_SIZE;
+    
+    // base_address must be page aligned
+    ProgramImage(const std::vector<uint8_t>& data, uint32_t main_address, uint32_t base_address = 0);
+    ProgramImage(const SparseBinary& binary, uint32_t main_address, uint32_t base_address = 0); // zero pages not stored
+    
+    // reads a BinaryFormat file
+    static std::shared_ptr<const ProgramImage> load_file(const std::string& filename);
+    
+    // BinaryFormat bytes already in memory, the header is checked against size
+    static std::shared_ptr<const ProgramImage> from_binary(const uint8_t* data, size_t size);
+    
+    // throws std::runtime_error carrying the assembler's messages
+    static std::shared_ptr<const ProgramImage> assemble(const std::string& text);
+    
+    uint32_t main_address() const { return main_address_; }
+    uint32_t base_address() const { return first_page_ * static_cast<uint32_t>(PAGE_SIZE); }
+    size_t size() const { return size_; }
+    size_t num_pages() const { return num_pages_; }
+    
+    // contents of a guest page, null outside the image and for pages that are all zero
+    const uint8_t* page_data(uint32_t page_index) const {
+        uint32_t relative = page_index - first_page_;
+        return relative < num_pages_ && slots_[relative] != NO_PAGE
+            ? pages_.get() + static_cast<size_t>(slots_[relative]) * PAGE_SIZE : nullptr;
+    }
+
+private:
+    static constexpr uint32_t NO_PAGE = 0xFFFFFFFF;
+    
+    std::unique_ptr<uint8_t[]> pages_; // whole pages, zero padded
+    std::vector<uint32_t> slots_;      // image page -> page in pages_, NO_PAGE if all zero
+    uint32_t main_address_;
+    uint32_t first_page_;
+    uint32_t num_pages_;
+    size_t size_;
+};
+
+} // namespace mips
@@ -0,0 +1,93 @@
+#include "replay.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace mips {
+
+namespace {
+
+// the get position of a stream, also valid after it has hit eof
+std::streamoff input_position(std::istream& input) {
+    return input.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in);
+}
+
+} // namespace
+
+CheckpointReplay::CheckpointReplay(uint64_t interval) : interval_(interval) {
+    if (interval == 0) {
+        throw std::invalid_argument("Checkpoint interval must be positive");
+    }
+}
+
+StopReason CheckpointReplay::record(CPU& cpu, const std::string& input, uint64_t max_instructions) {
+    input_ = input;
+    output_.clear();
+    checkpoints_.clear();
+    
+    MachineState& state = cpu.get_state();
+    std::istringstream input_stream(input_);
+    std::ostringstream output_stream;
+    std::istream* saved_input = state.input_stream;
+    std::ostream* saved_output = state.output_stream;
+    bool saved_blocking = cpu.has_blocking_input();
+    state.input_stream = &input_stream;
+    state.output_stream = &output_stream;
+    cpu.set_blocking_input(true); // all input is known, never park
+    
+    uint64_t start = cpu.instruction_count();
+    StopReason reason = StopReason::BUDGET_EXHAUSTED;
+    while (reason == StopReason::BUDGET_EXHAUSTED && !cpu.is_halted()) {
+        uint64_t executed = cpu.instruction_count() - start;
+        uint64_t budget = interval_;
+        if (max_instructions > 0) {
+            if (executed >= max_instructions) break;
+            budget = std::min(budget, max_instructions - executed);
+        }
+        checkpoints_.push_back(Checkpoint{state.clone(), executed, 0, input_position(input_stream)});
+        reason = cpu.run(budget);
+        checkpoints_.back().instructions = cpu.instruction_count() - start - executed;
+    }
+    if (cpu.is_halted()) {
+        reason = StopReason::HALTED;
+    }
+    
+    output_ = output_stream.str();
+    state.input_stream = saved_input;
+    state.output_stream = saved_output;
+    cpu.set_blocking_input(saved_blocking);
+    return reason;
+}
+
+std::vector<ReplayInterval> CheckpointReplay::replay(const IntervalAnalysis& analysis, ThreadPool& pool) const {
+    std::vector<ReplayInterval> results(checkpoints_.size());
+    for (size_t i = 0; i < checkpoints_.size(); ++i) {
+        pool.submit([this, &analysis, &results, i] {
+            const Checkpoint& checkpoint = checkpoints_[i];
+            ReplayInterval& result = results[i];
+            result.first_instruction = checkpoint.first_instruction;
+            result.instructions = checkpoint.instructions;
+            
+            std::istringstream input(input_);
+            input.rdbuf()->pubseekpos(checkpoint.input_position, std::ios::in);
+            std::ostringstream output;
+            try {
+                CPU cpu;
+                cpu.get_state() = checkpoint.state.clone();
+                cpu.get_state().input_stream = &input;
+                cpu.get_state().output_stream = &output;
+                analysis(i, cpu, checkpoint.instructions);
+                if (cpu.instruction_count() != checkpoint.instructions) {
+                    result.error = "Replay executed " + std::to_string(cpu.instruction_count()) +
+                                   " instructions, recorded " + std::to_string(checkpoint.instructions);
+                }
+            } catch (const std::exception& e) {
+                result.error = e.what();
+            }
+            result.output = output.str();
+        });
+    }
+    pool.wait_idle();
+    return results;
+}
+
+} // namespace mips
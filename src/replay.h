@@ -0,0 +1,60 @@
+#pragma once
+
+#include "mips_core.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mips {
+
+// one checkpointed interval of a recorded run
+struct ReplayInterval {
+    uint64_t first_instruction = 0;
+    uint64_t instructions = 0;   // length of the interval in the recorded run
+    std::string output;          // guest output of the interval when replayed
+    std::string error;           // the replay faulted, or executed a different number of instructions
+};
+
+// detailed pass over one interval: gets the interval's index and a CPU restored from its
+// checkpoint, and must execute the given number of instructions on it (typically step by
+// step while tracing or profiling). called from pool threads, results are best written
+// to a slot per interval index so no locking is needed
+using IntervalAnalysis = std::function<void(size_t interval, CPU& cpu, uint64_t instructions)>;
+
+// checkpoint-parallel execution of long deterministic runs: record() runs the guest at
+// full speed and clones its MachineState every interval instructions, replay() then
+// re-runs every interval from its checkpoint concurrently and returns them in program
+// order. guests must be single-hart and use only the builtin traps, input is fixed up
+// front and an ll/sc pair split by a checkpoint fails its sc on replay. each checkpoint
+// holds a copy of the guest's private pages
+class CheckpointReplay {
+public:
+    explicit CheckpointReplay(uint64_t interval);
+    
+    // fast pass over a CPU with its program loaded, until it halts, faults or has run
+    // max_instructions (0 = no limit); input is the guest's whole input
+    StopReason record(CPU& cpu, const std::string& input, uint64_t max_instructions = 0);
+    
+    const std::string& output() const { return output_; } // guest output of the fast pass
+    size_t num_intervals() const { return checkpoints_.size(); }
+    uint64_t interval() const { return interval_; }
+    
+    std::vector<ReplayInterval> replay(const IntervalAnalysis& analysis, ThreadPool& pool) const;
+
+private:
+    struct Checkpoint {
+        MachineState state;
+        uint64_t first_instruction;
+        uint64_t instructions;
+        std::streamoff input_position;
+    };
+    
+    uint64_t interval_;
+    std::string input_;
+    std::string output_;
+    std::vector<Checkpoint> checkpoints_;
+};
+
+} // namespace mips
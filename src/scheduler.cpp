@@ -0,0 +1,202 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mips {
+
+Scheduler::Scheduler(size_t num_workers, uint64_t quantum)
+    : quantum_(quantum), work_epoch_(0), idle_workers_(0), runnable_(0), next_worker_(0), stop_(false) {
+    if (num_workers == 0) {
+        num_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    // start threads only once every deque exists, workers steal from each other
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers_[i]->thread = std::thread(&Scheduler::worker_loop, this, i);
+    }
+}
+
+Scheduler::~Scheduler() {
+    stop_.store(true);
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        work_cv_.notify_all();
+    }
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+size_t Scheduler::add_guest(const std::vector<uint8_t>& binary, uint32_t main_address, const std::string& input) {
+    return add_guest(std::make_shared<const ProgramImage>(binary, main_address), input);
+}
+
+size_t Scheduler::add_guest(std::shared_ptr<const ProgramImage> image, const std::string& input) {
+    auto guest = std::make_unique<Guest>(std::move(image));
+    guest->session.provide_input(input);
+    
+    Guest* raw = guest.get();
+    {
+        std::lock_guard<std::mutex> lock(guests_mutex_);
+        raw->id = guests_.size();
+        guests_.push_back(std::move(guest));
+    }
+    runnable_++;
+    enqueue(raw);
+    return raw->id;
+}
+
+void Scheduler::provide_input(size_t guest_id, const std::string& text) {
+    Guest& guest = find_guest(guest_id);
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(guest.mutex);
+        guest.pending_input += text;
+        if (guest.state == GuestState::PARKED) {
+            guest.state = GuestState::RUNNABLE;
+            wake = true;
+        }
+    }
+    if (wake) {
+        runnable_++;
+        enqueue(&guest);
+    }
+}
+
+void Scheduler::wait(size_t guest_id) {
+    Guest& guest = find_guest(guest_id);
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    done_cv_.wait(lock, [&guest] {
+        std::lock_guard<std::mutex> guest_lock(guest.mutex);
+        return guest.state != GuestState::RUNNABLE;
+    });
+}
+
+void Scheduler::wait_all() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    done_cv_.wait(lock, [this] { return runnable_.load() == 0; });
+}
+
+GuestStatus Scheduler::get_status(size_t guest_id) {
+    Guest& guest = find_guest(guest_id);
+    std::lock_guard<std::mutex> lock(guest.mutex);
+    if (guest.state == GuestState::RUNNABLE) {
+        // the guest may be running right now, only the state is safe to read
+        return {guest.state, 0, "", ""};
+    }
+    return {guest.state, guest.session.instructions(), guest.session.output(), guest.session.error()};
+}
+
+Scheduler::Guest& Scheduler::find_guest(size_t guest_id) {
+    std::lock_guard<std::mutex> lock(guests_mutex_);
+    if (guest_id >= guests_.size()) {
+        throw std::out_of_range("Unknown guest id: " + std::to_string(guest_id));
+    }
+    return *guests_[guest_id];
+}
+
+void Scheduler::enqueue(Guest* guest) {
+    // spread new and woken guests round-robin, stealing evens out the rest
+    Worker& worker = *workers_[next_worker_++ % workers_.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(guest);
+    }
+    signal_work();
+}
+
+void Scheduler::signal_work() {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    work_epoch_++;
+    if (idle_workers_ > 0) {
+        work_cv_.notify_one();
+    }
+}
+
+Scheduler::Guest* Scheduler::next_guest(size_t index) {
+    // own queue first (front, so guests rotate round-robin) ...
+    {
+        Worker& own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            Guest* guest = own.queue.front();
+            own.queue.pop_front();
+            return guest;
+        }
+    }
+    // ... then steal from the back of the others
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            Guest* guest = victim.queue.back();
+            victim.queue.pop_back();
+            return guest;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::worker_loop(size_t index) {
+    Worker& own = *workers_[index];
+    
+    while (!stop_.load()) {
+        // read before looking, anything queued after the deques were seen empty changes it
+        uint64_t seen = work_epoch_.load();
+        Guest* guest = next_guest(index);
+        if (!guest) {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            idle_workers_++;
+            work_cv_.wait(lock, [this, seen] { return stop_.load() || work_epoch_.load() != seen; });
+            idle_workers_--;
+            continue;
+        }
+        
+        SessionState result = run_quantum(*guest);
+        
+        std::unique_lock<std::mutex> guest_lock(guest->mutex);
+        if (result == SessionState::FAULTED) {
+            guest->state = GuestState::FAULTED;
+        } else if (result == SessionState::HALTED) {
+            guest->state = GuestState::HALTED;
+        } else if (result == SessionState::NEEDS_INPUT && guest->pending_input.empty()) {
+            guest->state = GuestState::PARKED; // provide_input() re-queues it
+        } else {
+            // quantum used up (or input already arrived): back to the tail
+            guest_lock.unlock();
+            bool shared;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.queue.push_back(guest);
+                shared = own.queue.size() > 1;
+            }
+            if (shared) {
+                signal_work(); // more than this worker runs next, an idle one can steal
+            }
+            continue;
+        }
+        guest_lock.unlock();
+        runnable_--;
+        notify_done();
+    }
+}
+
+SessionState Scheduler::run_quantum(Guest& guest) {
+    {
+        std::lock_guard<std::mutex> lock(guest.mutex);
+        if (!guest.pending_input.empty()) {
+            guest.session.provide_input(guest.pending_input);
+            guest.pending_input.clear();
+        }
+    }
+    return guest.session.resume(quantum_);
+}
+
+void Scheduler::notify_done() {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    done_cv_.notify_all();
+}
+
+} // namespace mips
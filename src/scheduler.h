@@ -0,0 +1,103 @@
+#pragma once
+
+#include "mips_core.h"
+#include "guest_session.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mips {
+
+enum class GuestState {
+    RUNNABLE,   // queued or running
+    PARKED,     // waiting for input
+    HALTED,
+    FAULTED
+};
+
+// result view of a hosted guest
+struct GuestStatus {
+    GuestState state;
+    uint64_t instructions;
+    std::string output;
+    std::string error;
+};
+
+// runs many guests time-sliced over a few host threads, each guest gets a fixed
+// instruction quantum before it goes back to the tail of a per-worker deque;
+// idle workers steal from the other deques
+class Scheduler {
+public:
+    static constexpr uint64_t DEFAULT_QUANTUM = 10000;
+    
+    // 0 workers = one per hardware thread
+    explicit Scheduler(size_t num_workers = 0, uint64_t quantum = DEFAULT_QUANTUM);
+    ~Scheduler(); // stops the workers, unfinished guests are abandoned
+    
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+    
+    // returns the guest id, guests started from one image share its pages
+    size_t add_guest(const std::vector<uint8_t>& binary, uint32_t main_address, const std::string& input = "");
+    size_t add_guest(std::shared_ptr<const ProgramImage> image, const std::string& input = "");
+    
+    // appends input and wakes the guest if it is parked on an input trap
+    void provide_input(size_t guest_id, const std::string& text);
+    
+    // blocks until the guest has halted, faulted or parked
+    void wait(size_t guest_id);
+    // blocks until no guest is runnable
+    void wait_all();
+    
+    GuestStatus get_status(size_t guest_id);
+    size_t num_workers() const { return workers_.size(); }
+    
+private:
+    struct Guest {
+        explicit Guest(std::shared_ptr<const ProgramImage> image) : session(std::move(image)) {}
+        
+        size_t id;
+        GuestSession session; // only touched by the worker running the guest
+        
+        std::mutex mutex; // guards state and pending_input
+        GuestState state = GuestState::RUNNABLE;
+        std::string pending_input;
+    };
+    
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Guest*> queue;
+        std::thread thread;
+    };
+    
+    uint64_t quantum_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex guests_mutex_;
+    std::vector<std::unique_ptr<Guest>> guests_;
+    
+    // idle workers and waiters sleep on these; work_epoch_ counts queued guests so a worker
+    // that found every deque empty cannot miss one queued before it went to sleep
+    std::mutex wake_mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::atomic<uint64_t> work_epoch_; // changed under wake_mutex_
+    size_t idle_workers_;              // guarded by wake_mutex_
+    std::atomic<size_t> runnable_;
+    std::atomic<size_t> next_worker_;
+    std::atomic<bool> stop_;
+    
+    void worker_loop(size_t index);
+    Guest* next_guest(size_t index);
+    SessionState run_quantum(Guest& guest);
+    void enqueue(Guest* guest);
+    void signal_work();
+    Guest& find_guest(size_t guest_id);
+    void notify_done();
+};
+
+} // namespace mips
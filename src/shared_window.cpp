@@ -0,0 +1,92 @@
+#include "shared_window.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mips {
+
+namespace {
+
+// header fields are stored little-endian like the guest bytes, whatever the host order
+uint32_t little_endian(uint32_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+uint16_t little_endian(uint16_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap16(value);
+#else
+    return value;
+#endif
+}
+
+} // namespace
+
+SharedWindow::SharedWindow(const std::string& name, uint32_t guest_base, uint32_t size, uint32_t page_size)
+    : name_(name), guest_base_(guest_base), size_(size), fd_(-1), mapping_(nullptr), mapping_size_(0) {
+    mapping_size_ = HEADER_SIZE + static_cast<size_t>(size);
+    if (name.empty()) {
+        mapping_ = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping_ == MAP_FAILED) {
+            throw std::runtime_error(std::string("mmap failed for an anonymous window: ") + std::strerror(errno));
+        }
+        write_header(page_size);
+        return;
+    }
+    if (name[0] != '/') {
+        throw std::invalid_argument("Shared window name must start with '/': " + name);
+    }
+    
+    // never truncate an object someone else may have mapped, its readers would fault
+    fd_ = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd_ < 0 && errno == EEXIST) {
+        throw std::runtime_error("Shared window name already in use: " + name);
+    }
+    if (fd_ < 0) {
+        throw std::runtime_error("shm_open failed for " + name + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd_, static_cast<off_t>(mapping_size_)) != 0) {
+        int error = errno;
+        close(fd_);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("ftruncate failed for " + name + ": " + std::strerror(error));
+    }
+    mapping_ = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping_ == MAP_FAILED) {
+        int error = errno;
+        close(fd_);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("mmap failed for " + name + ": " + std::strerror(error));
+    }
+    
+    write_header(page_size);
+}
+
+SharedWindow::~SharedWindow() {
+    munmap(mapping_, mapping_size_);
+    if (fd_ >= 0) {
+        close(fd_);
+        shm_unlink(name_.c_str());
+    }
+}
+
+void SharedWindow::write_header(uint32_t page_size) {
+    // the object is fresh and zero-filled, only the header needs writing
+    auto* header = static_cast<SharedWindowHeader*>(mapping_);
+    header->magic = little_endian(SHARED_WINDOW_MAGIC);
+    header->version = little_endian(SHARED_WINDOW_VERSION);
+    header->header_size = little_endian(static_cast<uint16_t>(HEADER_SIZE));
+    header->guest_base = little_endian(guest_base_);
+    header->size = little_endian(size_);
+    header->page_size = little_endian(page_size);
+}
+
+} // namespace mips
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace mips {
+
+// Layout of a shared window object (e.g. /dev/shm/<name>):
+//
+//   offset 0          SharedWindowHeader, padded to header_size bytes (one page)
+//   offset header_size guest bytes [guest_base, guest_base + size)
+//
+// External processes shm_open() + mmap() the object, check magic/version and read
+// or write the guest range in place while the guest runs. All fields are little-endian
+// on every host, as are the guest's words.
+struct SharedWindowHeader {
+    uint32_t magic;        // SHARED_WINDOW_MAGIC
+    uint16_t version;      // SHARED_WINDOW_VERSION
+    uint16_t header_size;  // offset of the first guest byte
+    uint32_t guest_base;   // guest address of the first guest byte
+    uint32_t size;         // number of guest bytes, a multiple of the page size
+    uint32_t page_size;    // guest page size
+    uint32_t reserved[3];
+};
+
+static constexpr uint32_t SHARED_WINDOW_MAGIC = 0x5350494D; // "MIPS"
+static constexpr uint16_t SHARED_WINDOW_VERSION = 1;
+
+// POSIX shared memory object backing a guest address range, or anonymous shared memory
+// when only this process needs the window
+class SharedWindow {
+public:
+    static constexpr size_t HEADER_SIZE = 4096;
+    
+    // creates the object, name must start with '/' and must not exist yet (an object in
+    // use by another interpreter is never replaced); an empty name maps anonymous memory,
+    // nothing is created in /dev/shm and nothing outlives the process
+    SharedWindow(const std::string& name, uint32_t guest_base, uint32_t size, uint32_t page_size);
+    ~SharedWindow(); // unmaps and unlinks the object
+    
+    SharedWindow(const SharedWindow&) = delete;
+    SharedWindow& operator=(const SharedWindow&) = delete;
+    
+    const std::string& name() const { return name_; } // empty if anonymous
+    uint32_t guest_base() const { return guest_base_; }
+    uint32_t size() const { return size_; }
+    
+    // first guest byte of the window
+    uint8_t* data() { return static_cast<uint8_t*>(mapping_) + HEADER_SIZE; }
+    const SharedWindowHeader& header() const { return *static_cast<const SharedWindowHeader*>(mapping_); } // little-endian
+    
+    bool contains(uint32_t address) const {
+        return address >= guest_base_ && static_cast<uint64_t>(address) < static_cast<uint64_t>(guest_base_) + size_;
+    }
+    
+private:
+    std::string name_;
+    uint32_t guest_base_;
+    uint32_t size_;
+    int fd_;
+    void* mapping_;
+    size_t mapping_size_;
+    
+    void write_header(uint32_t page_size);
+};
+
+} // namespace mips
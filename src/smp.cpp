@@ -0,0 +1,129 @@
+#include "smp.h"
+#include <stdexcept>
+#include <string>
+
+namespace mips {
+
+SmpMachine::SmpMachine(CPU& boot_hart, size_t max_harts)
+    : boot_(boot_hart), max_harts_(max_harts), boot_finished_(false), stopping_(false) {
+    if (max_harts == 0) {
+        throw std::invalid_argument("SMP machine needs at least one hart");
+    }
+    boot_.register_syscall(static_cast<uint32_t>(TrapCode::HART_SPAWN), [this](CPU& cpu, MachineState& state) {
+        uint32_t id = spawn(cpu, state.get_register(Register::A0), state.get_register(Register::A1),
+                            state.get_register(Register::A2));
+        state.set_register(Register::V0, id);
+    });
+    boot_.register_syscall(static_cast<uint32_t>(TrapCode::HART_JOIN), [this](CPU& cpu, MachineState& state) {
+        uint32_t id = state.get_register(Register::A0);
+        if (id == cpu.get_hart_id()) {
+            throw std::runtime_error("Hart " + std::to_string(id) + " cannot join itself");
+        }
+        join(id);
+    });
+}
+
+SmpMachine::~SmpMachine() {
+    stop_all();
+    boot_.unregister_syscall(static_cast<uint32_t>(TrapCode::HART_SPAWN));
+    boot_.unregister_syscall(static_cast<uint32_t>(TrapCode::HART_JOIN));
+}
+
+void SmpMachine::run() {
+    std::exception_ptr fault;
+    try {
+        boot_.run();
+    } catch (...) {
+        fault = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        boot_finished_ = true;
+    }
+    finished_cv_.notify_all();
+    
+    stop_all();
+    if (!fault) {
+        for (const auto& hart : harts_) {
+            if (hart->fault) {
+                fault = hart->fault;
+                break;
+            }
+        }
+    }
+    if (fault) {
+        std::rethrow_exception(fault);
+    }
+}
+
+uint32_t SmpMachine::spawn(const CPU& parent, uint32_t entry, uint32_t stack, uint32_t argument) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || harts_.size() + 1 >= max_harts_) {
+        return SPAWN_FAILED;
+    }
+    uint32_t id = static_cast<uint32_t>(harts_.size() + 1);
+    auto hart = std::make_unique<Hart>();
+    hart->cpu = std::make_unique<CPU>(parent, id);
+    MachineState& state = hart->cpu->get_state();
+    state.set_pc(entry);
+    state.set_register(Register::SP, stack);
+    state.set_register(Register::A0, argument);
+    
+    Hart& started = *hart;
+    harts_.push_back(std::move(hart));
+    started.thread = std::thread([this, &started] { run_hart(started); });
+    return id;
+}
+
+void SmpMachine::join(uint32_t hart_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (hart_id == 0) {
+        finished_cv_.wait(lock, [this] { return boot_finished_; });
+        return;
+    }
+    if (hart_id > harts_.size()) {
+        throw std::runtime_error("Join of unknown hart " + std::to_string(hart_id));
+    }
+    Hart& hart = *harts_[hart_id - 1];
+    finished_cv_.wait(lock, [&hart] { return hart.finished; });
+}
+
+size_t SmpMachine::num_harts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return harts_.size() + 1;
+}
+
+void SmpMachine::run_hart(Hart& hart) {
+    std::exception_ptr fault;
+    try {
+        hart.cpu->run();
+    } catch (...) {
+        fault = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hart.fault = fault;
+        hart.finished = true;
+    }
+    finished_cv_.notify_all();
+}
+
+void SmpMachine::stop_all() {
+    // no spawns once stopping, so the list below is final
+    std::vector<std::thread*> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& hart : harts_) {
+            hart->cpu->halt();
+            if (hart->thread.joinable()) {
+                threads.push_back(&hart->thread);
+            }
+        }
+    }
+    for (auto* thread : threads) {
+        thread->join();
+    }
+}
+
+} // namespace mips
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "mips_core.h"
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mips {
+
+// runs one guest on several harts, each a CPU on its own host thread sharing the boot
+// hart's memory and devices; attaching registers the spawn/join traps on the boot hart
+// (spawned harts inherit them with the rest of the syscall table)
+class SmpMachine {
+public:
+    static constexpr size_t DEFAULT_MAX_HARTS = 64;
+    static constexpr uint32_t SPAWN_FAILED = 0xFFFFFFFF;
+    
+    explicit SmpMachine(CPU& boot_hart, size_t max_harts = DEFAULT_MAX_HARTS);
+    ~SmpMachine(); // stops and joins every spawned hart
+    
+    SmpMachine(const SmpMachine&) = delete;
+    SmpMachine& operator=(const SmpMachine&) = delete;
+    
+    // runs the boot hart on the calling thread; once it halts the remaining harts are
+    // stopped and joined, the first fault of any hart is rethrown
+    void run();
+    
+    // new hart of the machine starting at entry with $sp = stack, $a0 = argument
+    uint32_t spawn(const CPU& parent, uint32_t entry, uint32_t stack, uint32_t argument);
+    void join(uint32_t hart_id); // blocks until that hart halts
+    
+    size_t num_harts() const; // including the boot hart
+    
+private:
+    struct Hart {
+        std::unique_ptr<CPU> cpu;
+        std::thread thread;
+        bool finished = false;
+        std::exception_ptr fault;
+    };
+    
+    CPU& boot_;
+    size_t max_harts_;
+    mutable std::mutex mutex_;
+    std::condition_variable finished_cv_;
+    std::vector<std::unique_ptr<Hart>> harts_; // hart id - 1
+    bool boot_finished_;
+    bool stopping_;
+    
+    void run_hart(Hart& hart);
+    void stop_all();
+};
+
+} // namespace mips
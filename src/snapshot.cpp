@@ -0,0 +1,56 @@
+#include "snapshot.h"
+#include "mips_core.h"
+
+namespace mips {
+
+// word layout: registers, pc, hi, lo, instruction count (lo, hi), resident pages (lo, hi)
+void SnapshotPublisher::publish(const CPU& cpu) {
+    const MachineState& state = cpu.get_state();
+    uint32_t values[NUM_WORDS];
+    for (size_t i = 0; i < 32; ++i) {
+        values[i] = state.get_register(static_cast<Register>(i));
+    }
+    values[32] = state.get_pc();
+    values[33] = state.get_hi();
+    values[34] = state.get_lo();
+    uint64_t count = cpu.instruction_count();
+    uint64_t pages = state.resident_pages();
+    values[35] = static_cast<uint32_t>(count);
+    values[36] = static_cast<uint32_t>(count >> 32);
+    values[37] = static_cast<uint32_t>(pages);
+    values[38] = static_cast<uint32_t>(pages >> 32);
+    
+    uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // odd sequence is visible before the data
+    for (size_t i = 0; i < NUM_WORDS; ++i) {
+        words_[i].store(values[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+CpuSnapshot SnapshotPublisher::read() const {
+    uint32_t values[NUM_WORDS];
+    while (true) {
+        uint64_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1) continue; // publish in progress
+        for (size_t i = 0; i < NUM_WORDS; ++i) {
+            values[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire); // data is read before the recheck
+        if (sequence_.load(std::memory_order_relaxed) == before) break;
+    }
+    
+    CpuSnapshot snapshot;
+    for (size_t i = 0; i < 32; ++i) {
+        snapshot.registers[i] = values[i];
+    }
+    snapshot.pc = values[32];
+    snapshot.hi = values[33];
+    snapshot.lo = values[34];
+    snapshot.instruction_count = values[35] | static_cast<uint64_t>(values[36]) << 32;
+    snapshot.resident_pages = values[37] | static_cast<uint64_t>(values[38]) << 32;
+    return snapshot;
+}
+
+} // namespace mips
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mips {
+
+class CPU;
+
+// architectural state of a CPU at one block boundary
+struct CpuSnapshot {
+    std::array<uint32_t, 32> registers{};
+    uint32_t pc = 0;
+    uint32_t hi = 0;
+    uint32_t lo = 0;
+    uint64_t instruction_count = 0;
+    uint64_t resident_pages = 0;
+};
+
+// seqlock holding the latest snapshot of one CPU. the executing thread publishes (see
+// CPU::set_snapshot_publisher), any number of monitoring threads read without taking
+// a lock or stopping the interpreter; a reader racing a publish simply retries
+class SnapshotPublisher {
+public:
+    SnapshotPublisher() = default;
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+    
+    // single writer
+    void publish(const CPU& cpu);
+    
+    // consistent copy of the latest publication
+    CpuSnapshot read() const;
+    
+    uint64_t publications() const { return sequence_.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr size_t NUM_WORDS = 32 + 3 + 2 * 2; // registers, pc/hi/lo, two 64-bit counters
+    
+    std::atomic<uint64_t> sequence_{0}; // odd while a publish is in progress
+    std::array<std::atomic<uint32_t>, NUM_WORDS> words_{};
+};
+
+} // namespace mips
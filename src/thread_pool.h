@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mips {
+
+// fixed-size pool of worker threads running queued tasks in FIFO order
+class ThreadPool {
+public:
+    // 0 threads = one per hardware thread
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool(); // finishes queued tasks, then joins
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    void submit(std::function<void()> task);
+    
+    // blocks until every submitted task has finished
+    void wait_idle();
+    
+    size_t size() const { return workers_.size(); }
+    
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_cv_;
+    std::condition_variable idle_cv_;
+    size_t active_;
+    bool stop_;
+    
+    void worker_loop();
+};
+
+} // namespace mips
@@ -1,6 +1,9 @@
 #include "catch2.hpp"
 #include "../src/assembler.h"
+#include "../src/asm_session.h"
+#include "../src/debugger.h"
 #include "../src/mips_core.h"
+#include <iostream>
 #include <stdexcept>
 #include <sstream>
 
@@ -101,3 +104,367 @@ main:
     REQUIRE_FALSE(assembler.has_errors());
     REQUIRE_EQ(binary.size(), 12); // 3 instructions * 4 bytes each
 }
+
+TEST_CASE("Assembler - Quoted strings and inline comments") {
+    mips::Assembler assembler;
+    
+    std::string program =
+        "main:   addi $t0,$zero,1   # comment, with \"quotes\"\r\n"
+        "    trap 5 # exit\n"
+        "text: .asciiz \"a, b # c\\n\\\"d\\\"\"\n"
+        "after: .byte 7\n";
+    
+    auto lines = assembler.parse_assembly(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE_EQ(lines.size(), 4);
+    REQUIRE_EQ(lines[0].label, "main");
+    REQUIRE_EQ(lines[0].operands.size(), 3);
+    REQUIRE_EQ(lines[0].operands[2], "1");
+    REQUIRE_EQ(lines[1].operands.size(), 1);
+    REQUIRE_EQ(lines[2].operands.size(), 1);
+    
+    // 12 decoded characters plus the terminator, the next label lands after all of them
+    auto binary = assembler.assemble(lines);
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE_EQ(binary.size(), 8 + 13 + 1);
+    std::string text(binary.begin() + 8, binary.begin() + 21);
+    REQUIRE_EQ(text, std::string("a, b # c\n\"d\"\0", 13));
+    REQUIRE_EQ(binary[21], 7);
+    
+    // an unterminated literal is reported with its line number
+    assembler.parse_assembly("main:\n    .asciiz \"open\n");
+    REQUIRE(assembler.has_errors());
+    REQUIRE(assembler.get_errors()[0].find("Line 2") != std::string::npos);
+}
+
+TEST_CASE("Assembler - Compact IR with interned symbols") {
+    mips::Assembler assembler;
+    
+    std::string program = R"(
+main:
+    beq $t0, $zero, done
+    lw $t1, value($zero)
+    addi $t2, $t1, -1
+    j main
+done:
+    trap 5
+value:
+    .word 0x10, done
+)";
+
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE_EQ(binary.size(), 28);
+    
+    const mips::IrProgram& ir = assembler.program();
+    REQUIRE_EQ(ir.lines.size(), 6);
+    REQUIRE_EQ(ir.operands.size(), 12);
+    REQUIRE_EQ(ir.end_address, 28);
+    
+    // every name is stored once, references and the definition share the id
+    REQUIRE_EQ(ir.symbols.size(), 3);
+    uint32_t done = ir.symbols.find("done");
+    REQUIRE(done != mips::SymbolTable::NONE);
+    REQUIRE(ir.symbols.defined(done));
+    REQUIRE_EQ(ir.symbols.address(done), 16);
+    REQUIRE(ir.operands[2].kind == mips::OperandKind::SYMBOL);
+    REQUIRE_EQ(ir.operands[2].value, done);
+    REQUIRE(ir.operands[4].kind == mips::OperandKind::MEMORY_SYMBOL);
+    REQUIRE(ir.operands[7].kind == mips::OperandKind::IMMEDIATE);
+    REQUIRE_EQ(ir.operands[7].value, 0xFFFFFFFF);
+    
+    // forward branch over 3 instructions, label offset, and the label in .word
+    REQUIRE_EQ(binary[0], 3);
+    REQUIRE_EQ(binary[4], 20);
+    REQUIRE_EQ(binary[20], 0x10);
+    REQUIRE_EQ(binary[24], 16);
+    
+    // same bytes through the string form
+    auto lines = assembler.parse_assembly(program);
+    REQUIRE(assembler.assemble(lines) == binary);
+}
+
+TEST_CASE("Assembler - Streaming assembly patches forward references") {
+    std::string program = R"(
+main:
+    beq $t0, $zero, done
+    blez $t1, done
+    lw $t1, value($zero)
+    llo $t2, value
+    jal done
+    .word done, value
+    .half value
+    .byte value, 0
+done:
+    trap 5
+value:
+    .word 7
+)";
+
+    mips::Assembler two_pass;
+    auto expected = two_pass.assemble_text(program);
+    REQUIRE_FALSE(two_pass.has_errors());
+    
+    mips::Assembler streaming;
+    std::istringstream input(program);
+    auto binary = streaming.assemble_stream(input);
+    REQUIRE_FALSE(streaming.has_errors());
+    REQUIRE(binary == expected);
+    REQUIRE_EQ(binary[0], 7); // forward branch over 28 bytes of code and data
+    
+    // lines split across tiny reads come out whole, the last one without its newline
+    std::istringstream text("first line\n\nsecond, longer line\nlast");
+    mips::StreamLineReader reader(text, 3);
+    std::vector<std::string> lines;
+    std::string_view line;
+    while (reader.next_line(line)) {
+        lines.emplace_back(line);
+    }
+    REQUIRE_EQ(lines.size(), 4);
+    REQUIRE_EQ(lines[2], "second, longer line");
+    REQUIRE_EQ(lines[3], "last");
+    
+    // references that are never defined are reported at the end, in source order
+    std::istringstream broken("main:\n    j nowhere\n    .word missing\n");
+    streaming.assemble_stream(broken);
+    REQUIRE_EQ(streaming.get_errors().size(), 2);
+    REQUIRE_EQ(streaming.get_errors()[0], "Line 2: Undefined label: nowhere");
+    REQUIRE_EQ(streaming.get_errors()[1], "Line 3: Invalid immediate value: missing");
+}
+
+TEST_CASE("Assembler - Parallel chunks match the serial assembler") {
+    // a few MB so the source is split, with references across chunk boundaries
+    std::string program = "main:\n    j last\n";
+    for (int i = 0; i < 60000; ++i) {
+        std::string n = std::to_string(i);
+        program += "l" + n + ": addi $t0, $t0, " + n + "\n";
+        program += "    beq $t0, $zero, l" + std::to_string((i * 7919) % 60000) + "\n";
+        program += "    .word l" + std::to_string(59999 - i) + ", 0x" + n + "\n";
+        program += "    .asciiz \"chunk text " + n + "\"\n";
+    }
+    program += "l5: bogus $t0\n"; // a redefinition across chunks, and an error near the end
+    program += "last: trap 5\n";
+    REQUIRE(program.size() > (2u << 20));
+    
+    mips::Assembler serial;
+    auto expected = serial.assemble_text(program);
+    
+    mips::Assembler parallel;
+    mips::ThreadPool pool(4);
+    auto binary = parallel.assemble_parallel(program, pool);
+    REQUIRE(binary == expected);
+    REQUIRE_EQ(parallel.get_main_address(), serial.get_main_address());
+    REQUIRE(parallel.get_errors() == serial.get_errors());
+    REQUIRE_EQ(parallel.get_errors().size(), 2u);
+    REQUIRE_EQ(parallel.get_errors()[0], "Line 240003: Duplicate label: l5");
+    REQUIRE_EQ(parallel.get_errors()[1], "Line 240003: Unknown instruction: bogus");
+    
+    // the single pass sees the same first definition
+    mips::Assembler streaming;
+    std::istringstream input(program);
+    REQUIRE(streaming.assemble_stream(input) == expected);
+    REQUIRE(streaming.get_errors() == serial.get_errors());
+}
+
+TEST_CASE("Assembler - A duplicate label is an error in every path") {
+    std::string program = "main: j L\nL: addi $t0, $t0, 1\n    beq $zero, $zero, L\n"
+                          "L: addi $t0, $t0, 2\n    trap 0\n";
+    mips::Assembler two_pass;
+    auto expected = two_pass.assemble_text(program);
+    REQUIRE(two_pass.get_errors() == std::vector<std::string>{"Line 4: Duplicate label: L"});
+    
+    mips::Assembler streaming;
+    std::istringstream input(program);
+    REQUIRE(streaming.assemble_stream(input) == expected);
+    REQUIRE(streaming.get_errors() == two_pass.get_errors());
+    
+    mips::Assembler parallel;
+    mips::ThreadPool pool(2);
+    REQUIRE(parallel.assemble_parallel(program, pool) == expected);
+    REQUIRE(parallel.get_errors() == two_pass.get_errors());
+    
+    mips::AssemblySession session;
+    session.load(program);
+    REQUIRE(session.binary() == expected);
+    REQUIRE(session.get_errors() == two_pass.get_errors());
+    session.replace_lines(3, 1, "M: addi $t0, $t0, 2\n");
+    REQUIRE_FALSE(session.has_errors());
+}
+
+TEST_CASE("Assembler - A program past the 32-bit address space is an error in every path") {
+    // the line that does not fit is dropped, the ones after it still assemble
+    std::string program = "main: trap 5\n    .space 0xFFFFFFFD\nend: .word end\n";
+    std::vector<std::string> errors{"Line 2: Program does not fit in the 32-bit address space"};
+    mips::Assembler two_pass;
+    auto expected = two_pass.assemble_text(program);
+    REQUIRE(two_pass.get_errors() == errors);
+    REQUIRE_EQ(expected.size(), 8u);
+    REQUIRE_EQ(expected[4], 4u);
+    
+    mips::Assembler streaming;
+    std::istringstream input(program);
+    REQUIRE(streaming.assemble_stream(input) == expected);
+    REQUIRE(streaming.get_errors() == errors);
+    
+    mips::Assembler parallel;
+    mips::ThreadPool pool(2);
+    REQUIRE(parallel.assemble_parallel(program, pool) == expected);
+    REQUIRE(parallel.get_errors() == errors);
+    
+    mips::AssemblySession session;
+    session.load(program);
+    REQUIRE(session.binary() == expected);
+    REQUIRE(session.get_errors() == errors);
+    session.replace_lines(1, 1, "    .space 16\n");
+    REQUIRE_FALSE(session.has_errors());
+    REQUIRE_EQ(session.binary().size(), 24u);
+    session.replace_lines(1, 1, "    .space 0xFFFFFFFD\n");
+    REQUIRE(session.binary() == expected);
+    REQUIRE(session.get_errors() == errors);
+    
+    // the sum of lines that fit on their own, kept sparse so nothing is allocated
+    mips::Assembler sparse;
+    std::istringstream large("main: trap 5\nbuf: .space 0xFFFFFFF0\nafter: .word 1, 2, 3, 4, 5, 6\n");
+    auto binary = sparse.assemble_sparse(large);
+    REQUIRE(sparse.get_errors() == std::vector<std::string>{"Line 3: Program does not fit in the 32-bit address space"});
+    REQUIRE_EQ(binary.size, 0xFFFFFFF4u);
+}
+
+TEST_CASE("Assembler - Concurrent assemblers share the instruction tables") {
+    // many small files at once, as mips-assemble does for a directory
+    std::vector<std::string> programs;
+    for (int i = 0; i < 32; ++i) {
+        std::string n = std::to_string(i);
+        programs.push_back("main: addi $t0, $zero, " + n + "\n    beq $t0, $zero, done\n    .word done\n"
+                           "    .asciiz \"file " + n + "\"\ndone: trap 5\n" + (i % 8 == 0 ? "    nosuch $t0\n" : ""));
+    }
+    std::vector<std::vector<uint8_t>> expected;
+    std::vector<std::vector<std::string>> expected_errors;
+    for (const auto& program : programs) {
+        mips::Assembler assembler;
+        expected.push_back(assembler.assemble_text(program));
+        expected_errors.push_back(assembler.get_errors());
+    }
+    
+    std::vector<std::vector<uint8_t>> binaries(programs.size());
+    std::vector<std::vector<std::string>> errors(programs.size());
+    mips::ThreadPool pool(4);
+    for (size_t i = 0; i < programs.size(); ++i) {
+        pool.submit([&, i] {
+            mips::Assembler assembler;
+            std::istringstream input(programs[i]);
+            binaries[i] = assembler.assemble_stream(input);
+            errors[i] = assembler.get_errors();
+        });
+    }
+    pool.wait_idle();
+    REQUIRE(binaries == expected);
+    REQUIRE(errors == expected_errors);
+    REQUIRE(errors[8] == std::vector<std::string>{"Line 6: Unknown instruction: nosuch"});
+}
+
+TEST_CASE("Assembler - Incremental session re-encodes only what an edit touches") {
+    std::vector<std::string> source = {"main: addi $t0, $zero, 1", "    j end"};
+    for (int i = 0; i < 200; ++i) {
+        std::string n = std::to_string(i);
+        source.push_back("l" + n + ": beq $t0, $zero, l" + std::to_string((i + 100) % 200));
+        source.push_back("    .word l" + std::to_string(199 - i) + ", " + n);
+    }
+    source.push_back("end: trap 10");
+    auto join = [&] {
+        std::string text;
+        for (const auto& line : source) {
+            text += line + "\n";
+        }
+        return text;
+    };
+    mips::AssemblySession session;
+    session.load(join());
+    auto check = [&] {
+        mips::Assembler full;
+        auto expected = full.assemble_text(join());
+        REQUIRE(session.binary() == expected);
+        REQUIRE_EQ(session.get_main_address(), full.get_main_address());
+        REQUIRE(session.get_errors() == full.get_errors());
+    };
+    check();
+    REQUIRE_EQ(session.lines_encoded(), 403);
+    
+    // same size: only the line itself
+    source[250] = "l124: bne $t1, $zero, l24";
+    session.update(join());
+    check();
+    REQUIRE_EQ(session.lines_encoded(), 1);
+    
+    // a line inserted near the end moves the last labels: their users and the branches
+    // that moved away from their targets, not the rest
+    source.insert(source.begin() + 380, "    addi $t2, $t2, 2");
+    session.update(join());
+    check();
+    REQUIRE(session.lines_encoded() < 100);
+    REQUIRE_EQ(session.last_edit().first, 380u);
+    REQUIRE_EQ(session.last_edit().count, 1u);
+    REQUIRE_EQ(session.last_edit().old_count, 0u);
+    
+    // errors come and go with the lines that cause them
+    source[10] = "l4: beq $t0, $zero, nowhere";
+    source.insert(source.begin() + 20, "    bogus $t0");
+    session.update(join());
+    check();
+    REQUIRE_EQ(session.get_errors().size(), 2);
+    source.push_back("nowhere: trap 5");
+    source.erase(source.begin() + 20);
+    session.update(join());
+    check();
+    REQUIRE_FALSE(session.has_errors());
+    
+    // explicit ranges, main moved
+    session.replace_lines(0, 1, "    addi $t0, $zero, 3\nmain: addi $t0, $zero, 1\n");
+    source[0] = "main: addi $t0, $zero, 1";
+    source.insert(source.begin(), "    addi $t0, $zero, 3");
+    check();
+    REQUIRE_EQ(session.get_main_address(), 4);
+    session.replace_lines(2, 3, "");
+    source.erase(source.begin() + 2, source.begin() + 5);
+    check();
+    REQUIRE_THROWS(session.replace_lines(source.size(), 1, "nop"));
+}
+
+TEST_CASE("Assembler - A session reports a bad register where assemble_text throws") {
+    std::string program = "main: addi $zz, $zero, 1\n    trap 5\n";
+    mips::Assembler assembler;
+    bool thrown = false;
+    try {
+        assembler.assemble_text(program);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    REQUIRE(thrown);
+    
+    mips::AssemblySession session;
+    session.load(program);
+    REQUIRE(session.get_errors() == std::vector<std::string>{"Line 1: Invalid register name: $zz"});
+    session.replace_lines(0, 1, "main: addi $t0, $zero, 1\n");
+    REQUIRE_FALSE(session.has_errors());
+}
+
+TEST_CASE("Debugger - Reloading a shorter program clears the old tail") {
+    std::ostringstream discard; // load messages, they also switch the stream to hex
+    std::streambuf* saved = std::cout.rdbuf(discard.rdbuf());
+    std::ios_base::fmtflags flags = std::cout.flags();
+    mips::Debugger debugger;
+    bool first = debugger.load_program_from_string("main: addi $t0, $zero, 1\n    addi $t1, $zero, 2\n"
+                                                   "    addi $t2, $zero, 3\n    trap 5\n");
+    bool second = debugger.load_program_from_string("main: addi $t0, $zero, 1\n    trap 5\n");
+    std::cout.flags(flags);
+    std::cout.rdbuf(saved);
+    REQUIRE(first);
+    REQUIRE(second);
+    
+    REQUIRE_EQ(debugger.format_instruction_at_address(0), "addi $t0, $zero, 1");
+    REQUIRE_EQ(debugger.format_instruction_at_address(4), "trap 5");
+    for (uint32_t address = 8; address < 16; address += 4) {
+        REQUIRE_EQ(debugger.get_state().load_word(address), 0u);
+        REQUIRE_EQ(debugger.format_instruction_at_address(address), "nop");
+    }
+}
@@ -1,6 +1,8 @@
 #include "catch2.hpp"
 #include "../src/assembler.h"
 #include "../src/mips_core.h"
+#include "../src/program_image.h"
+#include <algorithm>
 #include <sstream>
 
 TEST_CASE("BinaryFormat - Write and read binary data") {
@@ -50,6 +52,72 @@ TEST_CASE("BinaryFormat - Empty program handling") {
     REQUIRE_EQ(read_binary.size(), 0);
 }
 
+TEST_CASE("BinaryFormat - .space stays sparse from the assembler to guest memory") {
+    std::string program = R"(
+main:
+    j end
+pointer: .word table
+buffer: .space 0x1000000
+table: .word 42
+end:
+    trap 5
+)";
+    const uint32_t table = 8 + 0x1000000;
+    
+    mips::Assembler assembler;
+    auto dense = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    // the assembler keeps the 16MB as one zero range
+    std::istringstream input(program);
+    auto binary = assembler.assemble_sparse(input);
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE_EQ(binary.size, dense.size());
+    REQUIRE_EQ(binary.data.size(), 16u);
+    REQUIRE_EQ(binary.zero_ranges.size(), 1u);
+    REQUIRE_EQ(binary.zero_ranges[0].address, 8u);
+    REQUIRE_EQ(binary.zero_ranges[0].size, 0x1000000u);
+    REQUIRE(binary.to_dense() == dense);
+    
+    // and so does the file, read_binary still returns every byte
+    std::ostringstream output;
+    mips::BinaryFormat::write_binary(binary, output, 4);
+    REQUIRE(output.str().size() < 64);
+    std::istringstream sparse_input(output.str());
+    uint32_t main_address;
+    auto read_back = mips::BinaryFormat::read_sparse(sparse_input, main_address);
+    REQUIRE_EQ(main_address, 4u);
+    REQUIRE(read_back.data == binary.data);
+    REQUIRE(read_back.to_dense() == dense);
+    std::istringstream dense_input(output.str());
+    REQUIRE(mips::BinaryFormat::read_binary(dense_input, main_address) == dense);
+    
+    // a shared image stores only the pages with data
+    mips::ProgramImage image(binary, 0);
+    REQUIRE_EQ(image.size(), dense.size());
+    REQUIRE(image.page_data(0) != nullptr);
+    REQUIRE(image.page_data(100) == nullptr);
+    REQUIRE(image.page_data(table / mips::MachineState::PAGE_SIZE) != nullptr);
+    
+    // straight into memory: the forward references are patched, the range is never touched
+    mips::MachineState state;
+    std::istringstream memory_input(program);
+    REQUIRE_EQ(assembler.assemble_into(memory_input, state), dense.size());
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE(state.resident_pages() <= 2);
+    REQUIRE_EQ(state.load_word(4), table);
+    REQUIRE_EQ(state.load_word(table), 42u);
+    std::vector<uint8_t> start(8);
+    state.read_block(0, start.data(), start.size());
+    REQUIRE(std::equal(start.begin(), start.end(), dense.begin()));
+    
+    // a malformed range table is rejected
+    std::string bad = output.str();
+    bad[20] = '\xff'; // range size past the end
+    std::istringstream bad_input(bad);
+    REQUIRE_THROWS(mips::BinaryFormat::read_sparse(bad_input, main_address));
+}
+
 TEST_CASE("Instruction - Decode and encode roundtrip") {
     // test R-type instruction
     uint32_t original_word = 0x01094020; // add $t0, $t0, $t1
@@ -1,6 +1,10 @@
 #include "catch2.hpp"
 #include "../src/mips_core.h"
 #include "../src/assembler.h"
+#include "../src/snapshot.h"
+#include "../src/async_output.h"
+#include <sstream>
+#include <thread>
 
 // helper function to load program into CPU
 void load_program_into_cpu(mips::CPU& cpu, const std::vector<uint8_t>& binary) {
@@ -183,3 +187,254 @@ main:
     
     REQUIRE(cpu.is_halted());
 }
+
+TEST_CASE("CPU - Custom syscall registration") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    
+    std::string program = R"(
+main:
+    addi $a0, $zero, 20
+    addi $a1, $zero, 22
+    trap 100
+    trap 5
+)";
+    
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    // host handler: v0 = a0 + a1
+    cpu.register_syscall(100, [](mips::CPU&, mips::MachineState& state) {
+        state.set_register(mips::Register::V0,
+                           state.get_register(mips::Register::A0) + state.get_register(mips::Register::A1));
+    });
+    REQUIRE(cpu.has_syscall(100));
+    
+    load_program_into_cpu(cpu, binary);
+    cpu.run();
+    
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::V0), 42);
+    REQUIRE(cpu.is_halted());
+}
+
+TEST_CASE("CPU - Unknown trap code") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    
+    auto binary = assembler.assemble_text("main:\n    trap 77\n");
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    load_program_into_cpu(cpu, binary);
+    REQUIRE_FALSE(cpu.has_syscall(77));
+    REQUIRE_THROWS(cpu.run_single_step());
+}
+
+TEST_CASE("CPU - Bulk memory traps") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    
+    std::string program = R"(
+main:
+    lhi $a0, 1
+    addi $a1, $zero, 120
+    addi $a2, $zero, 9
+    trap 8
+    lhi $s0, 1
+    addi $a0, $s0, 0
+    trap 10
+    addi $s1, $v0, 0
+    lhi $a0, 2
+    addi $a1, $s0, 0
+    addi $a2, $zero, 10
+    trap 6
+    addi $a1, $s0, 0
+    addi $a2, $zero, 10
+    trap 9
+    trap 5
+)";
+    
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    load_program_into_cpu(cpu, binary);
+    cpu.run();
+    
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::S1), 9);  // strlen
+    REQUIRE_EQ(cpu.get_state().load_byte(0x20008), 'x');              // memcpy
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::V0), 0);  // memcmp
+}
+
+TEST_CASE("CPU - Asynchronous output keeps ordering") {
+    mips::Assembler assembler;
+    std::string program = R"(
+main:
+    addi $s0, $zero, 200
+loop:
+    addi $a0, $s0, 0
+    trap 0
+    addi $a0, $zero, 44
+    trap 1
+    addi $s0, $s0, -1
+    bgtz $s0, loop
+    trap 3
+    addi $a0, $v0, 0
+    trap 0
+    trap 5
+)";
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    std::string outputs[2];
+    for (int async = 0; async < 2; ++async) {
+        mips::CPU cpu;
+        std::istringstream input("77");
+        std::ostringstream output;
+        cpu.get_state().input_stream = &input;
+        cpu.get_state().output_stream = &output;
+        if (async) {
+            cpu.get_state().enable_async_output(16); // tiny ring to exercise backpressure
+        }
+        load_program_into_cpu(cpu, binary);
+        cpu.run();
+        outputs[async] = output.str();
+    }
+    
+    REQUIRE_EQ(outputs[1], outputs[0]);
+    REQUIRE_EQ(outputs[0].substr(0, 8), "200,199,");
+    REQUIRE_EQ(outputs[0].substr(outputs[0].size() - 4), "1,77");
+}
+
+TEST_CASE("AsyncOutput - Drain returns only once every byte is in the sink") {
+    std::ostringstream sink;
+    mips::AsyncOutput output(sink, 16);
+    for (size_t i = 1; i <= 5000; ++i) {
+        output.write("x", 1);
+        output.drain();
+        REQUIRE_EQ(static_cast<size_t>(sink.tellp()), i);
+    }
+}
+
+TEST_CASE("CPU - Memory-mapped console") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    
+    std::string program = R"(
+main:
+    lhi $t0, 0xFFFF
+    addi $t1, $zero, 72
+    sb $t1, 0($t0)
+    addi $t1, $zero, 105
+    sb $t1, 0($t0)
+    lhi $t1, 0x0A21
+    llo $t1, 0x2020
+    sw $t1, 0($t0)
+    addi $s0, $zero, 1
+    sw $zero, 4($t0)
+    trap 5
+)";
+    
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    std::ostringstream output;
+    cpu.get_state().output_stream = &output;
+    cpu.get_state().map_console(0xFFFF0000);
+    load_program_into_cpu(cpu, binary);
+    
+    // nothing reaches the stream until the control register is written
+    for (int i = 0; i < 9; ++i) {
+        cpu.run_single_step();
+    }
+    REQUIRE_EQ(output.str(), "");
+    cpu.run_single_step();
+    REQUIRE_EQ(output.str(), "Hi  !\n");
+    
+    // device page reads back as zero and never stores data
+    REQUIRE_EQ(cpu.get_state().load_word(0xFFFF0000), 0);
+}
+
+TEST_CASE("CPU - Bounded runs stop with a reason") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    std::string program = R"(
+main:
+    addi $t0, $t0, 1
+    addi $t1, $t1, 2
+loop:
+    addi $t2, $t2, 1
+    j loop
+)";
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    load_program_into_cpu(cpu, binary);
+    
+    // the budget is exact, it stops a run in the middle of a block
+    REQUIRE_EQ(cpu.run(3), mips::StopReason::BUDGET_EXHAUSTED);
+    REQUIRE_EQ(cpu.instruction_count(), 3u);
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::T2), 1u);
+    REQUIRE_EQ(cpu.run(1000), mips::StopReason::BUDGET_EXHAUSTED);
+    REQUIRE_EQ(cpu.instruction_count(), 1003u);
+    
+    // zeroed memory decodes as nops and never ends a block, the budget still stops it
+    uint32_t pc = cpu.get_state().get_pc();
+    cpu.get_state().set_pc(0x200000);
+    REQUIRE_EQ(cpu.run(5000), mips::StopReason::BUDGET_EXHAUSTED);
+    REQUIRE_EQ(cpu.get_state().get_pc(), 0x200000u + 4 * 5000);
+    cpu.get_state().set_pc(pc);
+    
+    // an endless guest returns once the deadline has passed
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+    REQUIRE_EQ(cpu.run_until(deadline), mips::StopReason::BUDGET_EXHAUSTED);
+    REQUIRE(std::chrono::steady_clock::now() >= deadline);
+    
+    // breakpoints stop before the instruction, resuming runs it
+    cpu.add_breakpoint(0x8);
+    REQUIRE_EQ(cpu.run(0), mips::StopReason::BREAKPOINT);
+    REQUIRE_EQ(cpu.get_state().get_pc(), 0x8u);
+    uint32_t count = cpu.get_state().get_register(mips::Register::T2);
+    REQUIRE_EQ(cpu.run(0), mips::StopReason::BREAKPOINT);
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::T2), count + 1);
+    cpu.remove_breakpoint(0x8);
+    REQUIRE_EQ(cpu.run(10), mips::StopReason::BUDGET_EXHAUSTED);
+    
+    // faults are reported, not thrown
+    cpu.get_state().store_word(0x100, 0x68000000 | 999); // trap 999
+    cpu.get_state().set_pc(0x100);
+    REQUIRE_EQ(cpu.run(0), mips::StopReason::FAULT);
+    REQUIRE(cpu.fault_message().find("999") != std::string::npos);
+    REQUIRE_EQ(cpu.get_state().get_pc(), 0x100u);
+}
+
+TEST_CASE("CPU - Snapshots are consistent while the guest runs") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    // at every block boundary $t1 == 2 * $t0
+    std::string program = R"(
+main:
+    addi $t0, $t0, 1
+    add $t1, $t0, $t0
+    j main
+)";
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    load_program_into_cpu(cpu, binary);
+    
+    mips::SnapshotPublisher publisher;
+    cpu.set_snapshot_publisher(&publisher, 16);
+    std::thread runner([&cpu] { cpu.run(3000000); });
+    
+    uint64_t last_count = 0;
+    bool consistent = true;
+    while (publisher.publications() == 0 || last_count < 3000000) {
+        mips::CpuSnapshot snapshot = publisher.read();
+        uint32_t t0 = snapshot.registers[static_cast<size_t>(mips::Register::T0)];
+        uint32_t t1 = snapshot.registers[static_cast<size_t>(mips::Register::T1)];
+        consistent = consistent && t1 == 2 * t0 && snapshot.instruction_count >= last_count &&
+                     snapshot.instruction_count == 3ull * t0;
+        last_count = snapshot.instruction_count;
+    }
+    runner.join();
+    REQUIRE(consistent);
+    REQUIRE(publisher.publications() > 1);
+    REQUIRE_EQ(publisher.read().pc, 0);
+}
@@ -0,0 +1,119 @@
+#include "catch2.hpp"
+#include "../src/guest_heap.h"
+#include "../src/mips_core.h"
+#include "../src/assembler.h"
+#include "../src/program_image.h"
+#include <sstream>
+
+TEST_CASE("GuestHeap - Allocate, free and coalesce") {
+    mips::GuestHeap heap(0x1000, 0x2000);
+    
+    uint32_t a = heap.allocate(10);
+    uint32_t b = heap.allocate(16);
+    uint32_t c = heap.allocate(8);
+    REQUIRE_EQ(a, 0x1000u);
+    REQUIRE_EQ(b, 0x1010u); // 10 rounds up to 16
+    REQUIRE_EQ(c, 0x1020u);
+    REQUIRE_EQ(heap.get_stats().bytes_in_use, 40u);
+    
+    // freeing a and b coalesces into one 32 byte block
+    REQUIRE(heap.release(a));
+    REQUIRE(heap.release(b));
+    REQUIRE_FALSE(heap.release(b));
+    auto stats = heap.get_stats();
+    REQUIRE_EQ(stats.free_bytes, 32u);
+    REQUIRE_EQ(stats.largest_free_block, 32u);
+    REQUIRE_EQ(stats.peak_bytes_in_use, 40u);
+    
+    // best fit reuses the freed block
+    REQUIRE_EQ(heap.allocate(24), 0x1000u);
+    REQUIRE_EQ(heap.get_stats().free_bytes, 8u);
+    
+    // exhausting the segment returns 0
+    REQUIRE_EQ(heap.allocate(0x2000), 0u);
+}
+
+TEST_CASE("GuestHeap - sbrk and fragmentation") {
+    mips::GuestHeap heap(0x1000, 0x2000);
+    
+    REQUIRE_EQ(heap.sbrk(0x100), 0x1000u);
+    REQUIRE_EQ(heap.get_break(), 0x1100u);
+    REQUIRE_EQ(heap.sbrk(-0x100), 0x1100u);
+    REQUIRE_EQ(heap.sbrk(-8), mips::GuestHeap::SBRK_FAILED);
+    REQUIRE_EQ(heap.sbrk(0x2000), mips::GuestHeap::SBRK_FAILED);
+    
+    uint32_t blocks[4];
+    for (auto& block : blocks) {
+        block = heap.allocate(16);
+    }
+    heap.release(blocks[0]);
+    heap.release(blocks[2]);
+    REQUIRE_EQ(heap.get_stats().fragmentation(), 0.5);
+    
+    // cannot shrink below a live allocation
+    REQUIRE_EQ(heap.sbrk(-16), mips::GuestHeap::SBRK_FAILED);
+}
+
+TEST_CASE("CPU - Heap traps") {
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    
+    std::string program = R"(
+main:
+    addi $a0, $zero, 100
+    trap 12
+    addi $s0, $v0, 0
+    addi $t0, $zero, 55
+    sw $t0, 96($s0)
+    addi $a0, $s0, 0
+    trap 13
+    addi $a0, $zero, 64
+    trap 12
+    addi $s1, $v0, 0
+    trap 5
+)";
+    
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    cpu.get_state().load_memory(binary, 0);
+    cpu.run();
+    
+    uint32_t first = cpu.get_state().get_register(mips::Register::S0);
+    REQUIRE_EQ(first, mips::GuestHeap::DEFAULT_BASE);
+    REQUIRE_EQ(cpu.get_state().load_word(first + 96), 55u);
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::S1), first); // reused after free
+    REQUIRE_EQ(cpu.get_state().heap().get_stats().peak_bytes_in_use, 104u);
+}
+
+TEST_CASE("CPU - Heap starts above a program that reaches past its base") {
+    std::string program = R"(
+main:
+    addi $a0, $zero, 16
+    trap 12
+    addi $s0, $v0, 0
+    trap 5
+buf:
+    .space 268435456
+)";
+
+    mips::CPU cpu;
+    mips::Assembler assembler;
+    std::istringstream input(program);
+    uint32_t size = assembler.assemble_into(input, cpu.get_state());
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE_EQ(size, mips::GuestHeap::DEFAULT_BASE + 16);
+    cpu.run();
+    REQUIRE_EQ(cpu.get_state().get_register(mips::Register::S0), mips::GuestHeap::DEFAULT_BASE + 0x1000);
+    
+    // a mapped image moves the heap the same way
+    mips::CPU shared;
+    shared.get_state().map_image(mips::ProgramImage::assemble(program));
+    REQUIRE_EQ(shared.get_state().heap().get_base(), mips::GuestHeap::DEFAULT_BASE + 0x1000);
+    
+    // a heap in use cannot move, and a program past the heap limit leaves no room
+    mips::CPU busy;
+    REQUIRE_EQ(busy.get_state().heap().allocate(8), mips::GuestHeap::DEFAULT_BASE);
+    REQUIRE_THROWS(busy.get_state().place_heap_above(mips::GuestHeap::DEFAULT_BASE + 4));
+    mips::CPU full;
+    REQUIRE_THROWS(full.get_state().place_heap_above(mips::GuestHeap::DEFAULT_LIMIT + 4));
+}
@@ -0,0 +1,130 @@
+#include "catch2.hpp"
+#include "../src/lockstep.h"
+#include "../src/assembler.h"
+#include <memory>
+#include <sstream>
+
+namespace {
+
+// sums i*i, i^k and (i >> 1) over an array it fills itself, then takes an
+// input-dependent detour so lanes diverge near the end
+const char* KERNEL = R"(
+main:
+    trap 3
+    addi $s0, $v0, 0
+    lhi $s1, 2
+    addi $t0, $zero, 0
+fill:
+    sll $t1, $t0, 2
+    add $t1, $t1, $s1
+    mult $t0, $t0
+    mflo $t2
+    sw $t2, 0($t1)
+    addi $t0, $t0, 1
+    slt $t3, $t0, $s0
+    bne $t3, $zero, fill
+    addi $t0, $zero, 0
+    addi $a0, $zero, 0
+sum:
+    sll $t1, $t0, 2
+    addu $t1, $t1, $s1
+    lw $t2, 0($t1)
+    xori $t4, $t0, 0x55
+    srlv $t5, $t2, $t0
+    addu $a0, $a0, $t2
+    addu $a0, $a0, $t4
+    subu $a0, $a0, $t5
+    sra $t6, $a0, 3
+    xor $a0, $a0, $t6
+    addi $t0, $t0, 1
+    sltu $t3, $t0, $s0
+    bgtz $t3, sum
+    andi $t7, $s0, 1
+    beq $t7, $zero, even
+    nor $a0, $a0, $zero
+even:
+    trap 0
+    trap 5
+)";
+
+struct Instance {
+    std::istringstream input;
+    std::ostringstream output;
+    mips::CPU cpu;
+    
+    Instance(const std::vector<uint8_t>& binary, uint32_t main_address, int n) : input(std::to_string(n)) {
+        cpu.get_state().input_stream = &input;
+        cpu.get_state().output_stream = &output;
+        cpu.get_state().load_memory(binary, 0);
+        cpu.get_state().set_pc(main_address);
+    }
+};
+
+} // namespace
+
+TEST_CASE("Lockstep - Lanes match scalar runs, diverged lanes finish") {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(KERNEL);
+    REQUIRE_FALSE(assembler.has_errors());
+    uint32_t main_address = assembler.get_main_address();
+    
+    std::vector<mips::LockstepIsa> isas = {mips::LockstepIsa::BASELINE};
+    if (mips::LockstepBatch::host_has_avx2()) {
+        isas.push_back(mips::LockstepIsa::AVX2);
+    }
+    for (auto isa : isas) {
+        const int inputs[] = {40, 40, 40, 41, 40, 7, 40, 40};
+        std::vector<std::unique_ptr<Instance>> lanes;
+        std::vector<mips::CPU*> cpus;
+        for (int n : inputs) {
+            lanes.push_back(std::make_unique<Instance>(binary, main_address, n));
+            cpus.push_back(&lanes.back()->cpu);
+        }
+        mips::LockstepBatch batch(cpus, isa);
+        batch.run();
+        
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            Instance scalar(binary, main_address, inputs[i]);
+            uint64_t steps = 0;
+            while (!scalar.cpu.is_halted()) {
+                scalar.cpu.run_single_step();
+                steps++;
+            }
+            REQUIRE(lanes[i]->cpu.is_halted());
+            REQUIRE(batch.lane(i).error.empty());
+            REQUIRE_EQ(lanes[i]->output.str(), scalar.output.str());
+            REQUIRE_EQ(batch.lane(i).instructions, steps);
+            REQUIRE_EQ(lanes[i]->cpu.get_state().get_register(mips::Register::A0),
+                       scalar.cpu.get_state().get_register(mips::Register::A0));
+        }
+        REQUIRE(batch.lane(3).diverged);
+        REQUIRE(batch.lane(5).diverged);
+        REQUIRE_FALSE(batch.lane(0).diverged);
+    }
+}
+
+TEST_CASE("Lockstep - Step limit and faulting lanes") {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(R"(
+main:
+    trap 3
+    lw $t0, 0($v0)
+spin:
+    addi $t1, $t1, 1
+    j spin
+)");
+    REQUIRE_FALSE(assembler.has_errors());
+    uint32_t main_address = assembler.get_main_address();
+    
+    Instance good(binary, main_address, 64);
+    Instance bad(binary, main_address, -2); // unaligned word at 0xfffffffe runs off the end of memory
+    mips::LockstepBatch batch({&good.cpu, &bad.cpu});
+    batch.run(1000);
+    
+    REQUIRE_EQ(batch.lane(0).instructions, 1000u);
+    REQUIRE(batch.lane(0).error.empty());
+    REQUIRE_EQ(good.cpu.get_state().get_register(mips::Register::T1), 499u);
+    REQUIRE_EQ(batch.lane(1).instructions, 1u);
+    REQUIRE_FALSE(batch.lane(1).error.empty());
+    REQUIRE_THROWS(mips::LockstepBatch({}));
+}
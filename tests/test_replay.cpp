@@ -0,0 +1,75 @@
+#include "catch2.hpp"
+#include "../src/replay.h"
+#include "../src/assembler.h"
+#include <string>
+#include <vector>
+
+TEST_CASE("Replay - Intervals re-run in parallel match the recorded run") {
+    // reads n, prints a running sum of n^2 every 1000 iterations using heap memory
+    std::string program = R"(
+main:
+    trap 3
+    addi $s0, $v0, 0
+    addi $a0, $zero, 64
+    trap 12
+    addi $s1, $v0, 0
+    addi $t0, $zero, 0
+loop:
+    mult $t0, $t0
+    mflo $t1
+    lw $t2, 0($s1)
+    add $t2, $t2, $t1
+    sw $t2, 0($s1)
+    addi $t0, $t0, 1
+    andi $t3, $t0, 1023
+    bne $t3, $zero, skip
+    addi $a0, $t2, 0
+    trap 0
+    addi $a0, $zero, 10
+    trap 1
+skip:
+    bne $t0, $s0, loop
+    trap 5
+)";
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    
+    mips::CPU cpu;
+    cpu.get_state().load_memory(binary, 0);
+    cpu.get_state().set_pc(assembler.get_main_address());
+    mips::CheckpointReplay replay(997);
+    REQUIRE_EQ(replay.record(cpu, "5000\n"), mips::StopReason::HALTED);
+    REQUIRE(replay.num_intervals() > 20);
+    
+    mips::ThreadPool pool(4);
+    std::vector<uint32_t> last_pc(replay.num_intervals());
+    std::vector<uint64_t> steps(replay.num_intervals());
+    auto intervals = replay.replay([&](size_t index, mips::CPU& guest, uint64_t instructions) {
+        for (uint64_t n = 0; n < instructions; ++n) {
+            guest.run_single_step();
+            steps[index]++;
+        }
+        last_pc[index] = guest.get_state().get_pc();
+    }, pool);
+    
+    std::string output;
+    uint64_t total = 0;
+    for (size_t i = 0; i < intervals.size(); ++i) {
+        REQUIRE_EQ(intervals[i].error, "");
+        REQUIRE_EQ(intervals[i].first_instruction, total);
+        REQUIRE_EQ(steps[i], intervals[i].instructions);
+        total += intervals[i].instructions;
+        output += intervals[i].output;
+    }
+    REQUIRE_EQ(total, cpu.instruction_count());
+    REQUIRE_EQ(output, replay.output());
+    REQUIRE(output.find("\n") != std::string::npos);
+    REQUIRE_EQ(last_pc.back(), cpu.get_state().get_pc());
+    
+    // a detailed pass that runs too far is reported, not silently stitched
+    auto wrong = replay.replay([](size_t, mips::CPU& guest, uint64_t instructions) {
+        guest.run(instructions + 1);
+    }, pool);
+    REQUIRE(!wrong.front().error.empty());
+}
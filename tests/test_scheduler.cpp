@@ -0,0 +1,71 @@
+#include "catch2.hpp"
+#include "../src/scheduler.h"
+#include "../src/assembler.h"
+
+namespace {
+
+std::vector<uint8_t> assemble_guest(const std::string& program, uint32_t& main_address) {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    main_address = assembler.get_main_address();
+    return binary;
+}
+
+} // namespace
+
+TEST_CASE("Scheduler - Many guests share few workers") {
+    uint32_t main_address;
+    auto binary = assemble_guest(R"(
+main:
+    trap 3
+    addi $s0, $v0, 0
+    addi $a0, $zero, 0
+loop:
+    add $a0, $a0, $s0
+    addi $s0, $s0, -1
+    bgtz $s0, loop
+    trap 0
+    trap 5
+)", main_address);
+    
+    mips::Scheduler scheduler(2, 50);
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 40; ++i) {
+        ids.push_back(scheduler.add_guest(binary, main_address, std::to_string(i * 10) + "\n"));
+    }
+    scheduler.wait_all();
+    
+    for (int i = 1; i <= 40; ++i) {
+        auto status = scheduler.get_status(ids[i - 1]);
+        REQUIRE_EQ(status.state, mips::GuestState::HALTED);
+        int n = i * 10;
+        REQUIRE_EQ(status.output, std::to_string(n * (n + 1) / 2));
+    }
+}
+
+TEST_CASE("Scheduler - Runaway guest does not starve others, input parks") {
+    uint32_t spin_main, echo_main;
+    auto spin = assemble_guest("main:\n    j main\n", spin_main);
+    auto echo = assemble_guest(R"(
+main:
+    trap 3
+    addi $a0, $v0, 1
+    trap 0
+    trap 5
+)", echo_main);
+    
+    mips::Scheduler scheduler(1, 1000);
+    scheduler.add_guest(spin, spin_main);
+    size_t echo_id = scheduler.add_guest(echo, echo_main);
+    
+    // parks on the input trap while the spinning guest keeps running
+    scheduler.wait(echo_id);
+    REQUIRE_EQ(scheduler.get_status(echo_id).state, mips::GuestState::PARKED);
+    
+    scheduler.provide_input(echo_id, "41\n");
+    scheduler.wait(echo_id);
+    auto status = scheduler.get_status(echo_id);
+    REQUIRE_EQ(status.state, mips::GuestState::HALTED);
+    REQUIRE_EQ(status.output, "42");
+}
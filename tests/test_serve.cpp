@@ -0,0 +1,112 @@
+#include "catch2.hpp"
+#include "../src/job_server.h"
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::string socket_path() {
+    return "/tmp/mips-serve-test-" + std::to_string(getpid()) + ".sock";
+}
+
+// a bare protocol connection, reads give up after a few seconds instead of hanging the suite
+int connect_raw(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    REQUIRE_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+void send_raw(int fd, const std::string& data) {
+    REQUIRE_EQ(send(fd, data.data(), data.size(), MSG_NOSIGNAL), static_cast<ssize_t>(data.size()));
+}
+
+// everything the server sends until it closes the connection
+std::string read_until_close(int fd) {
+    std::string received;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        received.append(chunk, static_cast<size_t>(n));
+    }
+    REQUIRE_EQ(n, 0); // not a timeout
+    return received;
+}
+
+const char* PRINT_A = "main: addi $a0, $zero, 65\n    trap 1\n    trap 5\n";
+
+} // namespace
+
+TEST_CASE("Serve - Jobs, pipelining and protocol errors over the socket") {
+    mips::JobServer server(socket_path(), 1);
+    std::thread poller([&server] { server.run(); });
+    
+    mips::JobClient client(socket_path());
+    auto result = client.run(mips::ProgramCache::Kind::ASSEMBLY, "main: trap 3\n    addi $a0, $v0, 1\n"
+                             "    trap 0\n    trap 5\n", "41\n");
+    REQUIRE_EQ(result.status, mips::JobClient::Status::HALTED);
+    REQUIRE_EQ(result.output, "42");
+    result = client.run(mips::ProgramCache::Kind::ASSEMBLY, "main: nosuch $t0\n");
+    REQUIRE_EQ(result.status, mips::JobClient::Status::ERROR);
+    REQUIRE_FALSE(result.error.empty());
+    
+    // two requests in one write, the second runs once the first is answered
+    int fd = connect_raw(socket_path());
+    std::string request = "asm " + std::to_string(std::strlen(PRINT_A)) + " 0 0\n" + PRINT_A;
+    send_raw(fd, request + request);
+    shutdown(fd, SHUT_WR);
+    REQUIRE_EQ(read_until_close(fd), "output 1\nAhalted 3\noutput 1\nAhalted 3\n");
+    close(fd);
+    
+    fd = connect_raw(socket_path());
+    send_raw(fd, "run everything\n");
+    REQUIRE_EQ(read_until_close(fd).rfind("error ", 0), 0u);
+    close(fd);
+    
+    server.stop();
+    poller.join();
+}
+
+TEST_CASE("Serve - Stalled clients and endless guests do not hold the workers") {
+    mips::JobServer server(socket_path(), 1, 16, 10000, 50000);
+    std::thread poller([&server] { server.run(); });
+    
+    // headers whose bodies never come, each would have blocked the only worker
+    std::vector<int> stalled;
+    for (int i = 0; i < 3; ++i) {
+        stalled.push_back(connect_raw(socket_path()));
+        send_raw(stalled.back(), "asm 100 0 0\nmain:");
+    }
+    mips::JobClient client(socket_path());
+    auto result = client.run(mips::ProgramCache::Kind::ASSEMBLY, PRINT_A);
+    REQUIRE_EQ(result.status, mips::JobClient::Status::HALTED);
+    REQUIRE_EQ(result.output, "A");
+    
+    // no budget gets the default, a larger one is cut to the limit
+    const char* spin = "main: j main\n";
+    result = client.run(mips::ProgramCache::Kind::ASSEMBLY, spin);
+    REQUIRE_EQ(result.status, mips::JobClient::Status::LIMIT);
+    REQUIRE_EQ(result.instructions, 10000u);
+    result = client.run(mips::ProgramCache::Kind::ASSEMBLY, spin, "", 1000000000);
+    REQUIRE_EQ(result.status, mips::JobClient::Status::LIMIT);
+    REQUIRE_EQ(result.instructions, 50000u);
+    result = client.run(mips::ProgramCache::Kind::ASSEMBLY, spin, "", 20);
+    REQUIRE_EQ(result.instructions, 20u);
+    
+    for (int fd : stalled) {
+        close(fd);
+    }
+    server.stop();
+    poller.join();
+}
@@ -0,0 +1,109 @@
+#include "catch2.hpp"
+#include "../src/guest_session.h"
+#include "../src/assembler.h"
+#include <memory>
+#include <vector>
+
+namespace {
+
+std::shared_ptr<const mips::ProgramImage> build_image(const std::string& program) {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    return std::make_shared<const mips::ProgramImage>(binary, assembler.get_main_address());
+}
+
+// prints the running total of the numbers it reads, stops at 0
+const char* ACCUMULATOR = R"(
+main:
+    addi $s0, $zero, 0
+next:
+    trap 3
+    beq $v0, $zero, done
+    add $s0, $s0, $v0
+    addi $a0, $s0, 0
+    trap 0
+    addi $a0, $zero, 10
+    trap 1
+    j next
+done:
+    trap 5
+)";
+
+} // namespace
+
+TEST_CASE("Session - One thread interleaves many interactive guests") {
+    auto image = build_image(ACCUMULATOR);
+    std::vector<std::unique_ptr<mips::GuestSession>> sessions;
+    for (int i = 0; i < 1000; ++i) {
+        sessions.push_back(std::make_unique<mips::GuestSession>(image));
+        REQUIRE_EQ(sessions.back()->resume(), mips::SessionState::NEEDS_INPUT);
+    }
+    
+    for (int round = 1; round <= 3; ++round) {
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            sessions[i]->provide_input(std::to_string(i + round) + "\n");
+        }
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            REQUIRE_EQ(sessions[i]->resume(), mips::SessionState::NEEDS_INPUT);
+        }
+    }
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        auto& session = *sessions[i];
+        size_t total = 3 * i + 6;
+        REQUIRE_EQ(session.take_output(), std::to_string(i + 1) + "\n" + std::to_string(2 * i + 3) + "\n" +
+                                          std::to_string(total) + "\n");
+        session.provide_input("0\n");
+        REQUIRE_EQ(session.resume(), mips::SessionState::HALTED);
+        REQUIRE_EQ(session.take_output(), "");
+    }
+    REQUIRE_EQ(image.use_count(), 1001);
+}
+
+TEST_CASE("Session - Budgets, closed input and faults") {
+    auto image = build_image(ACCUMULATOR);
+    mips::GuestSession session(image);
+    REQUIRE_EQ(session.resume(1), mips::SessionState::READY);
+    REQUIRE_EQ(session.instructions(), 1u);
+    session.provide_input("5 7");
+    REQUIRE_EQ(session.resume(), mips::SessionState::NEEDS_INPUT);
+    REQUIRE_EQ(session.output(), "5\n"); // "7" may still be the start of a longer number
+    session.close_input(); // the 7 is complete now, then eof reads as 0 and ends the program
+    REQUIRE_EQ(session.resume(), mips::SessionState::HALTED);
+    REQUIRE_EQ(session.output(), "5\n12\n");
+    REQUIRE_EQ(session.resume(), mips::SessionState::HALTED);
+    
+    mips::GuestSession faulty(build_image("main:\n    trap 999\n"));
+    REQUIRE_EQ(faulty.resume(), mips::SessionState::FAULTED);
+    REQUIRE_FALSE(faulty.error().empty());
+}
+
+TEST_CASE("Session - Reset reuses the CPU for another run") {
+    auto image = build_image(ACCUMULATOR);
+    mips::GuestSession session(image);
+    session.provide_input("4 0\n");
+    REQUIRE_EQ(session.resume(), mips::SessionState::HALTED);
+    REQUIRE_EQ(session.output(), "4\n");
+    
+    session.reset(image);
+    REQUIRE_EQ(session.instructions(), 0u);
+    REQUIRE_EQ(session.output(), "");
+    REQUIRE_EQ(session.resume(), mips::SessionState::NEEDS_INPUT);
+    session.provide_input("9 0\n");
+    REQUIRE_EQ(session.resume(), mips::SessionState::HALTED);
+    REQUIRE_EQ(session.output(), "9\n");
+}
+
+TEST_CASE("Session - A number split across two inputs is read whole") {
+    auto image = build_image(ACCUMULATOR);
+    mips::GuestSession session(image);
+    session.provide_input("1");
+    REQUIRE_EQ(session.resume(), mips::SessionState::NEEDS_INPUT);
+    REQUIRE_EQ(session.output(), "");
+    session.provide_input("2\n-");
+    REQUIRE_EQ(session.resume(), mips::SessionState::NEEDS_INPUT);
+    REQUIRE_EQ(session.output(), "12\n");
+    session.provide_input("5 \xE9"); // a byte that is not a number reads as 0
+    REQUIRE_EQ(session.resume(), mips::SessionState::HALTED);
+    REQUIRE_EQ(session.output(), "12\n7\n");
+}
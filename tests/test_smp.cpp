@@ -0,0 +1,116 @@
+#include "catch2.hpp"
+#include "../src/smp.h"
+#include "../src/assembler.h"
+#include <sstream>
+
+namespace {
+
+void load_guest(mips::CPU& cpu, const std::string& program) {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text(program);
+    REQUIRE_FALSE(assembler.has_errors());
+    cpu.get_state().load_memory(binary, 0);
+    cpu.get_state().set_pc(assembler.get_main_address());
+}
+
+} // namespace
+
+TEST_CASE("SMP - Harts share memory and count with ll/sc") {
+    mips::CPU cpu;
+    std::ostringstream output;
+    cpu.get_state().output_stream = &output;
+    load_guest(cpu, R"(
+worker:
+    addi $s1, $zero, 8192
+retry:
+    ll $t0, 0($s1)
+    addi $t0, $t0, 1
+    sc $t0, 0($s1)
+    beq $t0, $zero, retry
+    addi $a0, $a0, -1
+    bgtz $a0, retry
+    sync
+    trap 5
+main:
+    addi $s0, $zero, 0
+    addi $s2, $zero, 4
+spawn:
+    addi $a0, $zero, worker
+    addi $a1, $zero, 0
+    addi $a2, $zero, 2000
+    trap 15
+    addi $s0, $s0, 1
+    bne $s0, $s2, spawn
+join:
+    addi $a0, $s0, 0
+    trap 16
+    addi $s0, $s0, -1
+    bgtz $s0, join
+    addi $s1, $zero, 8192
+    lw $a0, 0($s1)
+    trap 0
+    trap 14
+    addi $a0, $v0, 0
+    trap 0
+    trap 5
+)");
+    
+    mips::SmpMachine machine(cpu);
+    machine.run();
+    REQUIRE_EQ(machine.num_harts(), 5u);
+    REQUIRE_EQ(output.str(), "80000");
+}
+
+TEST_CASE("SMP - ll/sc encoding, reservations and hart limits") {
+    mips::Assembler assembler;
+    auto binary = assembler.assemble_text("main:\n    ll $t0, 4($sp)\n    sc $t1, 8($sp)\n    sync\n");
+    REQUIRE_FALSE(assembler.has_errors());
+    REQUIRE_EQ(binary.size(), 12u);
+    auto word = [&binary](size_t i) {
+        return static_cast<uint32_t>(binary[i]) | (static_cast<uint32_t>(binary[i + 1]) << 8) |
+               (static_cast<uint32_t>(binary[i + 2]) << 16) | (static_cast<uint32_t>(binary[i + 3]) << 24);
+    };
+    REQUIRE_EQ(word(0), (0b110000u << 26) | (29u << 21) | (8u << 16) | 4u);
+    REQUIRE_EQ(word(4), (0b111000u << 26) | (29u << 21) | (9u << 16) | 8u);
+    REQUIRE_EQ(word(8), 0b001111u);
+    
+    // sc without a matching ll fails, spawn is unknown outside an SmpMachine
+    mips::CPU cpu;
+    load_guest(cpu, R"(
+main:
+    addi $s1, $zero, 4096
+    addi $t0, $zero, 7
+    sc $t0, 0($s1)
+    ll $t1, 0($s1)
+    addi $t2, $zero, 9
+    sc $t2, 4($s1)
+    ll $t3, 0($s1)
+    addi $t4, $zero, 11
+    sc $t4, 0($s1)
+    trap 15
+)");
+    REQUIRE_THROWS(cpu.run());
+    auto& state = cpu.get_state();
+    REQUIRE_EQ(state.get_register(mips::Register::T0), 0u);
+    REQUIRE_EQ(state.get_register(mips::Register::T2), 0u); // different address
+    REQUIRE_EQ(state.get_register(mips::Register::T4), 1u);
+    REQUIRE_EQ(state.load_word(4096), 11u);
+    
+    mips::CPU boot;
+    load_guest(boot, R"(
+spin:
+    j spin
+main:
+    addi $a0, $zero, spin
+    trap 15
+    addi $s0, $v0, 0
+    addi $a0, $zero, spin
+    trap 15
+    addi $s1, $v0, 0
+    trap 5
+)");
+    mips::SmpMachine machine(boot, 2);
+    machine.run(); // the spinning hart is stopped once the boot hart exits
+    REQUIRE_EQ(boot.get_state().get_register(mips::Register::S0), 1u);
+    REQUIRE_EQ(boot.get_state().get_register(mips::Register::S1), mips::SmpMachine::SPAWN_FAILED);
+}
@@ -1,6 +1,20 @@
 #include "catch2.hpp"
 #include "../src/mips_core.h"
+#include "../src/thread_pool.h"
+#include "../src/program_image.h"
+#include "../src/program_cache.h"
+#include "../src/assembly_cache.h"
+#include "../src/assembler.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <stdexcept>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 TEST_CASE("Utilities - Register name conversion") {
     // test valid register names
@@ -88,3 +102,249 @@ TEST_CASE("CPU - Basic functionality") {
     cpu.get_state().set_pc(100);
     REQUIRE_EQ(cpu.get_state().get_pc(), 100);
 }
+
+TEST_CASE("MachineState - Bulk copy across pages") {
+    mips::MachineState state;
+    
+    // source straddles a page boundary, destination straddles a different one
+    for (uint32_t i = 0; i < 64; ++i) {
+        state.store_byte(0x1FE0 + i, static_cast<uint8_t>(i + 1));
+    }
+    state.copy_memory(0x5FF0, 0x1FE0, 64);
+    for (uint32_t i = 0; i < 64; ++i) {
+        REQUIRE_EQ(state.load_byte(0x5FF0 + i), i + 1);
+    }
+    
+    // overlapping move towards higher addresses
+    state.copy_memory(0x1FF0, 0x1FE0, 48);
+    for (uint32_t i = 0; i < 48; ++i) {
+        REQUIRE_EQ(state.load_byte(0x1FF0 + i), i + 1);
+    }
+    
+    // copying from an unallocated page clears the destination
+    state.copy_memory(0x5FF0, 0x70000000, 32);
+    REQUIRE_EQ(state.load_word(0x5FF0), 0);
+    REQUIRE_EQ(state.load_word(0x600C), 0);
+    REQUIRE_EQ(state.load_byte(0x6010), 33);
+}
+
+TEST_CASE("MachineState - Bulk fill, compare and strlen") {
+    mips::MachineState state;
+    
+    state.fill_memory(0x2FFE, 'a', 5);
+    REQUIRE_EQ(state.load_byte(0x2FFD), 0);
+    REQUIRE_EQ(state.load_byte(0x2FFE), 'a');
+    REQUIRE_EQ(state.load_byte(0x3002), 'a');
+    REQUIRE_EQ(state.load_byte(0x3003), 0);
+    
+    // string runs across the page boundary
+    REQUIRE_EQ(state.string_length(0x2FFE), 5);
+    // unallocated memory is an empty string
+    REQUIRE_EQ(state.string_length(0x40000000), 0);
+    
+    state.fill_memory(0x8000, 'a', 5);
+    REQUIRE_EQ(state.compare_memory(0x2FFE, 0x8000, 5), 0);
+    state.store_byte(0x8004, 'b');
+    REQUIRE_EQ(state.compare_memory(0x2FFE, 0x8000, 5), -1);
+    REQUIRE_EQ(state.compare_memory(0x8000, 0x2FFE, 5), 1);
+    // allocated zeros compare equal to unallocated memory
+    REQUIRE_EQ(state.compare_memory(0x3003, 0x50000000, 16), 0);
+    
+    REQUIRE_THROWS(state.fill_memory(0xFFFFFFF0, 1, 32));
+}
+
+TEST_CASE("MachineState - Shared memory window") {
+    mips::MachineState state;
+    std::string name = "/mips-test-window-" + std::to_string(getpid());
+    
+    state.store_word(0x20004, 0x11111111); // existing contents move into the window
+    state.map_shared_window(name, 0x20000, 2 * mips::MachineState::PAGE_SIZE);
+    state.store_word(0x21000, 0xCAFEBABE);
+    
+    // an external reader maps the object independently
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    REQUIRE(fd >= 0);
+    struct stat info;
+    fstat(fd, &info);
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    REQUIRE(mapping != MAP_FAILED);
+    
+    const auto* header = static_cast<const mips::SharedWindowHeader*>(mapping);
+    REQUIRE_EQ(header->magic, mips::SHARED_WINDOW_MAGIC);
+    REQUIRE_EQ(header->version, mips::SHARED_WINDOW_VERSION);
+    REQUIRE_EQ(header->guest_base, 0x20000);
+    REQUIRE_EQ(header->size, 0x2000);
+    
+    uint8_t* guest = static_cast<uint8_t*>(mapping) + header->header_size;
+    uint32_t word;
+    std::memcpy(&word, guest + 0x1000, 4);
+    REQUIRE_EQ(word, 0xCAFEBABE);
+    std::memcpy(&word, guest + 4, 4);
+    REQUIRE_EQ(word, 0x11111111);
+    
+    // host-to-guest direction
+    guest[0x10] = 0x5A;
+    REQUIRE_EQ(state.load_byte(0x20010), 0x5A);
+    
+    // a name in use is an error, the mapped object is left alone
+    mips::MachineState other;
+    REQUIRE_THROWS(other.map_shared_window(name, 0x20000, mips::MachineState::PAGE_SIZE));
+    fstat(fd, &info);
+    REQUIRE_EQ(static_cast<size_t>(info.st_size), mips::SharedWindow::HEADER_SIZE + 0x2000);
+    REQUIRE_EQ(guest[0x10], 0x5Au);
+    
+    munmap(mapping, info.st_size);
+    close(fd);
+    
+    // contents survive unmapping the window
+    state.unmap_shared_window();
+    REQUIRE_EQ(state.load_word(0x21000), 0xCAFEBABE);
+    REQUIRE(shm_open(name.c_str(), O_RDONLY, 0) < 0);
+}
+
+TEST_CASE("Program image - Shared pages are copied on first write") {
+    std::vector<uint8_t> data(3 * mips::MachineState::PAGE_SIZE + 100);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    auto image = std::make_shared<const mips::ProgramImage>(data, 0x40);
+    REQUIRE_EQ(image->num_pages(), 4u);
+    REQUIRE(image->page_data(4) == nullptr);
+    
+    mips::CPU a, b;
+    a.get_state().map_image(image);
+    b.get_state().map_image(image);
+    auto& first = a.get_state();
+    auto& second = b.get_state();
+    REQUIRE_EQ(first.resident_pages(), 0u);
+    REQUIRE_EQ(first.load_byte(0x1001), static_cast<uint8_t>(0x1001 * 7));
+    REQUIRE_EQ(first.load_byte(0x3000 + 100), 0u); // zero padding
+    REQUIRE_EQ(first.string_length(0x3000 + 100), 0u);
+    
+    first.store_word(0x1000, 0xDEADBEEF);
+    REQUIRE_EQ(first.resident_pages(), 1u);
+    REQUIRE_EQ(first.load_word(0x1000), 0xDEADBEEFu);
+    REQUIRE_EQ(first.load_byte(0x1004), static_cast<uint8_t>(0x1004 * 7)); // rest of the page kept
+    REQUIRE_EQ(second.load_byte(0x1000), static_cast<uint8_t>(0x1000 * 7));
+    REQUIRE_EQ(image->page_data(1)[0], static_cast<uint8_t>(0x1000 * 7));
+    
+    // bulk writes privatise too, reads out of the image do not
+    second.fill_memory(0x2000, 0, 16);
+    second.copy_memory(0x10000, 0x10, 32);
+    REQUIRE_EQ(second.resident_pages(), 2u);
+    REQUIRE_EQ(second.load_word(0x2000), 0u);
+    REQUIRE_EQ(second.compare_memory(0x10000, 0x10, 32), 0);
+    REQUIRE_EQ(first.load_byte(0x2000), static_cast<uint8_t>(0x2000 * 7));
+    REQUIRE_THROWS(mips::ProgramImage(data, 0, 0x10));
+}
+
+TEST_CASE("Program cache - Builds each program once") {
+    using Kind = mips::ProgramCache::Kind;
+    mips::ProgramCache cache(2);
+    std::string first = "main:\n    addi $a0, $zero, 1\n    trap 5\n";
+    std::string second = "main:\n    addi $a0, $zero, 2\n    trap 5\n";
+    
+    auto image = cache.get(Kind::ASSEMBLY, first);
+    REQUIRE(cache.get(Kind::ASSEMBLY, first) == image);
+    REQUIRE(cache.get(Kind::ASSEMBLY, second) != image);
+    REQUIRE_EQ(cache.hits(), 1u);
+    REQUIRE_EQ(cache.misses(), 2u);
+    
+    // least recently used goes first
+    cache.get(Kind::ASSEMBLY, first);
+    cache.get(Kind::ASSEMBLY, "main:\n    trap 5\n");
+    REQUIRE_EQ(cache.size(), 2u);
+    REQUIRE(cache.get(Kind::ASSEMBLY, first) == image);
+    REQUIRE_EQ(cache.misses(), 3u);
+    
+    REQUIRE_THROWS(cache.get(Kind::ASSEMBLY, "main:\n    bogus $t0\n"));
+    REQUIRE_THROWS(cache.get(Kind::BINARY, std::string("\0\0\0\0\xff\xff\xff\xff", 8)));
+    REQUIRE_EQ(cache.get(Kind::BINARY, std::string("\x04\0\0\0\x04\0\0\0abcd", 12))->main_address(), 4u);
+}
+
+TEST_CASE("Assembly cache - Entries survive the process and are evicted by size") {
+    std::string directory = (std::filesystem::temp_directory_path()
+                             / ("mips-cache-test-" + std::to_string(getpid()))).string();
+    std::filesystem::remove_all(directory);
+    std::string first = "main:\n    addi $a0, $zero, 1\n    trap 5\n";
+    std::string second = "main:\n    addi $a0, $zero, 2\n    trap 5\n";
+    mips::SparseBinary data;
+    std::fill_n(data.append(1000), 1000, 0x5A);
+    auto entry = [&](const std::string& source) {
+        char name[24];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(mips::AssemblyCache::hash(source)));
+        return directory + "/" + name;
+    };
+    
+    {
+        mips::AssemblyCache cache(directory, 2500);
+        REQUIRE(cache.find(first) == nullptr);
+        cache.store(first, data, 8);
+    }
+    mips::AssemblyCache cache(directory, 2500); // another process would see the same
+    auto hit = cache.find(first);
+    REQUIRE(hit != nullptr);
+    REQUIRE_EQ(hit->main_address(), 8u);
+    REQUIRE_EQ(hit->size(), data.size);
+    REQUIRE(std::memcmp(hit->data(), data.data.data(), data.data.size()) == 0);
+    REQUIRE(cache.find(second) == nullptr);
+    REQUIRE(mips::AssemblyCache::hash(first) != mips::AssemblyCache::hash(second));
+    
+    // the least recently used entry goes once a third does not fit; the times are set
+    // rather than waited for, file systems differ in timestamp granularity
+    cache.store(second, data, 0);
+    auto now = std::filesystem::file_time_type::clock::now();
+    std::filesystem::last_write_time(entry(first), now - std::chrono::hours(2));
+    std::filesystem::last_write_time(entry(second), now - std::chrono::hours(1));
+    REQUIRE(cache.find(first) != nullptr); // used again, now the newest
+    mips::SparseBinary sparse = data;
+    sparse.append_zeros(0x100000);
+    sparse.append(4)[3] = 0x7F;
+    cache.store("main:\n    trap 10\n", sparse, 0);
+    REQUIRE(cache.find(second) == nullptr);
+    REQUIRE(cache.find(first) != nullptr);
+    REQUIRE_EQ(hit->data()[0], 0x5Au); // a mapping outlives eviction
+    
+    // a sparse entry keeps its zero ranges out of the file
+    auto sparse_hit = cache.find("main:\n    trap 10\n");
+    REQUIRE(sparse_hit != nullptr);
+    REQUIRE_EQ(sparse_hit->size(), 1000u + 0x100000 + 4);
+    mips::MachineState state;
+    sparse_hit->load_into(state);
+    REQUIRE_EQ(state.load_byte(999), 0x5Au);
+    REQUIRE_EQ(state.load_byte(1000 + 0x80000), 0u);
+    REQUIRE_EQ(state.load_byte(1000 + 0x100000 + 3), 0x7Fu);
+    REQUIRE(state.resident_pages() <= 2);
+    
+    // an entry whose key and length match but whose source differs, as two colliding
+    // sources would leave it, is a miss
+    std::string colliding = "main:\n    addi $a0, $zero, 3\n    trap 5\n";
+    uint64_t colliding_key = mips::AssemblyCache::hash(colliding);
+    std::filesystem::copy_file(entry(first), entry(colliding));
+    {
+        int fd = open(entry(colliding).c_str(), O_WRONLY);
+        REQUIRE(fd >= 0);
+        REQUIRE_EQ(pwrite(fd, &colliding_key, sizeof(colliding_key), offsetof(mips::AssemblyCacheHeader, source_hash)),
+                   static_cast<ssize_t>(sizeof(colliding_key)));
+        close(fd);
+    }
+    REQUIRE(cache.find(colliding) == nullptr);
+    
+    // a damaged entry is a miss
+    std::filesystem::resize_file(entry(first), 100);
+    REQUIRE(cache.find(first) == nullptr);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("ThreadPool - Runs every task") {
+    std::atomic<int> sum(0);
+    {
+        mips::ThreadPool pool(4);
+        for (int i = 1; i <= 100; ++i) {
+            pool.submit([&sum, i] { sum += i; });
+        }
+        pool.wait_idle();
+        REQUIRE_EQ(sum.load(), 5050);
+        REQUIRE_EQ(pool.size(), 4u);
+    }
+}
@@ -0,0 +1,98 @@
+#include "catch2.hpp"
+#include "../src/mips_vm.h"
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+void append_output(void* user_data, const char* data, size_t size) {
+    static_cast<std::string*>(user_data)->append(data, size);
+}
+
+size_t next_input(void* user_data, char* buffer, size_t capacity) {
+    auto* input = static_cast<std::string*>(user_data);
+    size_t count = std::min(capacity, input->size());
+    std::memcpy(buffer, input->data(), count);
+    input->erase(0, count);
+    return count;
+}
+
+// doubles each number read until 0
+const char* DOUBLER = R"(
+main:
+    trap 3
+    beq $v0, $zero, done
+    add $a0, $v0, $v0
+    trap 0
+    addi $a0, $zero, 32
+    trap 1
+    j main
+done:
+    trap 5
+)";
+
+} // namespace
+
+TEST_CASE("C API - Run with callbacks, budgets and reset") {
+    mips_vm* vm = mips_vm_create();
+    REQUIRE(vm != nullptr);
+    std::string output;
+    std::string input = "1 2 3 0";
+    mips_vm_set_output(vm, append_output, &output);
+    mips_vm_set_input(vm, next_input, &input);
+    REQUIRE_EQ(mips_vm_load_assembly(vm, DOUBLER, std::strlen(DOUBLER)), MIPS_OK);
+    
+    uint64_t steps = 0;
+    REQUIRE_EQ(mips_vm_run(vm, 3, &steps), MIPS_STEP_LIMIT);
+    REQUIRE_EQ(steps, 3u);
+    REQUIRE_EQ(mips_vm_run(vm, 0, &steps), MIPS_HALTED);
+    REQUIRE_EQ(output, "2 4 6 ");
+    
+    // a restart reads from the same callback
+    input = "21 0";
+    output.clear();
+    REQUIRE_EQ(mips_vm_reset(vm), MIPS_OK);
+    REQUIRE_EQ(mips_vm_run(vm, 0, nullptr), MIPS_HALTED);
+    REQUIRE_EQ(output, "42 ");
+    
+    REQUIRE_EQ(mips_vm_load_assembly(vm, "main:\n    bogus $t0\n", 19), MIPS_ERROR);
+    REQUIRE(std::string(mips_vm_last_error(vm)).find("bogus") != std::string::npos);
+    REQUIRE_EQ(mips_vm_load_assembly(vm, "main:\n    trap 999\n", 19), MIPS_OK);
+    REQUIRE_EQ(mips_vm_run(vm, 0, nullptr), MIPS_ERROR);
+    REQUIRE(std::string(mips_vm_last_error(vm)).find("trap") != std::string::npos);
+    mips_vm_destroy(vm);
+}
+
+TEST_CASE("C API - Registers and memory") {
+    mips_vm* vm = mips_vm_create();
+    const char* program = "main:\n    lw $t0, 0($a0)\n    add $t0, $t0, $t0\n    sw $t0, 4($a0)\n    trap 5\n";
+    REQUIRE_EQ(mips_vm_load_assembly(vm, program, std::strlen(program)), MIPS_OK);
+    
+    uint8_t* window = mips_vm_map_memory(vm, 0x20000, 0x2000);
+    REQUIRE(window != nullptr);
+    uint32_t value = 0x01020304;
+    REQUIRE_EQ(mips_vm_write(vm, 0x20000, &value, 4), MIPS_OK);
+    REQUIRE_EQ(std::memcmp(window, &value, 4), 0); // same bytes, no copy
+    
+    // the window is anonymous, nothing named for other processes to find
+    std::string prefix = "mips-vm-" + std::to_string(getpid()) + "-";
+    std::error_code error;
+    for (std::filesystem::directory_iterator it("/dev/shm", error), end; !error && it != end; it.increment(error)) {
+        REQUIRE(it->path().filename().string().rfind(prefix, 0) != 0);
+    }
+    mips_vm_set_register(vm, 4, 0x20000);
+    REQUIRE_EQ(mips_vm_run(vm, 0, nullptr), MIPS_HALTED);
+    REQUIRE_EQ(mips_vm_get_register(vm, 8), 0x02040608u);
+    
+    uint32_t doubled = 0;
+    std::memcpy(&doubled, window + 4, 4);
+    uint32_t copied = 0;
+    REQUIRE_EQ(mips_vm_read(vm, 0x20004, &copied, 4), MIPS_OK);
+    REQUIRE_EQ(doubled, copied);
+    
+    REQUIRE(mips_vm_map_memory(vm, 0x20010, 0x1000) == nullptr); // not page aligned
+    REQUIRE_EQ(mips_vm_read(vm, 0xFFFFFFFE, &copied, 4), MIPS_ERROR);
+    mips_vm_destroy(vm);
+}